@@ -0,0 +1,231 @@
+/*
+Alarm decisions replayed on the host over a long 12 bit temperature trace.
+
+The same trace goes through the float comparisons the zones used to make and through the comparisons on
+raw 1/128 °C values (thresholds converted once by celsiusToRawCeil/Floor of the engine, as setZoneThresholds() does),
+for many random threshold sets. The raw readings then go through alarmStep(), the table-driven engine
+that replaced the branching code. Every reading must give the same emails in all three; the time per
+reading of each is printed:
+
+  .pio/build/alarmbench/program          exits with 1 if any decision differs
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include "AlarmEngine.h"
+
+#define TRACE_LENGTH 1000000
+#define THRESHOLD_SETS 200
+#define SAMPLE_PERIOD 10000  // Milliseconds between two readings, the clock wraps as millis() does
+#define NOTIFY_INTERVAL 600000  // Milliseconds between repeated emails
+
+enum email {EMAIL_NONE, EMAIL_PRE_ALARM = 1, EMAIL_ALARM = 2, EMAIL_ALARM_RESET = 4};
+
+struct thresholdSet {
+  float preAlarm, alarm, resetThreshold;  // °C, as in the configuration
+  int16_t preAlarmRaw, alarmRaw, preAlarmResetRaw, alarmResetRaw;
+};
+
+struct zoneState {
+  int status = IDLE;
+  int previousStatus = IDLE;
+  bool firstTempAlarm = true;
+  uint32_t lastAlarmEmailTime = 0;
+};
+
+int16_t trace[TRACE_LENGTH];
+uint8_t floatEmails[TRACE_LENGTH];
+uint8_t rawEmails[TRACE_LENGTH];
+uint8_t engineEmails[TRACE_LENGTH];
+
+uint32_t nextRandom(uint32_t &x)
+{
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+// A room drifting between 10 and 60 °C in 12 bit steps (1/16 °C), with bursts of fast heating
+void makeTrace()
+{
+  uint32_t random = 0x1234567;
+  int16_t raw = 20 * 128;
+  int heating = 0;
+  for (int i = 0; i < TRACE_LENGTH; i++)
+  {
+    if (heating == 0 && nextRandom(random) % 2000 == 0) heating = 200;
+    int step = (int)(nextRandom(random) % 5) - 2;
+    if (heating > 0)
+    {
+      heating--;
+      step += 2;
+    }
+    raw += step * 8;
+    if (raw < 10 * 128) raw = 10 * 128;
+    if (raw > 60 * 128) raw = 60 * 128;
+    trace[i] = raw;
+  }
+}
+
+thresholdSet makeThresholds(uint32_t &random)
+{
+  thresholdSet t;
+  t.preAlarm = 20 + (nextRandom(random) % 2000) / 100.0f;
+  t.alarm = t.preAlarm + 0.5f + (nextRandom(random) % 500) / 100.0f;
+  t.resetThreshold = 0.1f + (nextRandom(random) % 300) / 100.0f;
+  t.preAlarmRaw = celsiusToRawCeil(t.preAlarm);
+  t.alarmRaw = celsiusToRawCeil(t.alarm);
+  t.preAlarmResetRaw = celsiusToRawFloor(t.preAlarm - t.resetThreshold);
+  t.alarmResetRaw = celsiusToRawFloor(t.alarm - t.resetThreshold);
+  return t;
+}
+
+// The zone logic as it was, on the reading in °C
+uint8_t evaluateFloat(zoneState &z, const thresholdSet &t, float tempC, uint32_t now)
+{
+  uint8_t emails = EMAIL_NONE;
+  if ((z.status == IDLE || z.status == PRE_ALARM) && (tempC >= t.preAlarm && tempC < t.alarm))
+  {
+    if (z.firstTempAlarm || now - z.lastAlarmEmailTime > NOTIFY_INTERVAL)
+    {
+      z.status = PRE_ALARM;
+      z.firstTempAlarm = false;
+      emails |= EMAIL_PRE_ALARM;
+      z.lastAlarmEmailTime = now;
+    }
+  }
+  else if ((z.status == IDLE || z.status == PRE_ALARM || z.status == ALARM) && tempC >= t.alarm)
+  {
+    z.status = ALARM;
+    if (z.previousStatus != z.status) z.firstTempAlarm = true;
+    if (z.firstTempAlarm || now - z.lastAlarmEmailTime > NOTIFY_INTERVAL)
+    {
+      z.firstTempAlarm = false;
+      emails |= EMAIL_ALARM;
+      z.lastAlarmEmailTime = now;
+    }
+  }
+  if ((z.status == PRE_ALARM) && tempC <= t.preAlarm - t.resetThreshold)
+  {
+    z.status = IDLE;
+    z.firstTempAlarm = true;
+    emails |= EMAIL_ALARM_RESET;
+  }
+  else if ((z.status == ALARM) && tempC <= t.alarm - t.resetThreshold)
+  {
+    z.status = PRE_ALARM;
+    z.firstTempAlarm = true;
+    emails |= EMAIL_PRE_ALARM;
+  }
+  z.previousStatus = z.status;
+  return emails;
+}
+
+// The same logic on the raw reading and the thresholds converted once
+uint8_t evaluateRaw(zoneState &z, const thresholdSet &t, int16_t raw, uint32_t now)
+{
+  uint8_t emails = EMAIL_NONE;
+  if ((z.status == IDLE || z.status == PRE_ALARM) && (raw >= t.preAlarmRaw && raw < t.alarmRaw))
+  {
+    if (z.firstTempAlarm || now - z.lastAlarmEmailTime > NOTIFY_INTERVAL)
+    {
+      z.status = PRE_ALARM;
+      z.firstTempAlarm = false;
+      emails |= EMAIL_PRE_ALARM;
+      z.lastAlarmEmailTime = now;
+    }
+  }
+  else if ((z.status == IDLE || z.status == PRE_ALARM || z.status == ALARM) && raw >= t.alarmRaw)
+  {
+    z.status = ALARM;
+    if (z.previousStatus != z.status) z.firstTempAlarm = true;
+    if (z.firstTempAlarm || now - z.lastAlarmEmailTime > NOTIFY_INTERVAL)
+    {
+      z.firstTempAlarm = false;
+      emails |= EMAIL_ALARM;
+      z.lastAlarmEmailTime = now;
+    }
+  }
+  if ((z.status == PRE_ALARM) && raw <= t.preAlarmResetRaw)
+  {
+    z.status = IDLE;
+    z.firstTempAlarm = true;
+    emails |= EMAIL_ALARM_RESET;
+  }
+  else if ((z.status == ALARM) && raw <= t.alarmResetRaw)
+  {
+    z.status = PRE_ALARM;
+    z.firstTempAlarm = true;
+    emails |= EMAIL_PRE_ALARM;
+  }
+  z.previousStatus = z.status;
+  return emails;
+}
+
+// The emails of the actions returned by alarmStep()
+uint8_t engineStep(alarmState &state, const alarmThresholds &thresholds, const alarmSettings &settings, int16_t raw,
+                   uint32_t now)
+{
+  uint8_t actions = alarmStep(state, thresholds, settings, now, true, raw);
+  return (actions & ACTION_NOTIFY_PRE_ALARM ? EMAIL_PRE_ALARM : 0) | (actions & ACTION_NOTIFY_ALARM ? EMAIL_ALARM : 0) |
+         (actions & ACTION_NOTIFY_ALARM_RESET ? EMAIL_ALARM_RESET : 0);
+}
+
+// Nanoseconds per reading taken by one replay of the trace
+template <typename Replay>
+double timeReplay(Replay replay)
+{
+  auto start = std::chrono::steady_clock::now();
+  replay();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / TRACE_LENGTH;
+}
+
+int main()
+{
+  makeTrace();
+
+  uint32_t random = 0xC0FFEE;
+  const alarmSettings settings = {3, NOTIFY_INTERVAL};
+  double floatTime = 0, rawTime = 0, engineTime = 0;
+  long differences = 0, emailCount = 0;
+  for (int set = 0; set < THRESHOLD_SETS; set++)
+  {
+    thresholdSet t = makeThresholds(random);
+    floatTime += timeReplay([&] {
+      zoneState z;
+      for (int i = 0; i < TRACE_LENGTH; i++) floatEmails[i] = evaluateFloat(z, t, trace[i] / 128.0f, (uint32_t)i * SAMPLE_PERIOD);
+    });
+    rawTime += timeReplay([&] {
+      zoneState z;
+      for (int i = 0; i < TRACE_LENGTH; i++) rawEmails[i] = evaluateRaw(z, t, trace[i], (uint32_t)i * SAMPLE_PERIOD);
+    });
+    const alarmThresholds thresholds = {t.preAlarmRaw, t.alarmRaw, t.preAlarmResetRaw, t.alarmResetRaw};
+    engineTime += timeReplay([&] {
+      alarmState state;
+      for (int i = 0; i < TRACE_LENGTH; i++)
+        engineEmails[i] = engineStep(state, thresholds, settings, trace[i], (uint32_t)i * SAMPLE_PERIOD);
+    });
+    for (int i = 0; i < TRACE_LENGTH; i++)
+    {
+      if (floatEmails[i] != rawEmails[i] || rawEmails[i] != engineEmails[i])
+      {
+        if (differences < 10)
+          printf("set %d (%.2f %.2f %.2f) reading %d (%.4f °C): float %u raw %u engine %u\n", set, t.preAlarm, t.alarm,
+                 t.resetThreshold, i, trace[i] / 128.0, floatEmails[i], rawEmails[i], engineEmails[i]);
+        differences++;
+      }
+      if (floatEmails[i]) emailCount++;
+    }
+  }
+
+  printf("# %d threshold sets over %d readings, %ld emails\n", THRESHOLD_SETS, TRACE_LENGTH, emailCount);
+  printf("float  %6.2f ns/reading\n", floatTime / THRESHOLD_SETS);
+  printf("raw    %6.2f ns/reading\n", rawTime / THRESHOLD_SETS);
+  printf("engine %6.2f ns/reading\n", engineTime / THRESHOLD_SETS);
+  printf("%ld decisions differ\n", differences);
+  return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+Bus cost of the DallasTemperature operations, from 1 to 64 devices on one simulated bus (see lib/OneWireSim).
+
+Every operation is run on a fresh bus of DS18B20 with pseudo-random serial numbers and its resets,
+slots, bytes and bus time are printed, one line per operation and device count. The simulation is
+deterministic, so the output can be stored and compared:
+
+  .pio/build/bench/program > bench/baseline.txt       stores a new baseline
+  .pio/build/bench/program bench/baseline.txt         compares, exits with 1 if an operation got slower
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+
+#define BENCH_MAX_DEVICES 64
+#define BENCH_MAX_RESULTS 128
+#define BENCH_NAME_SIZE 32
+
+const int deviceCounts[] = {1, 2, 4, 8, 16, 32, 64};
+
+struct benchResult {
+  char name[BENCH_NAME_SIZE];
+  int devices;
+  oneWireStats stats;
+};
+
+benchResult results[BENCH_MAX_RESULTS];
+int resultCount = 0;
+
+// A bus of DS18B20 with their temperatures set, DallasTemperature not started yet
+struct benchBus {
+  OneWire wire;
+  SimDevice *devices[BENCH_MAX_DEVICES];
+  int deviceCount;
+  DallasTemperature sensors;
+
+  benchBus(int count) : wire(1), deviceCount(count), sensors(&wire)
+  {
+    uint64_t serial = 0x5EED;
+    for (int i = 0; i < count; i++)
+    {
+      serial = serial * 6364136223846793005ULL + 1442695040888963407ULL;  // Same serials on every run
+      devices[i] = new SimDevice(SIM_DS18B20, serial >> 16);
+      devices[i]->setTemperature(20 + i * 0.25f);
+      wire.attach(*devices[i]);
+    }
+  }
+  ~benchBus()
+  {
+    for (int i = 0; i < deviceCount; i++) delete devices[i];
+  }
+};
+
+typedef void BenchOperation(benchBus &bus);
+
+// Sets up a bus, runs the operation and records what it cost on the bus
+void measure(const char *name, int devices, BenchOperation *prepare, BenchOperation *operation)
+{
+  benchBus bus(devices);
+  if (prepare) prepare(bus);
+  simAdvance(1000000 - simMicros() % 1000000);  // Same clock phase whatever ran before, for the polling loops
+  bus.wire.clearStats();
+  operation(bus);
+
+  benchResult &r = results[resultCount++];
+  snprintf(r.name, BENCH_NAME_SIZE, "%s", name);
+  r.devices = devices;
+  r.stats = bus.wire.stats();
+}
+
+void begin(benchBus &bus) { bus.sensors.begin(); }
+void beginAndConvert(benchBus &bus)
+{
+  bus.sensors.begin();
+  bus.sensors.setWaitForConversion(false);
+  bus.sensors.requestTemperatures();
+  delay(750);
+}
+void beginAndAlarm(benchBus &bus)
+{
+  beginAndConvert(bus);
+  // TH is at 75 °C, only the last device is in alarm
+  for (int i = 0; i < bus.deviceCount; i++) bus.sensors.setLowAlarmTemp(bus.devices[i]->rom(), -55);
+  bus.devices[bus.deviceCount - 1]->setTemperature(80);
+  bus.sensors.requestTemperatures();
+  delay(750);
+}
+
+void getLastAddress(benchBus &bus)
+{
+  DeviceAddress address;
+  bus.sensors.getAddress(address, bus.deviceCount - 1);
+}
+// Every device by index, as the sketches do after begin(): from the address table...
+void getAddressAll(benchBus &bus)
+{
+  DeviceAddress address;
+  for (int i = 0; i < bus.deviceCount; i++) bus.sensors.getAddress(address, i);
+}
+// ...and with one ROM search per index, as before the table
+void searchAddressAll(benchBus &bus)
+{
+  bus.sensors.invalidateAddressTable();
+  getAddressAll(bus);
+}
+void setResolution(benchBus &bus) { bus.sensors.setResolution(11); }
+void setConfigurationAll(benchBus &bus) { bus.sensors.setConfigurationAll(11, 30, -55); }
+void beginAndConfigure(benchBus &bus)
+{
+  bus.sensors.begin();
+  setConfigurationAll(bus);
+}
+void getTempCByIndex(benchBus &bus) { bus.sensors.getTempCByIndex(bus.deviceCount - 1); }
+void getTemp(benchBus &bus) { bus.sensors.getTemp(bus.devices[0]->rom()); }
+// Blocking: polls the bus with read slots until the conversion is over
+void requestTemperatures(benchBus &bus) { bus.sensors.requestTemperatures(); }
+void requestTemperaturesAsync(benchBus &bus)
+{
+  bus.sensors.setWaitForConversion(false);
+  bus.sensors.requestTemperatures();
+}
+void alarmSearch(benchBus &bus)
+{
+  DeviceAddress address;
+  bus.sensors.resetAlarmSearch();
+  while (bus.sensors.alarmSearch(address));
+}
+void readAll(benchBus &bus)
+{
+  for (int i = 0; i < bus.deviceCount; i++) bus.sensors.getTemp(bus.devices[i]->rom());
+}
+
+void printResult(FILE *out, const benchResult &r)
+{
+  const oneWireStats &s = r.stats;
+  fprintf(out, "%-27s %3d %6u %8u %8u %7u %7u %11llu\n", r.name, r.devices, (unsigned)s.resets, (unsigned)s.bitsWritten,
+          (unsigned)s.bitsRead, (unsigned)s.bytesWritten, (unsigned)s.bytesRead, (unsigned long long)s.busTime);
+}
+
+// Compares the results with a stored baseline. Returns the number of operations that got slower
+int compare(const char *path)
+{
+  FILE *in = fopen(path, "r");
+  if (!in)
+  {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return -1;
+  }
+
+  int slower = 0, matched = 0;
+  char line[160];
+  while (fgets(line, sizeof(line), in))
+  {
+    if (line[0] == '#') continue;
+    char name[BENCH_NAME_SIZE];
+    int devices;
+    unsigned long long busTime;
+    unsigned resets, bitsWritten, bitsRead, bytesWritten, bytesRead;
+    if (sscanf(line, "%31s %d %u %u %u %u %u %llu", name, &devices, &resets, &bitsWritten, &bitsRead, &bytesWritten,
+               &bytesRead, &busTime) != 8) continue;
+    for (int i = 0; i < resultCount; i++)
+    {
+      const benchResult &r = results[i];
+      if (strcmp(r.name, name) != 0 || r.devices != devices) continue;
+      matched++;
+      if (r.stats.busTime == busTime) break;
+      double change = 100.0 * ((double)r.stats.busTime - busTime) / busTime;
+      printf("%-27s %3d %11llu -> %11llu us (%+.1f%%)\n", name, devices, busTime, (unsigned long long)r.stats.busTime, change);
+      if (r.stats.busTime > busTime) slower++;
+      break;
+    }
+  }
+  fclose(in);
+  printf("%d operations compared, %d slower than the baseline\n", matched, slower);
+  return slower;
+}
+
+int main(int argc, char **argv)
+{
+  for (int n : deviceCounts)
+  {
+    measure("begin", n, nullptr, begin);
+    measure("getAddress(last)", n, begin, getLastAddress);
+    measure("getAddress(all)", n, begin, getAddressAll);
+    measure("getAddress(all,search)", n, begin, searchAddressAll);
+    measure("setResolution", n, begin, setResolution);
+    measure("setConfigurationAll", n, begin, setConfigurationAll);
+    measure("setConfigurationAll(same)", n, beginAndConfigure, setConfigurationAll);
+    measure("requestTemperatures", n, begin, requestTemperatures);
+    measure("requestTemperatures(async)", n, begin, requestTemperaturesAsync);
+    measure("getTemp", n, beginAndConvert, getTemp);
+    measure("getTemp(all)", n, beginAndConvert, readAll);
+    measure("getTempCByIndex(last)", n, beginAndConvert, getTempCByIndex);
+    measure("alarmSearch(1 alarmed)", n, beginAndAlarm, alarmSearch);
+  }
+
+  if (argc > 1) return compare(argv[1]) == 0 ? 0 : 1;
+
+  printf("# Bus cost of DallasTemperature operations on simulated DS18B20, standard speed (%d us reset, %d us slot)\n",
+         ONEWIRE_SIM_RESET_TIME, ONEWIRE_SIM_SLOT_TIME);
+  printf("# operation               devices resets bits_wr  bits_rd bytes_wr bytes_rd  bus_time_us\n");
+  for (int i = 0; i < resultCount; i++) printResult(stdout, results[i]);
+  return 0;
+}
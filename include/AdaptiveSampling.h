@@ -0,0 +1,39 @@
+/*
+Adaptive sampling rate and resolution.
+
+samplingLevelFor() tells how closely a zone needs to be watched, from its last two readings and its
+thresholds: slowly and at low resolution while it sits far below the pre alarm threshold, faster and
+at high resolution when it gets close to it or climbs quickly. The monitor samples at the highest
+level asked by any zone. Like the alarm engine it builds and runs on the host.
+*/
+
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+#include <stdint.h>
+#include "AlarmEngine.h"
+
+enum sampling_level {SAMPLING_SLOW, SAMPLING_NORMAL, SAMPLING_FAST};
+
+struct samplingSettings {
+  uint16_t intervalPercent;  // Sampling interval, in percent of the configured mesurement interval
+  uint8_t resolution;  // Sensor resolution (bits)
+};
+
+// Indexed by sampling_level
+extern const samplingSettings samplingLevels[3];
+
+#define SAMPLING_NEAR_MARGIN 128  // 1 °C under the threshold the zone is sampled fast
+#define SAMPLING_FAR_MARGIN 384  // 3 °C under the threshold a steady zone is sampled slowly
+#define SAMPLING_STEADY_RATE 40  // Change (1/128 °C per minute) under which a zone is steady: 0.3 °C/min, above one 9 bit step per slow interval
+#define SAMPLING_LOOKAHEAD 10  // Minutes: a zone that would reach the threshold sooner at its current rate is sampled fast
+#define SAMPLING_MIN_INTERVAL 10000  // Milliseconds, fast sampling never goes below this
+
+// Level wanted by a zone. previousRaw and elapsed (milliseconds between the two readings) give the rate of change,
+// elapsed 0 if there is only one reading
+uint8_t samplingLevelFor(uint8_t status, int16_t raw, int16_t previousRaw, uint32_t elapsed, const alarmThresholds &thresholds);
+
+// Sampling interval (milliseconds) of a level
+uint32_t samplingInterval(uint8_t level, uint32_t configuredInterval);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+Alarm state machine of a zone.
+
+alarmStep() takes one reading of the zone and returns what has to be done about it (emails to send,
+status changes to show on the LED). It has no side effects other than updating the alarmState it is
+given and does not read the clock, so it builds and runs on the host as well as on the ESP32.
+
+The temperature transitions are in a table indexed by the current status and by the band the
+reading falls in, relative to the zone thresholds.
+*/
+
+#ifndef ALARM_ENGINE_H
+#define ALARM_ENGINE_H
+
+#include <stdint.h>
+
+enum system_status{IDLE, PRE_ALARM, ALARM, SENSOR_FAILURE, CONFIG};
+
+// Actions returned by alarmStep(), more than one can be set
+#define ACTION_NOTIFY_PRE_ALARM 0x01
+#define ACTION_NOTIFY_ALARM 0x02
+#define ACTION_NOTIFY_ALARM_RESET 0x04
+#define ACTION_NOTIFY_SENSOR_FAILURE 0x08
+#define ACTION_STATUS_CHANGED 0x10  // The LED pattern has to be updated
+
+// Zone thresholds in raw sensor units (1/128 °C)
+struct alarmThresholds {
+  int16_t preAlarm;  // Lowest reading in pre alarm
+  int16_t alarm;  // Lowest reading in alarm
+  int16_t preAlarmReset;  // Highest reading which resets the pre alarm
+  int16_t alarmReset;  // Highest reading which resets the alarm
+};
+
+// Smallest raw value at or above a temperature: a reading is over a threshold converted this way exactly when
+// its value in °C would be
+int16_t celsiusToRawCeil(float celsius);
+// Largest raw value at or below a temperature, for the reset levels
+int16_t celsiusToRawFloor(float celsius);
+
+// Settings shared by all the zones
+struct alarmSettings {
+  uint8_t failureReadings;  // Consecutive reading errors after which a zone is in SENSOR_FAILURE
+  uint32_t notifyInterval;  // Time (milliseconds) between repeated alarm or failure emails
+};
+
+struct alarmState {
+  uint8_t status = IDLE;  // IDLE/PRE_ALARM/ALARM/SENSOR_FAILURE
+  uint8_t failedReadings = 0;  // Consecutive reading errors, only a valid reading clears them
+  bool notifyTempNow = true;  // The next temperature alarm is notified without waiting notifyInterval
+  bool notifyFailureNow = true;  // The next sensor failure is notified without waiting notifyInterval
+  int16_t lastRaw = -7040;  // Last valid reading, DEVICE_DISCONNECTED_RAW until there is one
+  uint32_t lastTempNotify = 0;  // Time (milliseconds) of the last temperature alarm email
+  uint32_t lastFailureNotify = 0;  // Time (milliseconds) of the last sensor failure email
+};
+
+// Updates the state with a reading taken at "now" (milliseconds, may wrap) and returns the ACTION_ flags.
+// When valid is false the reading failed and raw is ignored, the last valid reading is evaluated again
+uint8_t alarmStep(alarmState &state, const alarmThresholds &thresholds, const alarmSettings &settings,
+                  uint32_t now, bool valid, int16_t raw);
+
+#endif
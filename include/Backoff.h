@@ -0,0 +1,38 @@
+/*
+Wait before retrying a connection that failed, shared by the WiFi link and the MQTT client.
+
+The wait is exponential with jitter: the minimum doubled at each failure in a row up to the maximum, taken
+at random in its upper half so that the devices of a site do not all retry together when the access point
+or the broker comes back. The random sequence is xorshift32, good enough to spread the attempts; the seed
+comes from the caller (esp_random() on the device), so Backoff builds and runs on the host.
+*/
+
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+class Backoff
+{
+public:
+  // Waits in milliseconds. seed starts the random sequence of the jitter
+  Backoff(uint32_t min, uint32_t max, uint32_t seed);
+
+  // Counts one more failure and returns the milliseconds to wait before the next attempt
+  uint32_t next();
+
+  // After a success: the next failure waits the minimum again
+  void reset() { _failures = 0; }
+
+  uint8_t failures() const { return _failures; }
+
+private:
+  uint32_t _min;
+  uint32_t _max;
+  uint32_t _random;
+  uint8_t _failures = 0;  // In a row
+
+  uint32_t nextRandom();
+};
+
+#endif
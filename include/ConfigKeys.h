@@ -0,0 +1,66 @@
+/*
+Configuration fields by name, for the serial command protocol.
+
+Every field of the configuration that can be read or written from the serial port has an entry in a
+table built at compile time: its name, type, limits and where it lives in the structure. The device
+fields are named after their place in deviceConfig ("network.ssid", "alarms.alarmTemperature"), the zone
+fields after their place in zoneConfig ("name", "preAlarmTemperature"), the protocol adds "zone.<n>." in
+front. Values are read and written as text:
+  string  - as typed, up to the size of the field
+  secret  - a string that is shown with all but its first and last character hidden
+  bool    - "yes" or "no"
+  float   - decimal number within the limits
+  int     - integer within the limits
+  address - ROM code as 16 hex digits, read only
+Like the alarm engine this builds and runs on the host.
+*/
+
+#ifndef CONFIG_KEYS_H
+#define CONFIG_KEYS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "DeviceConfig.h"
+
+#define CONFIG_VALUE_SIZE (CONFIG_STRING_SIZE + 1)  // Longest value as text, terminator included
+
+enum config_key_type : uint8_t {KEY_STRING, KEY_SECRET, KEY_BOOL, KEY_FLOAT, KEY_INT, KEY_ADDRESS};
+
+// Reply status of the serial commands, sent as a number followed by its name
+enum config_status : uint8_t {
+  CONFIG_OK,
+  CONFIG_UNKNOWN_COMMAND,
+  CONFIG_BAD_ARGUMENTS,
+  CONFIG_UNKNOWN_KEY,
+  CONFIG_BAD_VALUE,
+  CONFIG_READ_ONLY,
+  CONFIG_INVALID,  // The values taken together are not valid, e.g. a pre alarm over the alarm
+  CONFIG_SAVE_FAILED,
+};
+
+struct configKey {
+  const char *name;
+  uint8_t type;
+  uint16_t offset;  // From the start of deviceConfig, or of zoneConfig for the zone fields
+  uint16_t size;  // Of the field, terminator included for the strings
+  float min;  // Limits of the float and int fields
+  float max;
+};
+
+extern const configKey deviceKeys[];
+extern const size_t deviceKeyCount;
+extern const configKey zoneKeys[];
+extern const size_t zoneKeyCount;
+
+// Entry of a name in a table, nullptr if there is none
+const configKey *findConfigKey(const configKey *keys, size_t count, const char *name);
+
+// Writes the field of "base" (a deviceConfig or a zoneConfig) as text. Returns the length, the text is empty if it does not fit
+size_t formatConfigValue(const void *base, const configKey &key, char *buffer, size_t size);
+
+// Sets the field of "base" from text. The field is left as it was unless CONFIG_OK is returned
+config_status parseConfigValue(void *base, const configKey &key, const char *text);
+
+const char *configStatusName(config_status status);
+
+#endif
@@ -0,0 +1,83 @@
+/*
+Typed configuration of the temperature monitor.
+
+The whole configuration lives in RAM in "config" and is stored in the NVS as a single
+versioned blob protected by a CRC32 ("config" namespace, "blob" key).
+It is read from flash once at startup and written back in one batch by saveConfig().
+Devices still using the old per-key namespaces ("network", "alarms", "email", "zones")
+are migrated the first time loadConfig() runs.
+*/
+
+#ifndef DEVICE_CONFIG_H
+#define DEVICE_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <DallasTemperature.h>
+
+#define CONFIG_VERSION 1
+#define SERIAL_BUFFER_SIZE 64
+#define WIFI_SSID_SIZE 32
+#define CONFIG_STRING_SIZE (SERIAL_BUFFER_SIZE + 1)
+#define MAX_ZONES 8  // Maximum number of sensors monitored, one zone per sensor
+#define ZONE_NAME_SIZE 24
+
+// Zone settings, matched to the sensors by ROM code
+struct zoneConfig {
+  DeviceAddress address;
+  char name[ZONE_NAME_SIZE];
+  float preAlarmTemperature;
+  float alarmTemperature;
+};
+
+struct networkConfig {
+  char ssid[WIFI_SSID_SIZE + 1];
+  bool isWpaEnterprise;
+  char passwd[CONFIG_STRING_SIZE];       // Not used with WPA2 enterprise
+  char eapID[CONFIG_STRING_SIZE];        // WPA2 enterprise only
+  char eapUsername[CONFIG_STRING_SIZE];  // WPA2 enterprise only
+  char eapPassword[CONFIG_STRING_SIZE];  // WPA2 enterprise only
+};
+
+struct alarmsConfig {
+  float preAlarmTemperature;  // Default pre alarm temperature of a new zone
+  float alarmTemperature;     // Default alarm temperature of a new zone
+  float alarmResetThreshold;  // Subtracted to a threshold to get the temperature under which the alarm is reset
+  int32_t mesureInterval;     // Seconds between mesurements
+  int32_t alarmInterval;      // Minutes between alarm emails
+};
+
+struct emailConfig {
+  char smtpServer[CONFIG_STRING_SIZE];
+  uint32_t smtpPort;
+  char senderAddress[CONFIG_STRING_SIZE];
+  char senderPassword[CONFIG_STRING_SIZE];
+  char authorName[CONFIG_STRING_SIZE];
+  char recipient[CONFIG_STRING_SIZE];
+  int32_t imAliveInterval;  // Hours between "I'm alive" emails
+};
+
+struct deviceConfig {
+  networkConfig network;
+  alarmsConfig alarms;
+  emailConfig email;
+  zoneConfig zones[MAX_ZONES];   // Settings of every sensor seen so far
+  bool zoneSlotUsed[MAX_ZONES];
+};
+
+extern deviceConfig config;
+
+// Fills the configuration with the factory defaults
+void setDefaultConfig(deviceConfig &cfg);
+
+// Loads the configuration from the NVS blob. If the blob is missing, from an older version
+// or corrupted, the old per-key namespaces are read instead and false is returned
+bool loadConfig(deviceConfig &cfg);
+
+// Writes the whole configuration to the NVS in a single blob
+bool saveConfig(const deviceConfig &cfg);
+
+// CRC32 (IEEE 802.3) used to validate the stored blob
+uint32_t configCrc32(const uint8_t *data, size_t length);
+
+#endif
@@ -0,0 +1,29 @@
+/*
+LedHal on the ESP32 LEDC peripheral.
+
+The three LEDs are LEDC channels on the same timer, so they blink in phase. The timer runs from the
+1 MHz REF_TICK with a fractional divider: the blink period is the whole PWM period and the on time is
+the duty cycle, so the LED blinks with no interrupt and no CPU time. Periods from 17 ms to 16 s are possible.
+*/
+
+#ifndef LEDC_LED_H
+#define LEDC_LED_H
+
+#include <stdint.h>
+#include "StatusLed.h"
+
+class LedcLed : public LedHal
+{
+public:
+  LedcLed(uint8_t redPin, uint8_t greenPin, uint8_t bluePin);
+
+  // Configures the LEDC timer and channels, the LED starts off
+  void begin();
+
+  void blink(uint8_t color, uint16_t onTime, uint16_t offTime) override;
+
+private:
+  uint8_t _pins[3];  // Red, green, blue
+};
+
+#endif
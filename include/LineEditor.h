@@ -0,0 +1,39 @@
+/*
+Line typed on the serial port, one byte at a time.
+
+feed() never waits: loop() hands it the bytes that have arrived and goes on with its jobs, the line is
+complete when feed() returns LINE_DONE. The caller echoes according to the event returned, so the editor
+knows nothing of the serial port and builds on the host:
+  LINE_CHAR  - a character was added (echo it, or '*' for a password)
+  LINE_ERASE - the last character was removed by backspace or DEL (echo "\b \b")
+  LINE_FULL  - the character did not fit and was dropped (ring the bell)
+  LINE_DONE  - CR or LF ended the line. The LF of a CR LF pair is skipped, it does not end an empty line
+*/
+
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <stddef.h>
+
+#define LINE_EDITOR_SIZE 64  // Longest line, as SERIAL_BUFFER_SIZE
+
+enum line_event {LINE_NONE, LINE_CHAR, LINE_ERASE, LINE_FULL, LINE_DONE};
+
+class LineEditor
+{
+public:
+  // Takes one byte of input. After LINE_DONE line() holds the line until the next byte is fed
+  line_event feed(char c);
+  void clear();
+
+  const char *line() const { return _buffer; }
+  size_t length() const { return _length; }
+
+private:
+  char _buffer[LINE_EDITOR_SIZE + 1] = {};
+  size_t _length = 0;
+  bool _done = false;  // The last byte ended a line
+  bool _afterCR = false;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+State of the monitor in the Prometheus text format, served on /metrics.
+
+formatMetrics() writes the whole response body into a buffer given by the caller, nothing is
+allocated. It only formats what it is given, so it builds and runs on the host: the native
+simulator prints the metrics of its zones at the end of the run.
+
+Exposed metrics (one sample per zone where there is a zone label):
+  tempmon_uptime_seconds                      seconds since startup
+  tempmon_status                              system status, see system_status in AlarmEngine.h
+  tempmon_wifi_rssi_dbm                       signal of the access point, absent when disconnected
+  tempmon_emails_sent_total                   emails accepted by the SMTP server
+  tempmon_emails_failed_total                 emails that could not be sent
+  tempmon_emails_dropped_total                emails dropped because the queue was full
+  tempmon_temperature_celsius{zone,sensor}    last valid reading, absent until there is one
+  tempmon_zone_status{zone,sensor}            status of the zone
+  tempmon_sensor_errors{zone,sensor}          consecutive failed readings of the sensor
+  tempmon_readings_rejected_total{zone,sensor,reason}  readings dropped by the zone filter
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "DeviceConfig.h"
+
+struct zoneMetrics {
+  DeviceAddress address;
+  char name[ZONE_NAME_SIZE];
+  int16_t raw;  // Last valid reading in 1/128 °C, DEVICE_DISCONNECTED_RAW if none
+  uint8_t status;
+  uint8_t failedReadings;
+  uint32_t rejectedPowerOn;
+  uint32_t rejectedSlew;
+};
+
+struct deviceMetrics {
+  uint32_t uptime;  // Seconds
+  uint8_t status;
+  bool wifiConnected;
+  int8_t rssi;  // dBm, only meaningful when wifiConnected
+  uint32_t emailsSent;
+  uint32_t emailsFailed;
+  uint32_t emailsDropped;
+  uint8_t zoneCount;
+  zoneMetrics zones[MAX_ZONES];
+};
+
+// Writes the metrics into buffer, null terminated. Returns the length written, 0 if the buffer is too small
+size_t formatMetrics(const deviceMetrics &metrics, char *buffer, size_t size);
+
+#endif
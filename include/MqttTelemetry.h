@@ -0,0 +1,148 @@
+/*
+Readings published to an MQTT broker in batches.
+
+Every reading is added to a batch. A batch is published when it holds settings.batchSamples readings
+or its oldest reading is settings.batchAge milliseconds old, so the radio wakes up once per batch
+instead of once per reading. The payload is compact JSON, times in seconds since startup and
+temperatures in raw sensor units (1/128 °C):
+  {"t":<time of the first reading>,"s":[[<zone>,<seconds after t>,<raw>],...]}
+
+Batches are published with QoS 1. Up to MQTT_MAX_INFLIGHT of them wait for their PUBACK: a batch
+is sent again with DUP set when it does not come within MQTT_RETRY_TIME, and after a reconnection.
+While the window is full, new readings wait in the batch, the oldest one is dropped when that is
+full too. A lost connection is retried after an exponential backoff with jitter (see Backoff.h), the
+readings keep being batched meanwhile.
+
+MqttTelemetry speaks MQTT 3.1.1 over an MqttTransport, does not read the clock and allocates
+nothing, so it builds and runs on the host: the native simulator publishes to a broker stand-in
+(sim/BrokerSim.h).
+*/
+
+#ifndef MQTT_TELEMETRY_H
+#define MQTT_TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Backoff.h"
+
+#define MQTT_MAX_INFLIGHT 4  // Batches waiting for their PUBACK
+#define MQTT_BATCH_MAX_SAMPLES 48  // Readings waiting to be published, the oldest ones are dropped beyond this
+#define MQTT_PAYLOAD_SIZE 512  // Longest payload, a batch that does not fit is split
+#define MQTT_TOPIC_SIZE 64  // Longer topics are cut
+#define MQTT_CLIENT_ID_SIZE 23  // Longest client id every broker has to accept, longer ones are cut
+#define MQTT_PACKET_SIZE (MQTT_PAYLOAD_SIZE + MQTT_TOPIC_SIZE + 16)
+#define MQTT_KEEPALIVE 60  // Seconds
+#define MQTT_CONNACK_TIMEOUT 5000  // Milliseconds
+#define MQTT_RETRY_TIME 10000  // Milliseconds waited for a PUBACK before publishing again
+#define MQTT_BACKOFF_MIN 1000  // Milliseconds before the first reconnection
+#define MQTT_BACKOFF_MAX 300000  // Longest wait between two reconnections
+#define MQTT_POLL_INTERVAL 100  // Milliseconds between two reads of the connection while an answer is expected
+#define MQTT_IDLE UINT32_MAX  // Returned by poll() when nothing is due
+
+// The connection to the broker
+class MqttTransport
+{
+public:
+  // Opens the connection, may block until it is open or has failed
+  virtual bool connect(const char *host, uint16_t port) = 0;
+  virtual bool connected() = 0;
+  // Returns the bytes written, less than length if the connection failed
+  virtual size_t write(const uint8_t *data, size_t length) = 0;
+  // Returns the bytes read, 0 if none is available. Never blocks
+  virtual size_t read(uint8_t *data, size_t length) = 0;
+  virtual void stop() = 0;
+};
+
+struct telemetrySample {
+  uint8_t zone;
+  uint32_t time;  // Seconds since startup
+  int16_t raw;  // 1/128 °C
+};
+
+struct mqttSettings {
+  const char *host;
+  uint16_t port;
+  const char *clientId;
+  const char *topic;
+  uint8_t batchSamples;  // Readings per batch, at most MQTT_BATCH_MAX_SAMPLES
+  uint32_t batchAge;  // Milliseconds the first reading of a batch waits at most
+};
+
+struct mqttStats {
+  uint32_t published;  // PUBLISH packets sent, retransmissions included
+  uint32_t acked;  // Batches acknowledged by the broker
+  uint32_t retransmitted;
+  uint32_t samplesDropped;  // Readings lost because the batch was full
+  uint32_t connects;  // Connections accepted by the broker
+  uint32_t connectFailures;  // Connections refused, failed or lost
+};
+
+class MqttTelemetry
+{
+public:
+  // seed starts the random sequence of the backoff jitter
+  MqttTelemetry(MqttTransport &transport, const mqttSettings &settings, uint32_t seed);
+
+  // Adds a reading taken at "now" (milliseconds, may wrap) to the batch
+  void add(const telemetrySample &sample, uint32_t now);
+
+  // Connects, publishes the batches that are ready and handles the answers of the broker. Returns the
+  // milliseconds until it has to be called again, MQTT_IDLE if only a new reading would give it work
+  uint32_t poll(uint32_t now);
+
+  bool connected() const { return _state == CONNECTED; }
+  const mqttStats &stats() const { return _stats; }
+
+private:
+  enum connection_state {DISCONNECTED, CONNECTING, CONNECTED};
+
+  // A batch waiting for its PUBACK
+  struct inflightBatch {
+    bool used;
+    bool sent;  // Sent on the current connection
+    uint16_t packetId;
+    uint32_t sentTime;
+    uint16_t length;
+    char payload[MQTT_PAYLOAD_SIZE];
+  };
+
+  MqttTransport &_transport;
+  mqttSettings _settings;
+  mqttStats _stats = {};
+  Backoff _retry;
+
+  uint8_t _state = DISCONNECTED;
+  uint32_t _stateTime = 0;  // Time (milliseconds) of the last state change
+  uint32_t _backoff = 0;  // Milliseconds to wait in DISCONNECTED before connecting
+  uint32_t _lastSend = 0;
+  uint32_t _lastReceive = 0;
+  bool _pingPending = false;
+
+  telemetrySample _samples[MQTT_BATCH_MAX_SAMPLES];  // Circular, oldest first
+  uint8_t _sampleFirst = 0;
+  uint8_t _sampleCount = 0;
+  uint32_t _batchStart = 0;  // Time (milliseconds) the oldest reading of the batch was added
+
+  inflightBatch _inflight[MQTT_MAX_INFLIGHT] = {};
+  uint16_t _nextPacketId = 1;
+  uint8_t _packet[MQTT_PACKET_SIZE];
+
+  // Incoming packet being parsed, only the first bytes of the body are kept
+  uint8_t _rxStep = 0;
+  uint8_t _rxHeader = 0;
+  uint32_t _rxRemaining = 0;
+  uint32_t _rxMultiplier = 1;
+  uint8_t _rxBody[4];
+  uint8_t _rxLength = 0;
+
+  void connectBroker(uint32_t now);
+  void fail(uint32_t now);
+  bool batchReady(uint32_t now) const;
+  bool fillBatch(uint32_t now);
+  void publish(inflightBatch &batch, bool dup, uint32_t now);
+  bool sendPacket(size_t length, uint32_t now);
+  void receive(uint32_t now);
+  void handlePacket(uint32_t now);
+};
+
+#endif
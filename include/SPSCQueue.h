@@ -0,0 +1,66 @@
+/*
+Bounded lock-free queue for exactly one producer and one consumer.
+
+Items are copied in and out of a fixed array, nothing is allocated after construction.
+The producer only writes "tail", the consumer only writes "head", so the two sides can run
+on different cores (or in an ISR and a task) without a lock.
+push() never blocks: when the queue is full the item is dropped and counted.
+*/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SPSCQueue
+{
+public:
+  // Producer side. Returns false (and counts the item as dropped) when the queue is full
+  bool push(const T &item)
+  {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) >= N)
+    {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    _items[tail % N] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when the queue is empty
+  bool pop(T &item)
+  {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) return false;
+    item = _items[head % N];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Number of items waiting, safe to call from either side
+  size_t depth() const
+  {
+    return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+  }
+
+  // Number of items rejected by push() because the queue was full
+  uint32_t dropped() const
+  {
+    return _dropped.load(std::memory_order_relaxed);
+  }
+
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T _items[N];
+  std::atomic<size_t> _head{0};
+  std::atomic<size_t> _tail{0};
+  std::atomic<uint32_t> _dropped{0};
+};
+
+#endif
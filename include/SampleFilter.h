@@ -0,0 +1,60 @@
+/*
+Filter stage between the sensor readings and the alarm engine.
+
+A single bad reading must not raise an alarm: the DS18B20 answers 85.0 °C when it is read before its
+first conversion (after a power loss on the bus), and a read can come back corrupted in a way the CRC
+does not catch. filterSample() drops these readings and smooths the others, in this order:
+  - power-on check: a reading of exactly 85.0 °C that does not follow the previous ones is rejected
+  - max-slew check: a reading further from the last accepted one than maxSlew allows is rejected
+  - median of the last medianLength accepted readings
+  - exponential moving average of the medians
+A real change is never held back for long: after FILTER_MAX_REJECTS rejections in a row the reading is
+accepted and the filter starts again from it. The power-on value is the exception, it is never taken as
+real however many times it comes: a sensor that keeps losing its supply is a failed sensor, the caller
+counts the rejected readings as failed ones.
+
+The state has a fixed size and each sample costs the same whatever the history, the median window
+being at most FILTER_MAX_MEDIAN readings. Like the alarm engine it does not read the clock and builds
+and runs on the host.
+*/
+
+#ifndef SAMPLE_FILTER_H
+#define SAMPLE_FILTER_H
+
+#include <stdint.h>
+#include <DallasTemperature.h>
+
+#define FILTER_MAX_MEDIAN 7
+#define FILTER_MAX_REJECTS 3  // Rejections in a row after which a reading other than the power-on value is taken as real
+#define FILTER_SLEW_MARGIN 64  // Change (1/128 °C) always accepted, whatever the time elapsed: one 9 bit step
+
+enum filter_result {FILTER_ACCEPTED, FILTER_REJECTED_POWER_ON, FILTER_REJECTED_SLEW};
+
+struct sampleFilterSettings {
+  uint8_t medianLength;  // Readings the median is taken on, 1 (no median) to FILTER_MAX_MEDIAN
+  uint8_t emaShift;  // A new median weighs 1/2^emaShift in the average, 0 for no average
+  int16_t maxSlew;  // Largest change (1/128 °C per minute) between two readings, 0 for no check
+};
+
+struct sampleFilterState {
+  int16_t window[FILTER_MAX_MEDIAN];  // Last accepted readings, circular
+  uint8_t windowCount = 0;  // 0 until the first reading is accepted
+  uint8_t windowNext = 0;
+  int32_t emaSum = 0;  // Average multiplied by 2^emaShift
+  int16_t lastRaw = 0;  // Last accepted reading, before the median
+  uint32_t lastTime = 0;  // Time (milliseconds) of lastRaw
+  uint8_t rejectsInRow = 0;
+  uint32_t accepted = 0;
+  uint32_t rejectedPowerOn = 0;
+  uint32_t rejectedSlew = 0;
+};
+
+// Filters a valid reading taken at "now" (milliseconds, may wrap). Returns a filter_result, filtered is set
+// only when the reading is accepted
+uint8_t filterSample(sampleFilterState &state, const sampleFilterSettings &settings, uint32_t now, int16_t raw,
+                     int16_t &filtered);
+
+// Forgets the previous readings, the counters are kept
+void resetFilter(sampleFilterState &state);
+
+#endif
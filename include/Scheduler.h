@@ -0,0 +1,64 @@
+/*
+Deadline scheduler for the jobs of loop().
+
+Jobs are registered once with addJob() and then scheduled at absolute deadlines, in milliseconds on
+a 64 bit monotonic clock that never wraps. Pending jobs are kept in a binary min-heap, so finding the
+next deadline is O(1) and scheduling or running a job is O(log n). Nothing is allocated.
+
+loop() runs the due jobs and then sleeps until nextDeadline(), instead of polling every timer.
+The scheduler does not read the clock, so it builds and runs on the host.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#define SCHEDULER_MAX_JOBS 8
+#define SCHEDULER_NEVER UINT64_MAX
+
+class Scheduler
+{
+public:
+  typedef void JobFunction(int job);
+
+  // Registers a job, not scheduled yet. Returns its id, -1 if there is no room left
+  int addJob(JobFunction *function);
+
+  // Sets the deadline of a job, scheduling it if it was not
+  void schedule(int job, uint64_t deadline);
+
+  // Schedules a periodic job one period after its last deadline. If that is already past
+  // (loop() was busy for a long time) the missed runs are skipped instead of run in a burst
+  void scheduleNext(int job, uint64_t period, uint64_t now);
+
+  void cancel(int job);
+  bool isScheduled(int job) const { return _jobs[job].heapIndex >= 0; }
+  uint64_t deadline(int job) const { return _jobs[job].deadline; }
+
+  // Runs every job due at "now", earliest first. A job is unscheduled before it runs and may schedule itself again.
+  // Returns the number of jobs run
+  int runDue(uint64_t now);
+
+  // Deadline of the next job, SCHEDULER_NEVER if none is scheduled
+  uint64_t nextDeadline() const { return _heapSize ? _jobs[_heap[0]].deadline : SCHEDULER_NEVER; }
+
+private:
+  struct job {
+    JobFunction *function;
+    uint64_t deadline;
+    int8_t heapIndex;  // -1 when not scheduled
+  };
+
+  job _jobs[SCHEDULER_MAX_JOBS];
+  uint8_t _jobCount = 0;
+  uint8_t _heap[SCHEDULER_MAX_JOBS];  // Job ids, earliest deadline first
+  uint8_t _heapSize = 0;
+
+  void place(uint8_t index, uint8_t jobId);
+  void siftUp(uint8_t index);
+  void siftDown(uint8_t index);
+  void remove(uint8_t index);
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+Temperature sensors spread over several OneWire buses.
+
+Cable length and capacitance limit how many sensors fit on one chain, so the sensors can be split on
+more GPIOs, each one with its own OneWire/DallasTemperature pair. SensorBuses starts the conversion on
+every bus at once and reads each bus as soon as its own conversion is over, so a mesurement takes about
+one conversion time whatever the number of buses.
+
+The devices of all the buses are kept in a single set, looked up by ROM code with find().
+SensorBuses does not read the clock: the caller gives it the time in milliseconds (may wrap).
+*/
+
+#ifndef SENSOR_BUSES_H
+#define SENSOR_BUSES_H
+
+#include <stdint.h>
+#include <DallasTemperature.h>
+
+#define MAX_BUSES 4
+#define MAX_BUS_DEVICES 16  // Devices on all the buses together
+#define BUSES_COLLECTED UINT32_MAX  // Returned by collect() when every bus has been read
+
+struct sensorReading {
+  DeviceAddress address;
+  uint8_t bus;  // Index of the bus the device is on
+  int16_t raw = DEVICE_DISCONNECTED_RAW;  // Last reading in 1/128 °C, DEVICE_DISCONNECTED_RAW if it failed
+  bool read = false;  // Read in the last mesurement
+  bool alarmed = false;  // Answered the alarm search of the last mesurement
+  bool watched = false;  // Read in every mesurement, even when it does not answer the alarm search
+};
+
+class SensorBuses
+{
+public:
+  // Adds a bus, returns its index or -1 if there are already MAX_BUSES
+  int addBus(DallasTemperature &sensors);
+
+  // Finds the devices of every bus. Conversions are set not to block
+  void begin();
+
+  int busCount() const { return _busCount; }
+  DallasTemperature &bus(int index) { return *_buses[index].sensors; }
+
+  int deviceCount() const { return _deviceCount; }
+  const sensorReading &reading(int device) const { return _devices[device]; }
+  // Index of a device in the set, -1 if it was not found on any bus
+  int find(const uint8_t *address) const;
+  // Bus a device is on, nullptr if it was not found
+  DallasTemperature *busOf(const uint8_t *address);
+
+  void setWatched(int device, bool watched) { _devices[device].watched = watched; }
+  // Reads only the temperature bytes of the scratchpad (see DallasTemperature::getTempFast()), 0 to read it all
+  void setFastRead(int16_t maxJump) { _fastReadMaxJump = maxJump; }
+
+  // Sets the resolution of every device. Unless save is set it is not written to the EEPROM
+  void setResolution(uint8_t bits, bool save);
+  // Sets the same resolution and alarm temperatures on every device with one broadcast write per bus
+  // (see DallasTemperature::setConfigurationAll()). Returns the number of devices that could not be set
+  int configure(uint8_t bits, int8_t highAlarm, int8_t lowAlarm, bool save);
+  uint8_t getResolution() { return _busCount ? _buses[0].sensors->getResolution() : 0; }
+
+  // Starts a conversion on every bus. With alarmedOnly set, only the watched devices and the ones answering
+  // the alarm search are read afterwards. Returns the milliseconds until the first bus has finished
+  uint32_t requestTemperatures(uint32_t now, bool alarmedOnly);
+
+  // Reads the buses whose conversion is over. Returns the milliseconds until the next bus has finished,
+  // BUSES_COLLECTED once every bus has been read
+  uint32_t collect(uint32_t now);
+
+private:
+  struct busState {
+    DallasTemperature *sensors;
+    uint32_t conversionStart;  // Time (milliseconds) requestTemperatures() was called
+    uint32_t conversionTime;  // Milliseconds, at the resolution of the bus
+    bool collected;
+    bool hasDs18s20;  // The DS18S20 always converts at 12 bits, whatever the resolution set
+  };
+
+  busState _buses[MAX_BUSES];
+  uint8_t _busCount = 0;
+  sensorReading _devices[MAX_BUS_DEVICES];
+  uint8_t _deviceCount = 0;
+  bool _alarmedOnly = false;
+  int16_t _fastReadMaxJump = 0;
+
+  void collectBus(uint8_t busIndex);
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+Blink patterns of the RGB status LED.
+
+A pattern is a list of steps, each one blinking a color with its on and off times for a number of
+periods. The LED hardware (see LedHal) keeps blinking on its own, so the CPU only does something when
+a new pattern is played or a step is over. A pattern with a single step, or a step with repeat 0,
+costs nothing after it has started.
+
+LedSequencer does not depend on Arduino and can be built on the host with a fake LedHal.
+*/
+
+#ifndef STATUS_LED_H
+#define STATUS_LED_H
+
+#include <stdint.h>
+
+// Colors, one bit per LED
+#define LED_OFF 0
+#define LED_BLUE 1
+#define LED_GREEN 2
+#define LED_AQUA 3
+#define LED_RED 4
+#define LED_PURPLE 5
+#define LED_YELLOW 6
+#define LED_WHITE 7
+
+#define LED_NO_CHANGE UINT32_MAX  // Returned by LedSequencer::update() when no step change is due
+
+struct ledStep {
+  uint8_t color;
+  uint16_t onTime;  // Milliseconds
+  uint16_t offTime;  // Milliseconds
+  uint16_t repeat;  // Periods before the next step, 0 to stay on this step
+};
+
+struct ledPattern {
+  const ledStep *steps;
+  uint8_t stepCount;
+};
+
+// The LED hardware: blinks a color until it is told otherwise
+class LedHal
+{
+public:
+  virtual void blink(uint8_t color, uint16_t onTime, uint16_t offTime) = 0;
+};
+
+class LedSequencer
+{
+public:
+  LedSequencer(LedHal &hal) : _hal(hal) {}
+
+  // Starts a pattern from its first step. Playing the pattern already running does nothing
+  void play(const ledPattern &pattern, uint32_t now);
+
+  // Moves to the next step when the current one is over. Returns the milliseconds until the next
+  // step change, LED_NO_CHANGE if there is none
+  uint32_t update(uint32_t now);
+
+  const ledPattern *pattern() const { return _pattern; }
+  uint8_t step() const { return _step; }
+
+private:
+  LedHal &_hal;
+  const ledPattern *_pattern = nullptr;
+  uint8_t _step = 0;
+  uint32_t _stepStart = 0;  // Time (milliseconds) the current step started
+
+  void startStep(uint32_t now);
+};
+
+#endif
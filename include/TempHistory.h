@@ -0,0 +1,87 @@
+/*
+Compressed temperature history kept in RAM.
+
+Samples are raw DS18B20 values (1/128 °C, as returned by DallasTemperature::getTemp()) with a
+timestamp in seconds. They are stored in a fixed pool of blocks shared by all the zones, so the
+memory used is always HISTORY_BLOCK_COUNT * sizeof(historyBlock) no matter how long the device
+has been running. When the pool is full the oldest block is reused.
+
+Every block starts with one full sample, the following ones are varint tokens:
+  tag 0 - run of n samples equal to the previous one, one step apart
+  tag 1 - one sample, value delta in 1/16 °C (the 12 bit resolution step)
+  tag 2 - one sample, value delta in 1/128 °C
+  tag 3 - sampling step change, in seconds (no sample)
+A stable room at a fixed interval costs a few bytes per run, a noisy 12 bit reading one byte per sample.
+Appending is O(1).
+*/
+
+#ifndef TEMP_HISTORY_H
+#define TEMP_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HISTORY_BLOCK_COUNT
+#define HISTORY_BLOCK_COUNT 128
+#endif
+#define HISTORY_BLOCK_SIZE 256
+#define HISTORY_MAX_ZONES 8
+#define HISTORY_TIME_TOLERANCE 2  // Seconds a sample can be late or early and still be "one step" after the previous one
+
+struct historyBlock {
+  uint8_t zone;
+  uint8_t used;
+  uint16_t length;     // Bytes of data in use
+  uint32_t startTime;  // Time of the first sample
+  int16_t startValue;  // Value of the first sample
+  uint16_t step;       // Sampling step at the first sample
+  uint8_t data[HISTORY_BLOCK_SIZE - 12];
+};
+
+class TempHistory
+{
+public:
+  typedef void SampleHandler(uint8_t zone, uint32_t time, int16_t raw, void *context);
+
+  TempHistory();
+
+  // Adds a sample. Times must not go backwards for the same zone
+  void append(uint8_t zone, uint32_t time, int16_t raw);
+
+  // Calls handler for every sample of the zone with from <= time <= to, oldest first.
+  // Returns the number of samples found
+  uint32_t read(uint8_t zone, uint32_t from, uint32_t to, SampleHandler *handler, void *context) const;
+
+  // Forgets every sample
+  void clear();
+
+  // Number of samples stored for a zone
+  uint32_t sampleCount(uint8_t zone) const;
+
+  // Bytes of the pool holding encoded samples
+  size_t bytesUsed() const;
+
+  static constexpr size_t memorySize() { return sizeof(historyBlock) * HISTORY_BLOCK_COUNT; }
+
+private:
+  // Encoder state of a zone
+  struct zoneWriter {
+    int16_t block;       // Block being written, -1 if none
+    int16_t lastValue;
+    uint32_t lastTime;   // Time of the last sample as it will be decoded
+    uint16_t step;
+    uint32_t pendingRun; // Samples equal to lastValue not written to the block yet
+  };
+
+  historyBlock _blocks[HISTORY_BLOCK_COUNT];
+  zoneWriter _writers[HISTORY_MAX_ZONES];
+  uint16_t _nextBlock;  // Next block to be (re)used, the oldest one
+
+  void startBlock(uint8_t zone, uint32_t time, int16_t raw);
+  void writeToken(historyBlock &block, uint32_t value, uint8_t tag);
+  void flushRun(zoneWriter &writer);
+  uint32_t decode(const historyBlock &block, uint32_t pendingRun, uint32_t from, uint32_t to,
+                  SampleHandler *handler, void *context) const;
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+Latest value shared between exactly one producer and one consumer.
+
+Unlike SPSCQueue, older values are not kept: the consumer always gets the last complete value the
+producer published, however many were published in between, and never one that is half written.
+Three copies of the value rotate between the producer (being written), the consumer (being read)
+and the middle slot (last published), the slots are swapped with a single atomic exchange.
+Neither side ever blocks or waits for the other.
+*/
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+  // Producer side: the value to fill before publish()
+  T &back() { return _items[_back]; }
+
+  // Producer side: makes back() the latest value, back() then refers to another copy, with old content
+  void publish()
+  {
+    _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // Consumer side: a value was published that latest() has not returned yet
+  bool fresh() const { return _middle.load(std::memory_order_relaxed) & FRESH; }
+
+  // Consumer side: the latest value published, a default constructed T until the first publish()
+  const T &latest()
+  {
+    if (_middle.load(std::memory_order_relaxed) & FRESH)
+      _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+    return _items[_front];
+  }
+
+private:
+  static constexpr uint8_t INDEX = 0x03;
+  static constexpr uint8_t FRESH = 0x04;  // The middle slot holds a value the consumer has not taken yet
+
+  T _items[3];
+  uint8_t _back = 0;  // Written by the producer only
+  uint8_t _front = 1;  // Written by the consumer only
+  std::atomic<uint8_t> _middle{2};
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+WiFi link kept up in background, instead of restarting the device when it drops.
+
+poll() watches the link. When it is lost a connection is started at once; an attempt that does not come
+up within WIFI_CONNECT_TIMEOUT is dropped and the next one waits an exponential backoff with jitter
+between WIFI_BACKOFF_MIN and WIFI_BACKOFF_MAX, as the MQTT client does (see Backoff.h). A link that comes back by itself meanwhile (the driver reconnects on its own too) is taken
+as it is.
+
+WiFiReconnect only drives a WiFiLink and does not read the clock, so it builds and runs on the host.
+*/
+
+#ifndef WIFI_RECONNECT_H
+#define WIFI_RECONNECT_H
+
+#include <stdint.h>
+#include "Backoff.h"
+
+#define WIFI_CHECK_INTERVAL 1000  // Milliseconds between two checks of the link
+#define WIFI_CONNECT_TIMEOUT 30000  // Milliseconds an attempt is given to come up
+#define WIFI_BACKOFF_MIN 5000  // Milliseconds before the second attempt
+#define WIFI_BACKOFF_MAX 300000  // Longest wait between two attempts
+
+// The station interface
+class WiFiLink
+{
+public:
+  virtual bool connected() = 0;
+  // Starts a connection with the current settings, does not wait for it
+  virtual void begin() = 0;
+  virtual void disconnect() = 0;
+};
+
+struct wifiStats {
+  uint32_t linkLosses;  // Times the link went down
+  uint32_t attempts;  // Connections started
+  uint32_t failures;  // Attempts that timed out
+};
+
+class WiFiReconnect
+{
+public:
+  // seed starts the random sequence of the backoff jitter
+  WiFiReconnect(WiFiLink &link, uint32_t seed);
+
+  // Drops the link, if any, and connects with the current settings. Also the first connection after startup
+  void reconnect(uint32_t now);
+
+  // Follows the link and starts the attempts that are due. Returns the milliseconds until it has to be called again
+  uint32_t poll(uint32_t now);
+
+  bool connected() const { return _state == LINK_UP; }
+  const wifiStats &stats() const { return _stats; }
+
+private:
+  enum link_state {LINK_UP, LINK_CONNECTING, LINK_WAITING};
+
+  WiFiLink &_link;
+  wifiStats _stats = {};
+  Backoff _retry;
+  uint8_t _state = LINK_WAITING;
+  uint32_t _stateTime = 0;  // Time (milliseconds) of the last state change
+  uint32_t _backoff = 0;  // Milliseconds to wait in LINK_WAITING before the next attempt
+
+  void attempt(uint32_t now);
+  void setState(uint8_t state, uint32_t now);
+};
+
+#endif
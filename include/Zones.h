@@ -0,0 +1,100 @@
+/*
+Zones of the monitor: one sensor each, with its own thresholds, filter and alarm state.
+
+The decisions taken on the zones live here: the zone each sensor belongs to, the thresholds in raw
+sensor units and the alarm registers of the sensors, the sensors a conversion reads, the way a reading
+goes through the filter and the alarm engine, and the sampling level that follows. What is done with
+the outcome (emails, history, telemetry, log) is left to a ZoneListener, so the simulator runs on the
+host the same code as the ESP32. The caller gives the time in milliseconds (may wrap).
+*/
+
+#ifndef ZONES_H
+#define ZONES_H
+
+#include <stdint.h>
+#include "DeviceConfig.h"
+#include "SensorBuses.h"
+#include "AlarmEngine.h"
+#include "SampleFilter.h"
+#include "AdaptiveSampling.h"
+
+#define SENSOR_FAILURE_READINGS 5  // Consecutive reading errors after which a zone is in SENSOR_FAILURE
+// The pre alarm threshold of each zone, less SAMPLING_FAR_MARGIN, is programmed in its sensor TH register, so after
+// a conversion an alarm search (0xEC) on each bus finds the sensors that need attention. Idle zones sampled slowly
+// whose sensor stays quiet are read only every FULL_READ_CYCLES mesurements, which still catches disconnected sensors
+#define FULL_READ_CYCLES 5
+// Readings go through the zone filter before the alarm engine, see SampleFilter.h. The median of 3 drops a single
+// bad reading at the cost of one more reading before an alarm; the average is off as it would delay alarms further
+#define FILTER_MEDIAN_LENGTH 3
+#define FILTER_EMA_SHIFT 0
+#define FILTER_MAX_SLEW 1280  // Largest change (1/128 °C per minute) between two readings: 10 °C per minute
+#define SAMPLING_HOLD_CYCLES 3  // Mesurements a slower sampling level must be wanted for before it is taken
+
+// A monitored zone: one sensor with its own thresholds and alarm state
+struct zone {
+  zoneConfig config;
+  int nvsSlot = -1;  // Index of the zone settings in config.zones
+  int16_t tempRaw = DEVICE_DISCONNECTED_RAW;  // Last valid reading in 1/128 °C, converted to °C only to be shown
+  alarmThresholds thresholds;  // Thresholds converted to 1/128 °C by setZoneThresholds(), so that no float is used to take decisions
+  alarmState alarm;  // Status IDLE/PRE_ALARM/ALARM/SENSOR_FAILURE and notification timers, updated by alarmStep()
+  sampleFilterState filter;  // Last readings of the sensor and rejection counters, updated by filterSample()
+  int device = -1;  // Index of the sensor in buses, -1 if it was not found
+  uint32_t readingTime = 0;  // Time (milliseconds) of tempRaw
+  uint8_t samplingLevel = SAMPLING_NORMAL;  // Sampling level wanted by the zone at its last reading
+};
+
+// Settings shared by every zone
+struct zoneSettings {
+  alarmSettings alarm;
+  sampleFilterSettings filter;
+};
+
+// What readZones() did with a zone
+enum zone_reading {
+  ZONE_NOT_READ,  // Quiet sensor of an idle zone, left out of the mesurement
+  ZONE_READ,  // Reading accepted, now in tempRaw
+  ZONE_REJECTED,  // Reading rejected by the filter, evaluated as a failed one
+  ZONE_FAILED  // No answer or a bad CRC
+};
+
+class ZoneListener
+{
+public:
+  // Called by readZones() for every zone. raw is what the sensor answered, actions are the ones returned by
+  // alarmStep() (none for ZONE_NOT_READ)
+  virtual void zoneRead(int zoneIndex, uint8_t result, int16_t raw, uint8_t actions) = 0;
+};
+
+// Maps every sensor found on the buses to a zone, taking its settings from cfg.zones. Sensors seen for the first
+// time get a default name, the global thresholds and a slot in cfg.zones, and configChanged is set. With no sensor
+// a zone is kept anyway, so that the failure gets notified. Returns the number of zones
+int mapZones(const SensorBuses &buses, deviceConfig &cfg, zone *zones, bool &configChanged);
+
+// Converts the zone thresholds to raw sensor values (see celsiusToRawCeil()), the reset levels are resetThreshold
+// (°C) under them
+void setZoneThresholds(zone &z, float resetThreshold);
+
+// TH of the sensor of a zone, see programSensorAlarm()
+int8_t sensorHighAlarm(const zone &z);
+// Writes the alarm registers of the sensor of a zone
+void programSensorAlarm(SensorBuses &buses, const zone &z);
+// Sets the resolution of every sensor and, when save is set, programs their alarm registers too.
+// Returns the number of sensors that could not be configured
+int configureSensors(SensorBuses &buses, const zone *zones, int zoneCount, uint8_t bits, bool save);
+
+// Chooses the sensors the next conversion reads even if they stay quiet
+void watchZones(SensorBuses &buses, const zone *zones, int zoneCount);
+
+// Takes the readings of the last mesurement and updates the alarm state and the sampling level of the zones.
+// Returns the actions of all the zones
+uint8_t readZones(const SensorBuses &buses, zone *zones, int zoneCount, const zoneSettings &settings, uint32_t now,
+                  ZoneListener &listener);
+
+// Sampling level after a mesurement: the one of the zone that needs it most, taken at once when it is faster than
+// level, one step slower after SAMPLING_HOLD_CYCLES mesurements. holdCount keeps the mesurements waited so far
+uint8_t nextSamplingLevel(uint8_t level, uint8_t &holdCount, const zone *zones, int zoneCount);
+
+// The most severe status among the zones
+uint8_t worstZoneStatus(const zone *zones, int zoneCount);
+
+#endif
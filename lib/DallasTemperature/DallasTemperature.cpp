@@ -95,6 +95,7 @@ void DallasTemperature::setOneWire(OneWire* _oneWire) {
 	ds18Count = 0;
 	parasite = false;
 	bitResolution = 9;
+	addressTableValid = false;
 	waitForConversion = true;
 	checkForConversion = true;
   autoSaveScratchPad = true;
@@ -104,6 +105,17 @@ void DallasTemperature::setOneWire(OneWire* _oneWire) {
 // initialise the bus
 void DallasTemperature::begin(void) {
 
+	refreshAddressTable();
+
+}
+
+// enumerates the bus and caches the addresses found, so index based calls
+// don't have to repeat a full ROM search for every lookup. The power supply
+// and resolution of each thermometer are read in the same pass: looking the
+// devices up again by index would search the bus once per device past
+// ADDRESSTABLESIZE
+void DallasTemperature::refreshAddressTable(void) {
+
 	DeviceAddress deviceAddress;
 
 	_wire->reset_search();
@@ -113,6 +125,9 @@ void DallasTemperature::begin(void) {
 	while (_wire->search(deviceAddress)) {
 
 		if (validAddress(deviceAddress)) {
+
+			if (devices < ADDRESSTABLESIZE)
+				memcpy(addressTable[devices], deviceAddress, sizeof(DeviceAddress));
 			devices++;
 
 			if (validFamily(deviceAddress)) {
@@ -126,6 +141,17 @@ void DallasTemperature::begin(void) {
 			}
 		}
 	}
+
+	addressTableValid = true;
+}
+
+// drops the cached addresses, use after the bus has been rewired
+void DallasTemperature::invalidateAddressTable(void) {
+	addressTableValid = false;
+}
+
+bool DallasTemperature::isAddressTableValid(void) {
+	return addressTableValid;
 }
 
 // returns the number of devices found on the bus
@@ -144,8 +170,19 @@ bool DallasTemperature::validAddress(const uint8_t* deviceAddress) {
 
 // finds an address at a given index on the bus
 // returns true if the device was found
+// served from the address table when it is valid, devices past
+// ADDRESSTABLESIZE still need a ROM search
 bool DallasTemperature::getAddress(uint8_t* deviceAddress, uint8_t index) {
 
+	if (addressTableValid) {
+		if (index < devices && index < ADDRESSTABLESIZE) {
+			memcpy(deviceAddress, addressTable[index], sizeof(DeviceAddress));
+			return true;
+		}
+		if (devices <= ADDRESSTABLESIZE)
+			return false;
+	}
+
 	uint8_t depth = 0;
 
 	_wire->reset_search();
@@ -332,6 +369,101 @@ bool DallasTemperature::setResolution(const uint8_t* deviceAddress,
   return success;
 }
 
+// set the resolution and the alarm temperatures of all devices at once: one
+// Skip ROM write reaches every device, then a single pass over the devices
+// reads each scratchpad back and only the devices that did not take the
+// write get an addressed one. Unlike setResolution(uint8_t), the cost grows
+// linearly with the number of devices.
+// When autoSaveScratchPad is set the EEPROM is written with one broadcast
+// copy at the end, unless every device already holds the values in EEPROM.
+// The DS18S20 has no configuration register and only takes the alarm
+// temperatures. Returns the number of devices that still don't match
+uint8_t DallasTemperature::setConfigurationAll(uint8_t newResolution,
+		int8_t highAlarm, int8_t lowAlarm) {
+
+	newResolution = constrain(newResolution, 9, 12);
+	highAlarm = constrain(highAlarm, -55, 125);
+	lowAlarm = constrain(lowAlarm, -55, 125);
+	uint8_t configuration = TEMP_9_BIT | ((newResolution - 9) << 5);
+	bitResolution = newResolution;
+
+	// the broadcast commands below reach every device on the bus, so they
+	// are sent only when all of them are known to be thermometers. Otherwise
+	// each thermometer that doesn't match is written on its own
+	if (!addressTableValid || devices == 0 || ds18Count != devices)
+		return verifyConfiguration(highAlarm, lowAlarm, configuration, true);
+
+	// the EEPROM has limited write cycles
+	if (autoSaveScratchPad && recallScratchPad()
+			&& verifyConfiguration(highAlarm, lowAlarm, configuration, false) == 0)
+		return 0;
+
+	if (_wire->reset() == 0)
+		return devices;
+	_wire->skip();
+	_wire->write(WRITESCRATCH);
+	_wire->write((uint8_t) highAlarm);
+	_wire->write((uint8_t) lowAlarm);
+	_wire->write(configuration);  // ignored by the DS18S20
+	_wire->reset();
+
+	// the devices rewritten one by one are saved with the broadcast copy
+	bool autoSave = autoSaveScratchPad;
+	autoSaveScratchPad = false;
+	uint8_t failed = verifyConfiguration(highAlarm, lowAlarm, configuration, true);
+	autoSaveScratchPad = autoSave;
+	if (autoSaveScratchPad)
+		saveScratchPad();
+
+	return failed;
+}
+
+// reads the scratchpad of every device on the bus and compares it with the
+// given configuration. With rewrite set, a device that doesn't
+// match is written with an addressed write and checked once more, otherwise
+// the search stops at the first mismatch. Returns the devices that don't match
+uint8_t DallasTemperature::verifyConfiguration(int8_t highAlarm,
+		int8_t lowAlarm, uint8_t configuration, bool rewrite) {
+
+	// the address table saves the ROM search when it holds every device
+	bool fromTable = addressTableValid && devices <= ADDRESSTABLESIZE;
+	uint8_t failed = 0;
+	uint8_t index = 0;
+	DeviceAddress deviceAddress;
+	ScratchPad scratchPad;
+	if (!fromTable)
+		_wire->reset_search();
+	while (fromTable ? index < devices : _wire->search(deviceAddress)) {
+		if (fromTable)
+			memcpy(deviceAddress, addressTable[index++], sizeof(DeviceAddress));
+		if (!validAddress(deviceAddress) || !validFamily(deviceAddress))
+			continue;
+
+		for (uint8_t attempt = 0; attempt < 2; attempt++) {
+			bool match = isConnected(deviceAddress, scratchPad)
+					&& (int8_t) scratchPad[HIGH_ALARM_TEMP] == highAlarm
+					&& (int8_t) scratchPad[LOW_ALARM_TEMP] == lowAlarm
+					&& (deviceAddress[DSROM_FAMILY] == DS18S20MODEL
+							|| scratchPad[CONFIGURATION] == configuration);
+			if (match)
+				break;
+			if (!rewrite) {
+				if (!fromTable)
+					_wire->reset_search();
+				return 1;
+			}
+			if (attempt == 1) {
+				failed++;
+				break;
+			}
+			scratchPad[HIGH_ALARM_TEMP] = (uint8_t) highAlarm;
+			scratchPad[LOW_ALARM_TEMP] = (uint8_t) lowAlarm;
+			scratchPad[CONFIGURATION] = configuration;
+			writeScratchPad(deviceAddress, scratchPad);
+		}
+	}
+	return failed;
+}
 
 // returns the global resolution
 uint8_t DallasTemperature::getResolution() {
@@ -660,6 +792,42 @@ int16_t DallasTemperature::getTemp(const uint8_t* deviceAddress) {
 
 }
 
+// returns temperature in 1/128 degrees C reading only TEMP_LSB and TEMP_MSB:
+// the read is ended by a reset after the second byte, saving the other seven
+// bytes. A truncated read has no CRC, so the full scratchpad is read with
+// getTemp() when the value is not plausible: all ones (no device answered),
+// the 85 degrees C power-on value, or a change larger than maxJump from
+// previousRaw. It is also read when there is no previous value and for the
+// DS18S20, which needs COUNT_REMAIN and COUNT_PER_C
+int16_t DallasTemperature::getTempFast(const uint8_t* deviceAddress,
+		int16_t previousRaw, int16_t maxJump) {
+
+	if (previousRaw == DEVICE_DISCONNECTED_RAW || deviceAddress[DSROM_FAMILY] == DS18S20MODEL)
+		return getTemp(deviceAddress);
+
+	if (_wire->reset() == 0)
+		return DEVICE_DISCONNECTED_RAW;
+
+	_wire->select(deviceAddress);
+	_wire->write(READSCRATCH);
+
+	ScratchPad scratchPad = {0};
+	scratchPad[TEMP_LSB] = _wire->read();
+	scratchPad[TEMP_MSB] = _wire->read();
+	_wire->reset();
+
+	if (scratchPad[TEMP_LSB] == 0xFF && scratchPad[TEMP_MSB] == 0xFF)
+		return getTemp(deviceAddress);
+
+	int16_t raw = calculateTemperature(deviceAddress, scratchPad);
+	int32_t jump = (int32_t) raw - previousRaw;
+	if (raw == POWER_ON_RAW || jump > maxJump || jump < -maxJump)
+		return getTemp(deviceAddress);
+
+	return raw;
+
+}
+
 // returns temperature in degrees C or DEVICE_DISCONNECTED_C if the
 // device's scratch pad cannot be read successfully.
 // the numeric value of DEVICE_DISCONNECTED_C is defined in
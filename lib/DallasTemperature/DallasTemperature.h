@@ -18,6 +18,12 @@
 #define REQUIRESALARMS true
 #endif
 
+// number of device addresses cached by begin(), index based calls on
+// devices past this limit fall back to a ROM search
+#ifndef ADDRESSTABLESIZE
+#define ADDRESSTABLESIZE 16
+#endif
+
 #include <inttypes.h>
 #ifdef __STM32F1__
 #include <OneWireSTM.h>
@@ -37,6 +43,9 @@
 #define DEVICE_DISCONNECTED_F -196.6
 #define DEVICE_DISCONNECTED_RAW -7040
 
+// Temperature register after power-on, before the first conversion (85 degrees C)
+#define POWER_ON_RAW 10880
+
 // For readPowerSupply on oneWire bus
 // definition of nullptr for C++ < 11, using official workaround:
 // http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2007/n2431.pdf
@@ -91,6 +100,17 @@ public:
 	// finds an address at a given index on the bus
 	bool getAddress(uint8_t*, uint8_t);
 
+	// re-enumerates the bus and rebuilds the cached address table, the power
+	// supply and resolution of the thermometers are read in the same pass
+	void refreshAddressTable(void);
+
+	// drops the cached address table, index based calls search the bus
+	// until the next begin() or refreshAddressTable()
+	void invalidateAddressTable(void);
+
+	// returns true if index based calls are served from the address table
+	bool isAddressTableValid(void);
+
 	// attempt to determine if the device at the given address is connected to the bus
 	bool isConnected(const uint8_t*);
 
@@ -120,6 +140,12 @@ public:
 	bool setResolution(const uint8_t*, uint8_t,
 			bool skipGlobalBitResolutionCalculation = false);
 
+	// set the same resolution and alarm temperatures on every device with one
+	// broadcast write, returns the number of devices that could not be set.
+	// Falls back to addressed writes when the bus holds other devices than
+	// thermometers or has not been enumerated by begin()
+	uint8_t setConfigurationAll(uint8_t, int8_t highAlarm, int8_t lowAlarm);
+
 	// sets/gets the waitForConversion flag
 	void setWaitForConversion(bool);
 	bool getWaitForConversion(void);
@@ -140,6 +166,10 @@ public:
 	// returns temperature raw value (12 bit integer of 1/128 degrees C)
 	int16_t getTemp(const uint8_t*);
 
+	// returns temperature raw value reading only the two temperature bytes,
+	// falls back to getTemp() when it is not plausible next to the previous value
+	int16_t getTempFast(const uint8_t*, int16_t previousRaw, int16_t maxJump);
+
 	// returns temperature in degrees C
 	float getTempC(const uint8_t*);
 
@@ -293,12 +323,20 @@ private:
 	// count of DS18xxx Family devices on bus
 	uint8_t ds18Count;
 
+	// addresses found by the last enumeration, in search order
+	DeviceAddress addressTable[ADDRESSTABLESIZE];
+	bool addressTableValid;
+
 	// Take a pointer to one wire instance
 	OneWire* _wire;
 
 	// reads scratchpad and returns the raw temperature
 	int16_t calculateTemperature(const uint8_t*, uint8_t*);
 
+	// compares the scratchpad of every device with a configuration, used by
+	// setConfigurationAll
+	uint8_t verifyConfiguration(int8_t, int8_t, uint8_t, bool);
+
 
 	// Returns true if all bytes of scratchPad are '\0'
 	bool isAllZeros(const uint8_t* const scratchPad, const size_t length = 9);
@@ -0,0 +1,17 @@
+#include "Arduino.h"
+
+static uint64_t simTime = 0;
+
+uint64_t simMicros() { return simTime; }
+void simAdvance(uint64_t us) { simTime += us; }
+
+unsigned long millis() { return (unsigned long)(simTime / 1000); }
+unsigned long micros() { return (unsigned long)simTime; }
+void delay(unsigned long ms) { simTime += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { simTime += us; }
+// Busy loops waiting on millis() would never end if yield() didn't take some time
+void yield() { simTime += 1; }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
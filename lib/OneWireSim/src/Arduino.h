@@ -0,0 +1,42 @@
+/*
+The part of the Arduino API used by DallasTemperature and by the monitor modules, for the native build.
+
+Time is simulated: it only moves forward with the bus traffic of the simulated OneWire buses and with
+delay(), so a run is repeatable and as fast as the host allows. simAdvance() moves it by hand.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Pins do nothing, digitalRead() reads HIGH
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Simulated clock, microseconds since the start of the program
+uint64_t simMicros();
+void simAdvance(uint64_t us);
+
+#endif
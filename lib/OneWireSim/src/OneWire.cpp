@@ -0,0 +1,193 @@
+#include "OneWire.h"
+#include <Arduino.h>
+
+bool OneWire::attach(SimDevice &device)
+{
+  if (_deviceCount >= ONEWIRE_SIM_MAX_DEVICES) return false;
+  _devices[_deviceCount++] = &device;
+  return true;
+}
+
+void OneWire::detach(SimDevice &device)
+{
+  for (int i = 0; i < _deviceCount; i++)
+  {
+    if (_devices[i] != &device) continue;
+    _devices[i] = _devices[--_deviceCount];
+    return;
+  }
+}
+
+void OneWire::clearStats()
+{
+  _stats = {};
+}
+
+uint8_t OneWire::reset()
+{
+  _stats.resets++;
+  _stats.busTime += ONEWIRE_SIM_RESET_TIME;
+  simAdvance(ONEWIRE_SIM_RESET_TIME);
+
+  bool presence = false;
+  for (int i = 0; i < _deviceCount; i++)
+    if (_devices[i]->reset(simMicros())) presence = true;
+  return presence;
+}
+
+void OneWire::select(const uint8_t rom[8])
+{
+  write(0x55);
+  for (int i = 0; i < 8; i++) write(rom[i]);
+}
+
+void OneWire::skip()
+{
+  write(0xCC);
+}
+
+void OneWire::write(uint8_t v, uint8_t power)
+{
+  _stats.bytesWritten++;
+  for (int i = 0; i < 8; i++) write_bit((v >> i) & 1);
+  strongPullup(power);
+}
+
+void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool power)
+{
+  for (uint16_t i = 0; i < count; i++) write(buf[i], power && i == count - 1);
+}
+
+uint8_t OneWire::read()
+{
+  _stats.bytesRead++;
+  uint8_t v = 0;
+  for (int i = 0; i < 8; i++) v |= read_bit() << i;
+  return v;
+}
+
+void OneWire::read_bytes(uint8_t *buf, uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++) buf[i] = read();
+}
+
+void OneWire::write_bit(uint8_t v)
+{
+  _stats.bitsWritten++;
+  _stats.busTime += ONEWIRE_SIM_SLOT_TIME;
+  simAdvance(ONEWIRE_SIM_SLOT_TIME);
+  for (int i = 0; i < _deviceCount; i++) _devices[i]->writeBit(v & 1, simMicros());
+}
+
+// The bus is pulled up, any device driving a 0 wins
+uint8_t OneWire::read_bit()
+{
+  _stats.bitsRead++;
+  _stats.busTime += ONEWIRE_SIM_SLOT_TIME;
+  simAdvance(ONEWIRE_SIM_SLOT_TIME);
+  uint8_t bit = 1;
+  for (int i = 0; i < _deviceCount; i++) bit &= _devices[i]->readBit(simMicros());
+  return bit;
+}
+
+void OneWire::depower()
+{
+  strongPullup(false);
+}
+
+void OneWire::strongPullup(bool on)
+{
+  for (int i = 0; i < _deviceCount; i++) _devices[i]->strongPullup(on, simMicros());
+}
+
+void OneWire::reset_search()
+{
+  memset(_searchRom, 0, sizeof(_searchRom));
+  _lastDiscrepancy = 0;
+  _lastFamilyDiscrepancy = 0;
+  _lastDevice = false;
+}
+
+void OneWire::target_search(uint8_t family_code)
+{
+  memset(_searchRom, 0, sizeof(_searchRom));
+  _searchRom[0] = family_code;
+  _lastDiscrepancy = 64;
+  _lastFamilyDiscrepancy = 0;
+  _lastDevice = false;
+}
+
+// Maxim application note 187: finds the next ROM code, descending the 0 branch of the last discrepancy
+// that was taken as 1 the time before
+bool OneWire::search(uint8_t *newAddr, bool search_mode)
+{
+  bool found = false;
+  if (!_lastDevice)
+  {
+    if (!reset())
+    {
+      reset_search();
+      return false;
+    }
+    write(search_mode ? 0xF0 : 0xEC);
+
+    int lastZero = 0;
+    int bitNumber = 1;
+    for (; bitNumber <= 64; bitNumber++)
+    {
+      uint8_t bit = read_bit();
+      uint8_t complement = read_bit();
+      if (bit && complement) break;  // No device left
+
+      uint8_t &romByte = _searchRom[(bitNumber - 1) / 8];
+      uint8_t mask = 1 << ((bitNumber - 1) % 8);
+      uint8_t direction;
+      if (bit != complement) direction = bit;
+      else
+      {
+        if (bitNumber < _lastDiscrepancy) direction = (romByte & mask) != 0;
+        else direction = bitNumber == _lastDiscrepancy;
+        if (direction == 0)
+        {
+          lastZero = bitNumber;
+          if (lastZero < 9) _lastFamilyDiscrepancy = lastZero;
+        }
+      }
+      if (direction) romByte |= mask;
+      else romByte &= ~mask;
+      write_bit(direction);
+    }
+
+    if (bitNumber > 64)
+    {
+      _lastDiscrepancy = lastZero;
+      if (_lastDiscrepancy == 0) _lastDevice = true;
+      found = true;
+    }
+  }
+
+  if (!found || _searchRom[0] == 0)
+  {
+    reset_search();
+    return false;
+  }
+  memcpy(newAddr, _searchRom, sizeof(_searchRom));
+  return true;
+}
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+  uint8_t crc = 0;
+  while (len--)
+  {
+    uint8_t in = *addr++;
+    for (int i = 0; i < 8; i++)
+    {
+      uint8_t mix = (crc ^ in) & 0x01;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      in >>= 1;
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,76 @@
+/*
+Simulated 1-Wire bus with the API of the OneWire library (as provided by OneWireNg), for the native build.
+
+Each OneWire object is one bus. SimDevice models are attached to it and take part in every time slot:
+a read slot returns the wired-AND of what the devices drive. Every reset and slot advances the simulated
+clock (see Arduino.h) by its standard speed duration and is counted in stats(), so the bus usage of
+DallasTemperature and of the monitor can be measured without hardware.
+*/
+
+#ifndef OneWire_h
+#define OneWire_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SimDevice.h"
+
+#define ONEWIRE_SIM_MAX_DEVICES 64
+// Standard speed timings (microseconds)
+#define ONEWIRE_SIM_RESET_TIME 960  // Reset pulse and presence detect
+#define ONEWIRE_SIM_SLOT_TIME 70  // Read or write slot, recovery included
+
+struct oneWireStats {
+  uint32_t resets;
+  uint32_t bitsWritten;
+  uint32_t bitsRead;
+  uint32_t bytesWritten;  // Also counted in bitsWritten
+  uint32_t bytesRead;  // Also counted in bitsRead
+  uint64_t busTime;  // Microseconds the bus was busy
+};
+
+class OneWire
+{
+public:
+  OneWire(uint8_t pin) : _pin(pin) { reset_search(); }
+
+  // Simulation side
+  bool attach(SimDevice &device);
+  void detach(SimDevice &device);
+  int deviceCount() const { return _deviceCount; }
+  SimDevice &device(int index) { return *_devices[index]; }
+  uint8_t pin() const { return _pin; }
+  const oneWireStats &stats() const { return _stats; }
+  void clearStats();
+
+  // OneWire API
+  uint8_t reset();
+  void select(const uint8_t rom[8]);
+  void skip();
+  void write(uint8_t v, uint8_t power = 0);
+  void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+  uint8_t read();
+  void read_bytes(uint8_t *buf, uint16_t count);
+  void write_bit(uint8_t v);
+  uint8_t read_bit();
+  void depower();
+  void reset_search();
+  void target_search(uint8_t family_code);
+  bool search(uint8_t *newAddr, bool search_mode = true);
+  static uint8_t crc8(const uint8_t *addr, uint8_t len);
+
+private:
+  uint8_t _pin;
+  SimDevice *_devices[ONEWIRE_SIM_MAX_DEVICES];
+  int _deviceCount = 0;
+  oneWireStats _stats = {};
+
+  // Search state
+  uint8_t _searchRom[8];
+  int _lastDiscrepancy;
+  int _lastFamilyDiscrepancy;
+  bool _lastDevice;
+
+  void strongPullup(bool on);
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "SimDevice.h"
+#include "OneWire.h"
+#include <Arduino.h>
+
+// Commands
+#define CMD_SEARCH_ROM 0xF0
+#define CMD_ALARM_SEARCH 0xEC
+#define CMD_READ_ROM 0x33
+#define CMD_MATCH_ROM 0x55
+#define CMD_SKIP_ROM 0xCC
+#define CMD_CONVERT_T 0x44
+#define CMD_READ_SCRATCHPAD 0xBE
+#define CMD_WRITE_SCRATCHPAD 0x4E
+#define CMD_COPY_SCRATCHPAD 0x48
+#define CMD_RECALL_EEPROM 0xB8
+#define CMD_READ_POWER_SUPPLY 0xB4
+
+#define COPY_TIME 10000  // Microseconds, EEPROM write
+
+SimDevice::SimDevice(uint8_t family, uint64_t serial, bool parasite) : _parasite(parasite)
+{
+  _rom[0] = family;
+  for (int i = 1; i < 7; i++) _rom[i] = (serial >> (8 * (i - 1))) & 0xFF;
+  _rom[7] = OneWire::crc8(_rom, 7);
+
+  // Factory EEPROM: TH 75 °C, TL 70 °C, 12 bits
+  _eeprom[0] = 0x4B;
+  _eeprom[1] = 0x46;
+  _eeprom[2] = 0x7F;
+  powerCycle();
+}
+
+void SimDevice::powerCycle()
+{
+  if (family() == SIM_DS18S20)
+  {
+    _scratchpad[0] = 0xAA;
+    _scratchpad[1] = 0x00;
+    _scratchpad[4] = 0xFF;
+    _scratchpad[5] = 0xFF;
+    _scratchpad[6] = 0x0C;
+  }
+  else
+  {
+    _scratchpad[0] = 0x50;
+    _scratchpad[1] = 0x05;
+    _scratchpad[4] = _eeprom[2];
+    _scratchpad[5] = 0xFF;
+    _scratchpad[6] = 0x0C;
+  }
+  _scratchpad[2] = _eeprom[0];
+  _scratchpad[3] = _eeprom[1];
+  _scratchpad[7] = 0x10;
+  _scratchpad[8] = OneWire::crc8(_scratchpad, 8);
+  _alarm = false;
+  _converting = false;
+  _conversionStarting = false;
+  _state = INACTIVE;
+}
+
+uint8_t SimDevice::resolution() const
+{
+  if (family() == SIM_DS18S20) return 9;
+  return 9 + ((_scratchpad[4] >> 5) & 0x03);
+}
+
+uint32_t SimDevice::conversionTime() const
+{
+  return 750000 >> (12 - (family() == SIM_DS18S20 ? 12 : resolution()));
+}
+
+bool SimDevice::reset(uint64_t now)
+{
+  update(now);
+  _conversionStarting = false;
+  if (_faults & SIM_FAULT_ABSENT)
+  {
+    _state = INACTIVE;
+    return false;
+  }
+  _state = ROM_COMMAND;
+  _bit = 0;
+  _byte = 0;
+  return true;
+}
+
+void SimDevice::writeBit(uint8_t bit, uint64_t now)
+{
+  update(now);
+  _conversionStarting = false;
+  switch (_state)
+  {
+    case ROM_COMMAND:
+    case FUNCTION_COMMAND:
+    case WRITE_SCRATCHPAD:
+      _byte |= (bit & 1) << (_bit % 8);
+      _bit++;
+      if (_bit % 8) break;
+      if (_state == ROM_COMMAND) romCommand(_byte);
+      else if (_state == FUNCTION_COMMAND) functionCommand(_byte, now);
+      else
+      {
+        // TH, TL and, except on the DS18S20, the configuration. Only the resolution bits of the configuration are writable
+        uint8_t index = 2 + _bit / 8 - 1;
+        if (index == 4 && family() != SIM_DS18S20) _scratchpad[4] = (_byte & 0x60) | 0x1F;
+        else if (index < 4) _scratchpad[index] = _byte;
+      }
+      _byte = 0;
+      break;
+
+    case MATCH_ROM:
+      if ((bit & 1) != romBit(_bit)) _state = INACTIVE;
+      else if (++_bit == 64)
+      {
+        _state = FUNCTION_COMMAND;
+        _bit = 0;
+      }
+      break;
+
+    case SEARCH_ROM:
+      if (_searchSlot != 2 || (bit & 1) != romBit(_bit)) _state = INACTIVE;
+      else if (++_bit == 64)
+      {
+        _state = FUNCTION_COMMAND;
+        _bit = 0;
+      }
+      _searchSlot = 0;
+      break;
+  }
+}
+
+uint8_t SimDevice::readBit(uint64_t now)
+{
+  update(now);
+  _conversionStarting = false;
+  switch (_state)
+  {
+    case SEARCH_ROM:
+      if (_searchSlot == 0)
+      {
+        _searchSlot = 1;
+        return romBit(_bit);
+      }
+      if (_searchSlot == 1)
+      {
+        _searchSlot = 2;
+        return !romBit(_bit);
+      }
+      return 1;
+
+    case READ_ROM:
+      if (_bit >= 64) return 1;
+      return romBit(_bit++);
+
+    case READ_SCRATCHPAD:
+      if (_bit >= 72) return 1;
+      _bit++;
+      return (_sending[(_bit - 1) / 8] >> ((_bit - 1) % 8)) & 1;
+
+    // Read slots are answered with 0 until the operation is over
+    case CONVERTING:
+      return !_converting;
+    case COPYING:
+      return now >= _copyEnd;
+
+    case READ_POWER:
+      return !_parasite;
+  }
+  return 1;
+}
+
+void SimDevice::strongPullup(bool on, uint64_t now)
+{
+  update(now);
+  // Without the strong pullup a parasite powered device has no energy for the conversion
+  if (_conversionStarting && _parasite && !on) _converting = false;
+  _conversionStarting = false;
+}
+
+// Ends the conversion if its time is over
+void SimDevice::update(uint64_t now)
+{
+  if (_converting && now >= _conversionEnd)
+  {
+    _converting = false;
+    latchTemperature();
+  }
+}
+
+void SimDevice::romCommand(uint8_t command)
+{
+  _bit = 0;
+  _searchSlot = 0;
+  switch (command)
+  {
+    case CMD_SKIP_ROM: _state = FUNCTION_COMMAND; break;
+    case CMD_MATCH_ROM: _state = MATCH_ROM; break;
+    case CMD_READ_ROM: _state = READ_ROM; break;
+    case CMD_SEARCH_ROM: _state = SEARCH_ROM; break;
+    case CMD_ALARM_SEARCH: _state = _alarm ? SEARCH_ROM : INACTIVE; break;
+    default: _state = INACTIVE;
+  }
+}
+
+void SimDevice::functionCommand(uint8_t command, uint64_t now)
+{
+  _bit = 0;
+  switch (command)
+  {
+    case CMD_CONVERT_T:
+      _state = CONVERTING;
+      if (_faults & SIM_FAULT_NO_CONVERSION) break;
+      _converting = true;
+      _conversionStarting = true;
+      _conversionEnd = now + conversionTime();
+      break;
+
+    case CMD_READ_SCRATCHPAD:
+      _state = READ_SCRATCHPAD;
+      memcpy(_sending, _scratchpad, 8);
+      _sending[8] = OneWire::crc8(_sending, 8);
+      if (_faults & SIM_FAULT_CRC) _sending[0] ^= 0x08;
+      break;
+
+    case CMD_WRITE_SCRATCHPAD:
+      _state = WRITE_SCRATCHPAD;
+      break;
+
+    case CMD_COPY_SCRATCHPAD:
+      _state = COPYING;
+      _eeprom[0] = _scratchpad[2];
+      _eeprom[1] = _scratchpad[3];
+      if (family() != SIM_DS18S20) _eeprom[2] = _scratchpad[4];
+      _eepromWrites++;
+      _copyEnd = now + COPY_TIME;
+      break;
+
+    case CMD_RECALL_EEPROM:
+      _state = RECALLING;
+      _scratchpad[2] = _eeprom[0];
+      _scratchpad[3] = _eeprom[1];
+      if (family() != SIM_DS18S20) _scratchpad[4] = _eeprom[2];
+      break;
+
+    case CMD_READ_POWER_SUPPLY:
+      _state = READ_POWER;
+      break;
+
+    default:
+      _state = INACTIVE;
+  }
+}
+
+// Writes the converted temperature to the scratchpad and compares its whole degrees with TH and TL
+void SimDevice::latchTemperature()
+{
+  float celsius = constrain(_celsius, -55.0f, 125.0f);
+  int8_t whole;
+  if (family() == SIM_DS18S20)
+  {
+    // 0.5 °C register, COUNT_REMAIN gives the extended resolution:
+    // T = TEMP_READ - 0.25 + (COUNT_PER_C - COUNT_REMAIN) / COUNT_PER_C
+    int16_t tempRead = (int16_t)floorf(celsius + 0.25f);
+    int countRemain = 16 - (int)lroundf((celsius - tempRead + 0.25f) * 16);
+    int16_t reg = tempRead * 2 + (celsius - tempRead >= 0.5f ? 1 : 0);
+    _scratchpad[0] = reg & 0xFF;
+    _scratchpad[1] = (reg >> 8) & 0xFF;
+    _scratchpad[6] = constrain(countRemain, 1, 16);
+    whole = reg >> 1;
+  }
+  else
+  {
+    // Bits under the resolution read as 0
+    int16_t reg = (int16_t)floorf(celsius * 16);
+    reg &= ~((1 << (12 - resolution())) - 1);
+    _scratchpad[0] = reg & 0xFF;
+    _scratchpad[1] = (reg >> 8) & 0xFF;
+    whole = reg >> 4;
+  }
+  _scratchpad[8] = OneWire::crc8(_scratchpad, 8);
+  _alarm = whole >= (int8_t)_scratchpad[2] || whole <= (int8_t)_scratchpad[3];
+  _conversions++;
+}
@@ -0,0 +1,107 @@
+/*
+Model of a Maxim 1-Wire temperature sensor: DS18S20, DS18B20, DS1822 or DS28EA00.
+
+The device follows the bus one time slot at a time, as the real chip does: it answers the reset pulse,
+takes part in ROM searches and alarm searches through the wired-AND of the bus, and runs the function
+commands (convert T, read/write/copy scratchpad, recall EEPROM, read power supply).
+A conversion takes its datasheet time at the current resolution on the simulated clock, then latches
+the temperature set with setTemperature() and updates the alarm flag from TH and TL.
+
+Faults can be injected at any time: a device that does not answer, a corrupted scratchpad read, a
+device that ignores conversions, or a power cycle that brings back the power-on scratchpad (85 °C).
+*/
+
+#ifndef SIM_DEVICE_H
+#define SIM_DEVICE_H
+
+#include <stdint.h>
+
+// Family codes
+#define SIM_DS18S20 0x10
+#define SIM_DS18B20 0x28
+#define SIM_DS1822 0x22
+#define SIM_DS28EA00 0x42
+
+// Faults, more than one can be set
+#define SIM_FAULT_ABSENT 0x01  // No presence pulse, the device never drives the bus
+#define SIM_FAULT_CRC 0x02  // A bit of the temperature LSB is flipped on every scratchpad read
+#define SIM_FAULT_NO_CONVERSION 0x04  // Convert T is ignored, the scratchpad keeps its last value
+
+class SimDevice
+{
+public:
+  // The ROM code is the family, the 48 bit serial number and their CRC
+  SimDevice(uint8_t family, uint64_t serial, bool parasite = false);
+
+  const uint8_t *rom() const { return _rom; }
+  uint8_t family() const { return _rom[0]; }
+  bool parasite() const { return _parasite; }
+
+  // Temperature measured by the next conversions
+  void setTemperature(float celsius) { _celsius = celsius; }
+  float temperature() const { return _celsius; }
+
+  void setFaults(uint8_t faults) { _faults = faults; }
+  uint8_t faults() const { return _faults; }
+
+  // Loses power: the scratchpad goes back to 85 °C with TH, TL and configuration from the EEPROM
+  void powerCycle();
+
+  bool alarm() const { return _alarm; }
+  const uint8_t *scratchpad() const { return _scratchpad; }
+  uint8_t resolution() const;
+  uint32_t conversionTime() const;  // Microseconds at the current resolution
+  uint32_t conversions() const { return _conversions; }
+  uint32_t eepromWrites() const { return _eepromWrites; }
+
+  // Bus side, called by the simulated OneWire at time "now" (microseconds)
+  bool reset(uint64_t now);
+  void writeBit(uint8_t bit, uint64_t now);
+  uint8_t readBit(uint64_t now);
+  // The master holds the bus high after a byte to power parasite devices
+  void strongPullup(bool on, uint64_t now);
+
+private:
+  enum deviceState {
+    INACTIVE,  // Not selected, waits for the next reset
+    ROM_COMMAND,
+    MATCH_ROM,
+    SEARCH_ROM,
+    READ_ROM,
+    FUNCTION_COMMAND,
+    READ_SCRATCHPAD,
+    WRITE_SCRATCHPAD,
+    CONVERTING,
+    COPYING,
+    RECALLING,
+    READ_POWER
+  };
+
+  uint8_t _rom[8];
+  uint8_t _scratchpad[9];
+  uint8_t _eeprom[3];  // TH, TL, configuration
+  uint8_t _sending[9];  // Scratchpad as sent by the current read, with its CRC
+  float _celsius = 25;
+  bool _parasite;
+  uint8_t _faults = 0;
+  bool _alarm = false;
+
+  uint8_t _state = INACTIVE;
+  uint16_t _bit = 0;  // Bits transferred in the current state
+  uint8_t _byte = 0;  // Byte being received
+  uint8_t _searchSlot = 0;  // 0: send the bit, 1: send its complement, 2: receive the direction
+  bool _converting = false;
+  bool _conversionStarting = false;  // Convert T just received, a parasite device needs the strong pullup now
+  uint64_t _conversionEnd = 0;
+  uint64_t _copyEnd = 0;
+  uint32_t _conversions = 0;
+  uint32_t _eepromWrites = 0;
+
+  void update(uint64_t now);
+  void romCommand(uint8_t command);
+  void functionCommand(uint8_t command, uint64_t now);
+  void latchTemperature();
+  uint8_t romBit(uint8_t index) const { return (_rom[index / 8] >> (index % 8)) & 1; }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "BrokerSim.h"
+#include <string.h>
+
+bool BrokerSim::connect(const char *, uint16_t)
+{
+  _open = _online;
+  _outputLength = 0;
+  return _open;
+}
+
+void BrokerSim::setOnline(bool online)
+{
+  _online = online;
+  if (!online) _open = false;
+}
+
+// Takes whole packets, as the client writes them
+size_t BrokerSim::write(const uint8_t *data, size_t length)
+{
+  if (!_open) return 0;
+  size_t i = 0;
+  while (i < length)
+  {
+    uint8_t type = data[i] & 0xF0;
+    uint32_t remaining = 0, multiplier = 1;
+    size_t n = i + 1;
+    do
+    {
+      remaining += (data[n] & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while (data[n++] & 0x80);
+    const uint8_t *body = data + n;
+
+    switch (type)
+    {
+      case 0x10:  // CONNECT
+        _connections++;
+        answer(0x20, 0, true);  // CONNACK, session present 0 and return code 0 take the place of the id
+        break;
+      case 0x30:  // PUBLISH, QoS 1
+      {
+        size_t topicLength = body[0] << 8 | body[1];
+        uint16_t packetId = body[2 + topicLength] << 8 | body[3 + topicLength];
+        size_t payload = 2 + topicLength + 2;
+        _publishes++;
+        received(body + payload, remaining - payload);
+        if (_lostPubacks > 0) _lostPubacks--;
+        else answer(0x40, packetId, true);
+        break;
+      }
+      case 0xC0:  // PINGREQ
+        answer(0xD0, 0, false);
+        break;
+    }
+    i = n + remaining;
+  }
+  return length;
+}
+
+size_t BrokerSim::read(uint8_t *data, size_t length)
+{
+  if (!_open) return 0;
+  if (length > _outputLength) length = _outputLength;
+  memcpy(data, _output, length);
+  memmove(_output, _output + length, _outputLength - length);
+  _outputLength -= length;
+  return length;
+}
+
+void BrokerSim::answer(uint8_t type, uint16_t packetId, bool withId)
+{
+  if (_outputLength + 4 > BROKER_SIM_OUTPUT_SIZE) return;
+  _output[_outputLength++] = type;
+  _output[_outputLength++] = withId ? 2 : 0;
+  if (!withId) return;
+  _output[_outputLength++] = packetId >> 8;
+  _output[_outputLength++] = packetId & 0xFF;
+}
+
+// Counts the readings of a payload ("[zone,time,raw]" items after the opening "[") unless it was already received
+void BrokerSim::received(const uint8_t *payload, size_t length)
+{
+  if (length > _largestPayload) _largestPayload = length;
+  uint32_t hash = 2166136261u;  // FNV-1a
+  for (size_t i = 0; i < length; i++) hash = (hash ^ payload[i]) * 16777619u;
+  for (int i = 0; i < _hashCount; i++)
+  {
+    if (_hashes[i] != hash) continue;
+    _duplicates++;
+    return;
+  }
+  if (_hashCount < BROKER_SIM_MAX_MESSAGES) _hashes[_hashCount++] = hash;
+  for (size_t i = 0; i < length; i++)
+    if (payload[i] == '[') _samples++;
+  _samples--;
+}
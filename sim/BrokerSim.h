@@ -0,0 +1,59 @@
+/*
+MQTT broker stand-in for the native simulator, in place of a local mosquitto.
+
+BrokerSim is the MqttTransport of the client: what the client writes is parsed as MQTT 3.1.1 and
+answered at once (CONNACK, PUBACK, PINGRESP), the answers are read back by the client. It can go
+offline, which drops the connection and refuses new ones, and lose PUBACKs to make the client publish
+again. Every payload received is counted, duplicates apart, so a run can check that no reading was lost.
+*/
+
+#ifndef BROKER_SIM_H
+#define BROKER_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "MqttTelemetry.h"
+
+#define BROKER_SIM_MAX_MESSAGES 1024  // Distinct payloads remembered to spot the duplicates
+#define BROKER_SIM_OUTPUT_SIZE 64
+
+class BrokerSim : public MqttTransport
+{
+public:
+  bool connect(const char *host, uint16_t port) override;
+  bool connected() override { return _open; }
+  size_t write(const uint8_t *data, size_t length) override;
+  size_t read(uint8_t *data, size_t length) override;
+  void stop() override { _open = false; }
+
+  // Offline, the connection is dropped and new ones are refused
+  void setOnline(bool online);
+  // The next count PUBLISH packets are received but not acknowledged
+  void losePubacks(int count) { _lostPubacks = count; }
+
+  uint32_t connections() const { return _connections; }
+  uint32_t publishes() const { return _publishes; }  // Duplicates included
+  uint32_t duplicates() const { return _duplicates; }
+  uint32_t samples() const { return _samples; }  // Readings in the distinct payloads
+  size_t largestPayload() const { return _largestPayload; }
+
+private:
+  bool _online = true;
+  bool _open = false;
+  int _lostPubacks = 0;
+  uint8_t _output[BROKER_SIM_OUTPUT_SIZE];  // Answers waiting to be read by the client
+  size_t _outputLength = 0;
+
+  uint32_t _connections = 0;
+  uint32_t _publishes = 0;
+  uint32_t _duplicates = 0;
+  uint32_t _samples = 0;
+  size_t _largestPayload = 0;
+  uint32_t _hashes[BROKER_SIM_MAX_MESSAGES];
+  int _hashCount = 0;
+
+  void answer(uint8_t type, uint16_t packetId, bool withId);
+  void received(const uint8_t *payload, size_t length);
+};
+
+#endif
@@ -0,0 +1,259 @@
+/*
+Runs the monitor logic against simulated sensors on the host (pio run -e native, then run the program).
+
+Two buses, six sensors of the four supported models. One zone climbs through the pre alarm and alarm
+thresholds and back, one sensor is unplugged for a while and one loses power. The zones are mapped,
+read and evaluated by Zones.cpp as on the ESP32, with the alarm search of the idle cycles and the
+adaptive sampling, and every mesurement goes through SensorBuses, DallasTemperature and the simulated
+OneWire. The status changes, the bus usage, the history and the telemetry are printed.
+*/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include "SensorBuses.h"
+#include "Zones.h"
+#include "TempHistory.h"
+#include "Metrics.h"
+#include "MqttTelemetry.h"
+#include "BrokerSim.h"
+
+#define MESUREMENT_INTERVAL 60  // Seconds, as in the configuration
+#define SIMULATED_MINUTES 120
+#define PRE_ALARM 30.0f
+#define ALARM_TEMPERATURE 35.0f
+#define RESET_THRESHOLD 1.0f
+#define ALARM_INTERVAL 10  // Minutes between alarm emails
+
+const char *statusNames[] = {"IDLE", "PRE_ALARM", "ALARM", "SENSOR_FAILURE"};
+
+// The temperature of the rack zone: 24 °C, up to 37 °C from minute 30 to 60, back down by minute 90
+float rackTemperature(float minutes)
+{
+  if (minutes < 30) return 24;
+  if (minutes < 60) return 24 + 13 * (minutes - 30) / 30;
+  if (minutes < 90) return 37 - 13 * (minutes - 60) / 30;
+  return 24;
+}
+
+// Prints the status changes and the rejected readings, and records the readings as the monitor does
+class SimZoneLog : public ZoneListener
+{
+public:
+  SimZoneLog(const zone *zones, TempHistory &history, MqttTelemetry &telemetry)
+    : _zones(zones), _history(history), _telemetry(telemetry) {}
+
+  void zoneRead(int zoneIndex, uint8_t result, int16_t raw, uint8_t actions) override
+  {
+    const zone &z = _zones[zoneIndex];
+    if (result == ZONE_READ)
+    {
+      _history.append(zoneIndex, millis() / 1000, z.tempRaw);
+      _telemetry.add({(uint8_t)zoneIndex, (uint32_t)(millis() / 1000), z.tempRaw}, millis());
+      recorded++;
+    }
+    if (result == ZONE_REJECTED)
+      printf("%6.1f min  %s: rejected %.2f °C\n", millis() / 60000.0f, z.config.name, DallasTemperature::rawToCelsius(raw));
+    if (actions & ACTION_STATUS_CHANGED)
+      printf("%6.1f min  %s: %s at %.2f °C\n", millis() / 60000.0f, z.config.name, statusNames[z.alarm.status],
+             DallasTemperature::rawToCelsius(z.alarm.lastRaw));
+    emails += (actions & ACTION_NOTIFY_PRE_ALARM) != 0;
+    emails += (actions & ACTION_NOTIFY_ALARM) != 0;
+    emails += (actions & ACTION_NOTIFY_ALARM_RESET) != 0;
+    emails += (actions & ACTION_NOTIFY_SENSOR_FAILURE) != 0;
+  }
+
+  uint32_t recorded = 0;  // Readings added to the history and to the telemetry
+  uint32_t emails = 0;  // Notifications the monitor would have queued
+
+private:
+  const zone *_zones;
+  TempHistory &_history;
+  MqttTelemetry &_telemetry;
+};
+
+// The unit tests (pio test -e native) build the sources of this env with their own main()
+#ifndef PIO_UNIT_TESTING
+int main()
+{
+  OneWire wire1(15);
+  OneWire wire2(16);
+  SimDevice rack(SIM_DS18B20, 0x0000A1B2C3D4);
+  SimDevice aisle(SIM_DS1822, 0x000011223344);
+  SimDevice legacy(SIM_DS18S20, 0x0000CAFE0001, true);  // Parasite powered
+  SimDevice chain(SIM_DS28EA00, 0x000055667788);
+  SimDevice intake(SIM_DS18B20, 0x0000A1B2C3D5);
+  SimDevice exhaust(SIM_DS18B20, 0x0000A1B2C3D6);
+  wire1.attach(rack);
+  wire1.attach(aisle);
+  wire1.attach(legacy);
+  wire1.attach(chain);
+  wire2.attach(intake);
+  wire2.attach(exhaust);
+  aisle.setTemperature(22.5f);
+  legacy.setTemperature(21.25f);
+  chain.setTemperature(23.0f);
+  intake.setTemperature(19.0f);
+  exhaust.setTemperature(25.5f);
+
+  DallasTemperature sensors1(&wire1);
+  DallasTemperature sensors2(&wire2);
+  SensorBuses buses;
+  buses.addBus(sensors1);
+  buses.addBus(sensors2);
+  buses.begin();
+
+  // A device seen for the first time: every sensor gets a new zone with the global thresholds
+  static deviceConfig simConfig;
+  simConfig.alarms = {PRE_ALARM, ALARM_TEMPERATURE, RESET_THRESHOLD, MESUREMENT_INTERVAL, ALARM_INTERVAL};
+  static zone zones[MAX_ZONES];
+  bool configChanged = false;
+  int zoneCount = mapZones(buses, simConfig, zones, configChanged);
+  zoneSettings settings = {{SENSOR_FAILURE_READINGS, ALARM_INTERVAL * 60000}, {FILTER_MEDIAN_LENGTH, FILTER_EMA_SHIFT, FILTER_MAX_SLEW}};
+  uint8_t samplingLevel = SAMPLING_NORMAL;
+  uint8_t samplingHoldCount = 0;
+  uint32_t samplingPeriod = samplingInterval(samplingLevel, MESUREMENT_INTERVAL * 1000);
+  int failed = configureSensors(buses, zones, zoneCount, samplingLevels[samplingLevel].resolution, true);
+  printf("Found %d devices on %d buses, %d zones, %d not configured\n", buses.deviceCount(), buses.busCount(), zoneCount, failed);
+
+  wire1.clearStats();
+  wire2.clearStats();
+
+  // Every reading goes to the broker stand-in, which is down from minute 30 to 45 and loses two PUBACKs at minute 80
+  BrokerSim broker;
+  mqttSettings mqtt = {"broker", 1883, "tempmon-sim", "tempmon/sim/readings", 12, 5 * 60000};
+  MqttTelemetry telemetry(broker, mqtt, 1);
+  static TempHistory history;
+  SimZoneLog log(zones, history, telemetry);
+
+  uint64_t fullReadTime = 0, alarmReadTime = 0;
+  int fullReads = 0, alarmReads = 0;
+  int levelMesurements[3] = {};
+  unsigned int mesurementCount = 0;
+  float previousMinutes = -1;
+  while (simMicros() < SIMULATED_MINUTES * 60000000ULL)
+  {
+    uint64_t start = simMicros();
+    float minutes = start / 60e6f;
+    // True in the first mesurement at or after the minute given
+    auto at = [&](float minute) { return previousMinutes < minute && minutes >= minute; };
+    rack.setTemperature(rackTemperature(minutes));
+    if (at(20)) aisle.setFaults(SIM_FAULT_ABSENT);
+    if (at(40)) aisle.setFaults(0);
+    if (at(70)) legacy.powerCycle();
+    // Loses power and does not convert: answers its power-on value. Its alarm flag is clear, so only a full read
+    // finds it: the fault lasts until one has been made at the normal level
+    if (at(100))
+    {
+      intake.powerCycle();
+      intake.setFaults(SIM_FAULT_NO_CONVERSION);
+    }
+    if (at(100 + FULL_READ_CYCLES)) intake.setFaults(0);
+    if (at(30)) broker.setOnline(false);
+    if (at(45)) broker.setOnline(true);
+    if (at(80)) broker.losePubacks(2);
+    previousMinutes = minutes;
+
+    uint64_t busTime = wire1.stats().busTime + wire2.stats().busTime;
+    bool fullRead = mesurementCount++ % FULL_READ_CYCLES == 0;
+    watchZones(buses, zones, zoneCount);
+    uint32_t wait = buses.requestTemperatures(millis(), !fullRead);
+    while (wait != BUSES_COLLECTED)
+    {
+      delay(wait);
+      wait = buses.collect(millis());
+    }
+    busTime = wire1.stats().busTime + wire2.stats().busTime - busTime;
+    if (fullRead)
+    {
+      fullReadTime += busTime;
+      fullReads++;
+    }
+    else
+    {
+      alarmReadTime += busTime;
+      alarmReads++;
+    }
+
+    readZones(buses, zones, zoneCount, settings, millis(), log);
+    levelMesurements[samplingLevel]++;
+    uint8_t level = nextSamplingLevel(samplingLevel, samplingHoldCount, zones, zoneCount);
+    if (level != samplingLevel)
+    {
+      samplingLevel = level;
+      samplingPeriod = samplingInterval(level, MESUREMENT_INTERVAL * 1000);
+      if (buses.getResolution() != samplingLevels[level].resolution)
+        configureSensors(buses, zones, zoneCount, samplingLevels[level].resolution, false);
+      printf("%6.1f min  sampling every %u s at %u bits\n", minutes, (unsigned)(samplingPeriod / 1000),
+             (unsigned)samplingLevels[level].resolution);
+    }
+
+    // The telemetry runs until the next mesurement, as its task would
+    uint64_t cycleEnd = start + samplingPeriod * 1000ULL;
+    while (simMicros() < cycleEnd)
+    {
+      uint64_t wait = telemetry.poll(millis()) * 1000ULL;
+      if (wait == 0) wait = 1000;
+      simAdvance(wait < cycleEnd - simMicros() ? wait : cycleEnd - simMicros());
+    }
+  }
+
+  printf("\nBus usage over %d minutes\n", SIMULATED_MINUTES);
+  printf("  full read cycles:   %3d, %6llu us of bus time each\n", fullReads, (unsigned long long)(fullReadTime / fullReads));
+  printf("  alarm read cycles:  %3d, %6llu us of bus time each\n", alarmReads, (unsigned long long)(alarmReadTime / alarmReads));
+  printf("  mesurements at the slow, normal and fast levels: %d, %d, %d\n", levelMesurements[SAMPLING_SLOW],
+         levelMesurements[SAMPLING_NORMAL], levelMesurements[SAMPLING_FAST]);
+  OneWire *wires[] = {&wire1, &wire2};
+  for (int i = 0; i < 2; i++)
+  {
+    const oneWireStats &s = wires[i]->stats();
+    printf("  bus %d: %u resets, %u bits written, %u bits read, %llu us\n", i, (unsigned)s.resets, (unsigned)s.bitsWritten,
+           (unsigned)s.bitsRead, (unsigned long long)s.busTime);
+  }
+  printf("  EEPROM writes of the rack sensor: %u\n", (unsigned)rack.eepromWrites());
+  uint32_t rejected = 0;
+  for (int i = 0; i < zoneCount; i++) rejected += zones[i].filter.rejectedPowerOn + zones[i].filter.rejectedSlew;
+  printf("  readings rejected by the filter: %u\n", (unsigned)rejected);
+  printf("  emails queued: %u\n", (unsigned)log.emails);
+
+  printf("\nHistory: %u bytes of %u\n", (unsigned)history.bytesUsed(), (unsigned)TempHistory::memorySize());
+  for (int i = 0; i < zoneCount; i++) printf("  %s: %u readings\n", zones[i].config.name, (unsigned)history.sampleCount(i));
+
+  // The last batch is still waiting for its age, a few more minutes without readings let it go
+  uint64_t drainEnd = simMicros() + 10 * 60000000ULL;
+  while (simMicros() < drainEnd)
+  {
+    uint64_t wait = telemetry.poll(millis()) * 1000ULL;
+    simAdvance(wait == 0 ? 1000 : wait < drainEnd - simMicros() ? wait : drainEnd - simMicros());
+  }
+  const mqttStats &ms = telemetry.stats();
+  printf("\nMQTT telemetry\n");
+  printf("  readings: %u added, %u received by the broker, %u dropped\n", (unsigned)log.recorded,
+         (unsigned)broker.samples(), (unsigned)ms.samplesDropped);
+  printf("  publishes: %u (%u retransmitted, %u duplicates at the broker), %u acknowledged, largest payload %u bytes\n",
+         (unsigned)ms.published, (unsigned)ms.retransmitted, (unsigned)broker.duplicates(), (unsigned)ms.acked,
+         (unsigned)broker.largestPayload());
+  printf("  connections: %u, failed or lost: %u\n", (unsigned)broker.connections(), (unsigned)ms.connectFailures);
+
+  // What /metrics would answer at the end of the run
+  static deviceMetrics metrics;
+  metrics.uptime = millis() / 1000;
+  metrics.status = worstZoneStatus(zones, zoneCount);
+  metrics.zoneCount = zoneCount;
+  for (int i = 0; i < zoneCount; i++)
+  {
+    zoneMetrics &zm = metrics.zones[i];
+    memcpy(zm.address, zones[i].config.address, sizeof(DeviceAddress));
+    memcpy(zm.name, zones[i].config.name, ZONE_NAME_SIZE);
+    zm.raw = zones[i].tempRaw;
+    zm.status = zones[i].alarm.status;
+    zm.failedReadings = zones[i].alarm.failedReadings;
+    zm.rejectedPowerOn = zones[i].filter.rejectedPowerOn;
+    zm.rejectedSlew = zones[i].filter.rejectedSlew;
+  }
+  static char body[6144];
+  printf("\n%s", formatMetrics(metrics, body, sizeof(body)) ? body : "Metrics do not fit the buffer\n");
+  return 0;
+}
+#endif
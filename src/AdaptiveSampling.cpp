@@ -0,0 +1,29 @@
+#include "AdaptiveSampling.h"
+
+const samplingSettings samplingLevels[3] = {
+  {200, 9},   // SAMPLING_SLOW
+  {100, 11},  // SAMPLING_NORMAL
+  {25, 12},   // SAMPLING_FAST
+};
+
+uint8_t samplingLevelFor(uint8_t status, int16_t raw, int16_t previousRaw, uint32_t elapsed, const alarmThresholds &thresholds)
+{
+  // In pre alarm the next step is the alarm, the other states only wait for the reading to come back
+  if (status == PRE_ALARM) return SAMPLING_FAST;
+  if (status != IDLE) return SAMPLING_NORMAL;
+
+  int32_t margin = (int32_t)thresholds.preAlarm - raw;
+  int32_t rate = elapsed ? ((int64_t)raw - previousRaw) * 60000 / elapsed : 0;  // 1/128 °C per minute
+
+  if (margin <= SAMPLING_NEAR_MARGIN) return SAMPLING_FAST;
+  if (rate > 0 && margin <= rate * SAMPLING_LOOKAHEAD) return SAMPLING_FAST;
+  if (margin >= SAMPLING_FAR_MARGIN && rate < SAMPLING_STEADY_RATE && rate > -SAMPLING_STEADY_RATE) return SAMPLING_SLOW;
+  return SAMPLING_NORMAL;
+}
+
+uint32_t samplingInterval(uint8_t level, uint32_t configuredInterval)
+{
+  uint32_t interval = (uint64_t)configuredInterval * samplingLevels[level].intervalPercent / 100;
+  if (interval < SAMPLING_MIN_INTERVAL) interval = configuredInterval < SAMPLING_MIN_INTERVAL ? configuredInterval : SAMPLING_MIN_INTERVAL;
+  return interval;
+}
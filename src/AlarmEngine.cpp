@@ -0,0 +1,115 @@
+#include "AlarmEngine.h"
+#include <math.h>
+
+// Where a reading falls relative to the zone thresholds. setZoneThresholds() keeps
+// preAlarmReset < preAlarm < alarm and preAlarmReset <= alarmReset < alarm, so these are all the cases
+enum readingBand {
+  BAND_HIGH,              // >= alarm
+  BAND_MID,               // >= preAlarm, < alarm
+  BAND_MID_ALARM_RESET,   // >= preAlarm, <= alarmReset
+  BAND_LOW,               // < preAlarm, > alarmReset
+  BAND_LOW_ALARM_RESET,   // < preAlarm, <= alarmReset, > preAlarmReset
+  BAND_LOW_RESET,         // <= preAlarmReset
+  BAND_COUNT
+};
+
+#define T_GATED 0x01  // Happens only if notifyTempNow is set or notifyInterval has elapsed since the last email
+#define T_REARM 0x02  // The next temperature alarm is notified at once
+
+struct transition {
+  uint8_t next;
+  uint8_t actions;  // No action means no transition
+  uint8_t flags;
+};
+
+static const transition temperatureTable[ALARM + 1][BAND_COUNT] = {
+  // IDLE
+  {{ALARM, ACTION_NOTIFY_ALARM, 0},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_GATED},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_GATED},
+   {IDLE, 0, 0},
+   {IDLE, 0, 0},
+   {IDLE, 0, 0}},
+  // PRE_ALARM
+  {{ALARM, ACTION_NOTIFY_ALARM, 0},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_GATED},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_GATED},
+   {PRE_ALARM, 0, 0},
+   {PRE_ALARM, 0, 0},
+   {IDLE, ACTION_NOTIFY_ALARM_RESET, T_REARM}},
+  // ALARM
+  {{ALARM, ACTION_NOTIFY_ALARM, T_GATED},
+   {ALARM, 0, 0},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_REARM},
+   {ALARM, 0, 0},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_REARM},
+   {PRE_ALARM, ACTION_NOTIFY_PRE_ALARM, T_REARM}},
+};
+
+static readingBand classify(int16_t raw, const alarmThresholds &t)
+{
+  if (raw >= t.alarm) return BAND_HIGH;
+  if (raw >= t.preAlarm) return raw <= t.alarmReset ? BAND_MID_ALARM_RESET : BAND_MID;
+  if (raw <= t.preAlarmReset) return BAND_LOW_RESET;
+  return raw <= t.alarmReset ? BAND_LOW_ALARM_RESET : BAND_LOW;
+}
+
+uint8_t alarmStep(alarmState &state, const alarmThresholds &thresholds, const alarmSettings &settings,
+                  uint32_t now, bool valid, int16_t raw)
+{
+  uint8_t previousStatus = state.status;
+  uint8_t actions = 0;
+
+  if (valid)
+  {
+    state.failedReadings = 0;
+    state.lastRaw = raw;
+    if (state.status == SENSOR_FAILURE)
+    {
+      state.status = IDLE;
+      state.notifyFailureNow = true;
+    }
+  }
+  else
+  {
+    if (state.failedReadings < UINT8_MAX) state.failedReadings++;
+    if (state.failedReadings >= settings.failureReadings) state.status = SENSOR_FAILURE;
+  }
+
+  if (state.status <= ALARM)
+  {
+    const transition &t = temperatureTable[state.status][classify(state.lastRaw, thresholds)];
+    bool allowed = !(t.flags & T_GATED) || state.notifyTempNow || now - state.lastTempNotify > settings.notifyInterval;
+    if (t.actions && allowed)
+    {
+      state.status = t.next;
+      actions |= t.actions;
+      if (t.flags & T_REARM) state.notifyTempNow = true;
+      else
+      {
+        state.notifyTempNow = false;
+        state.lastTempNotify = now;
+      }
+    }
+  }
+
+  if (state.status == SENSOR_FAILURE && (state.notifyFailureNow || now - state.lastFailureNotify > settings.notifyInterval))
+  {
+    actions |= ACTION_NOTIFY_SENSOR_FAILURE;
+    state.notifyFailureNow = false;
+    state.lastFailureNotify = now;
+  }
+
+  if (state.status != previousStatus) actions |= ACTION_STATUS_CHANGED;
+  return actions;
+}
+
+int16_t celsiusToRawCeil(float celsius)
+{
+  return fminf(fmaxf(ceilf(celsius * 128.0f), -32768.0f), 32767.0f);
+}
+
+int16_t celsiusToRawFloor(float celsius)
+{
+  return fminf(fmaxf(floorf(celsius * 128.0f), -32768.0f), 32767.0f);
+}
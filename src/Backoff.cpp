@@ -0,0 +1,22 @@
+#include "Backoff.h"
+
+Backoff::Backoff(uint32_t min, uint32_t max, uint32_t seed)
+  : _min(min), _max(max), _random(seed ? seed : 1)
+{
+}
+
+uint32_t Backoff::next()
+{
+  uint32_t backoff = _max;
+  if (_failures < 20 && (_min << _failures) < _max) backoff = _min << _failures;
+  if (_failures < UINT8_MAX) _failures++;
+  return backoff / 2 + nextRandom() % (backoff / 2 + 1);
+}
+
+uint32_t Backoff::nextRandom()
+{
+  _random ^= _random << 13;
+  _random ^= _random >> 17;
+  _random ^= _random << 5;
+  return _random;
+}
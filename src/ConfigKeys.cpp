@@ -0,0 +1,135 @@
+#include "ConfigKeys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEVICE_KEY(section, field, type, min, max) \
+  {#section "." #field, type, offsetof(deviceConfig, section.field), sizeof(deviceConfig::section.field), min, max}
+#define ZONE_KEY(field, type, min, max) \
+  {#field, type, offsetof(zoneConfig, field), sizeof(zoneConfig::field), min, max}
+
+const configKey deviceKeys[] = {
+  DEVICE_KEY(network, ssid, KEY_STRING, 0, 0),
+  DEVICE_KEY(network, isWpaEnterprise, KEY_BOOL, 0, 0),
+  DEVICE_KEY(network, passwd, KEY_SECRET, 0, 0),
+  DEVICE_KEY(network, eapID, KEY_STRING, 0, 0),
+  DEVICE_KEY(network, eapUsername, KEY_STRING, 0, 0),
+  DEVICE_KEY(network, eapPassword, KEY_SECRET, 0, 0),
+  DEVICE_KEY(alarms, preAlarmTemperature, KEY_FLOAT, -55, 125),
+  DEVICE_KEY(alarms, alarmTemperature, KEY_FLOAT, -55, 125),
+  DEVICE_KEY(alarms, alarmResetThreshold, KEY_FLOAT, 0.1f, 20),
+  DEVICE_KEY(alarms, mesureInterval, KEY_INT, 1, 9999),  // Seconds
+  DEVICE_KEY(alarms, alarmInterval, KEY_INT, 1, 9999),  // Minutes
+  DEVICE_KEY(email, smtpServer, KEY_STRING, 0, 0),
+  DEVICE_KEY(email, smtpPort, KEY_INT, 1, 65535),
+  DEVICE_KEY(email, senderAddress, KEY_STRING, 0, 0),
+  DEVICE_KEY(email, senderPassword, KEY_SECRET, 0, 0),
+  DEVICE_KEY(email, authorName, KEY_STRING, 0, 0),
+  DEVICE_KEY(email, recipient, KEY_STRING, 0, 0),
+  DEVICE_KEY(email, imAliveInterval, KEY_INT, 1, 9999),  // Hours
+};
+const size_t deviceKeyCount = sizeof(deviceKeys) / sizeof(deviceKeys[0]);
+
+const configKey zoneKeys[] = {
+  ZONE_KEY(address, KEY_ADDRESS, 0, 0),
+  ZONE_KEY(name, KEY_STRING, 0, 0),
+  ZONE_KEY(preAlarmTemperature, KEY_FLOAT, -55, 125),
+  ZONE_KEY(alarmTemperature, KEY_FLOAT, -55, 125),
+};
+const size_t zoneKeyCount = sizeof(zoneKeys) / sizeof(zoneKeys[0]);
+
+const configKey *findConfigKey(const configKey *keys, size_t count, const char *name)
+{
+  for (size_t i = 0; i < count; i++)
+    if (strcmp(keys[i].name, name) == 0) return &keys[i];
+  return nullptr;
+}
+
+size_t formatConfigValue(const void *base, const configKey &key, char *buffer, size_t size)
+{
+  const uint8_t *field = (const uint8_t *)base + key.offset;
+  int n = -1;
+  switch (key.type)
+  {
+    case KEY_STRING:
+      n = snprintf(buffer, size, "%.*s", (int)key.size - 1, (const char *)field);
+      break;
+    case KEY_SECRET:
+      n = snprintf(buffer, size, "%.*s", (int)key.size - 1, (const char *)field);
+      for (int i = 1; i < n - 1 && i < (int)size - 1; i++) buffer[i] = '*';
+      break;
+    case KEY_BOOL:
+      n = snprintf(buffer, size, "%s", *(const bool *)field ? "yes" : "no");
+      break;
+    case KEY_FLOAT:
+    {
+      float value;
+      memcpy(&value, field, sizeof(value));
+      n = snprintf(buffer, size, "%.2f", value);
+      break;
+    }
+    case KEY_INT:
+    {
+      int32_t value;
+      memcpy(&value, field, sizeof(value));  // uint32_t fields never exceed INT32_MAX within their limits
+      n = snprintf(buffer, size, "%d", (int)value);
+      break;
+    }
+    case KEY_ADDRESS:
+      n = snprintf(buffer, size, "%02X%02X%02X%02X%02X%02X%02X%02X",
+                   field[0], field[1], field[2], field[3], field[4], field[5], field[6], field[7]);
+      break;
+  }
+  if (n < 0 || (size_t)n >= size)
+  {
+    if (size) buffer[0] = 0;
+    return 0;
+  }
+  return n;
+}
+
+config_status parseConfigValue(void *base, const configKey &key, const char *text)
+{
+  uint8_t *field = (uint8_t *)base + key.offset;
+  char *end;
+  switch (key.type)
+  {
+    case KEY_STRING:
+    case KEY_SECRET:
+    {
+      size_t length = strlen(text);
+      if (length >= key.size) return CONFIG_BAD_VALUE;
+      memcpy(field, text, length + 1);
+      return CONFIG_OK;
+    }
+    case KEY_BOOL:
+      if (strcmp(text, "yes") == 0) *(bool *)field = true;
+      else if (strcmp(text, "no") == 0) *(bool *)field = false;
+      else return CONFIG_BAD_VALUE;
+      return CONFIG_OK;
+    case KEY_FLOAT:
+    {
+      float value = strtof(text, &end);
+      if (end == text || *end != 0 || !(value >= key.min && value <= key.max)) return CONFIG_BAD_VALUE;
+      memcpy(field, &value, sizeof(value));
+      return CONFIG_OK;
+    }
+    case KEY_INT:
+    {
+      long value = strtol(text, &end, 10);
+      if (end == text || *end != 0 || value < key.min || value > key.max) return CONFIG_BAD_VALUE;
+      int32_t stored = value;
+      memcpy(field, &stored, sizeof(stored));
+      return CONFIG_OK;
+    }
+  }
+  return CONFIG_READ_ONLY;
+}
+
+const char *configStatusName(config_status status)
+{
+  static const char *const names[] = {
+    "OK", "UNKNOWN_COMMAND", "BAD_ARGUMENTS", "UNKNOWN_KEY", "BAD_VALUE", "READ_ONLY", "INVALID", "SAVE_FAILED",
+  };
+  return status < sizeof(names) / sizeof(names[0]) ? names[status] : "ERROR";
+}
@@ -0,0 +1,134 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include "DeviceConfig.h"
+
+// Layout of the blob saved in the NVS
+struct configBlob {
+  uint16_t version;
+  uint16_t size;
+  uint32_t crc;  // CRC32 of data
+  deviceConfig data;
+};
+
+deviceConfig config;
+
+static Preferences configStorage;
+
+// Copies a String to a fixed size buffer, always terminating it
+static void copyString(char *dest, const String &src, size_t size)
+{
+  strncpy(dest, src.c_str(), size - 1);
+  dest[size - 1] = 0;
+}
+
+// Reads the configuration from the namespaces used before the blob was introduced
+static void loadLegacyConfig(deviceConfig &cfg)
+{
+  configStorage.begin("network", true);
+  copyString(cfg.network.ssid, configStorage.getString("ssid", cfg.network.ssid), sizeof(cfg.network.ssid));
+  cfg.network.isWpaEnterprise = configStorage.getString("isWpaEnterprise", cfg.network.isWpaEnterprise ? "yes" : "no") == String("yes");
+  copyString(cfg.network.passwd, configStorage.getString("passwd", cfg.network.passwd), CONFIG_STRING_SIZE);
+  copyString(cfg.network.eapID, configStorage.getString("eap_id", cfg.network.eapID), CONFIG_STRING_SIZE);
+  copyString(cfg.network.eapUsername, configStorage.getString("eap_username", cfg.network.eapUsername), CONFIG_STRING_SIZE);
+  copyString(cfg.network.eapPassword, configStorage.getString("eap_password", cfg.network.eapPassword), CONFIG_STRING_SIZE);
+  configStorage.end();
+
+  configStorage.begin("alarms", true);
+  cfg.alarms.preAlarmTemperature = configStorage.getFloat("pre_alarm", cfg.alarms.preAlarmTemperature);
+  cfg.alarms.alarmTemperature = configStorage.getFloat("alarm_threshold", cfg.alarms.alarmTemperature);
+  cfg.alarms.alarmResetThreshold = configStorage.getFloat("reset_threshold", cfg.alarms.alarmResetThreshold);
+  cfg.alarms.mesureInterval = configStorage.getInt("mesure_interval", cfg.alarms.mesureInterval);
+  cfg.alarms.alarmInterval = configStorage.getInt("alarm_interval", cfg.alarms.alarmInterval);
+  configStorage.end();
+
+  configStorage.begin("email", true);
+  copyString(cfg.email.smtpServer, configStorage.getString("smtp_server", cfg.email.smtpServer), CONFIG_STRING_SIZE);
+  cfg.email.smtpPort = configStorage.getUInt("smpt_port", cfg.email.smtpPort);
+  copyString(cfg.email.senderAddress, configStorage.getString("sender_address", cfg.email.senderAddress), CONFIG_STRING_SIZE);
+  copyString(cfg.email.senderPassword, configStorage.getString("sender_password", cfg.email.senderPassword), CONFIG_STRING_SIZE);
+  copyString(cfg.email.authorName, configStorage.getString("author_name", cfg.email.authorName), CONFIG_STRING_SIZE);
+  copyString(cfg.email.recipient, configStorage.getString("recipient_1", cfg.email.recipient), CONFIG_STRING_SIZE);
+  cfg.email.imAliveInterval = configStorage.getInt("imAlive_intrvl", cfg.email.imAliveInterval);
+  configStorage.end();
+
+  char key[8];
+  configStorage.begin("zones", true);
+  for (int slot = 0; slot < MAX_ZONES; slot++)
+  {
+    sprintf(key, "zone_%d", slot);
+    cfg.zoneSlotUsed[slot] = configStorage.getBytes(key, &cfg.zones[slot], sizeof(zoneConfig)) == sizeof(zoneConfig);
+  }
+  configStorage.end();
+}
+
+void setDefaultConfig(deviceConfig &cfg)
+{
+  memset(&cfg, 0, sizeof(deviceConfig));
+
+  strcpy(cfg.network.ssid, "your_ssid");
+  cfg.network.isWpaEnterprise = false;
+  strcpy(cfg.network.passwd, "password");
+  strcpy(cfg.network.eapID, "id");
+  strcpy(cfg.network.eapUsername, "user");
+  strcpy(cfg.network.eapPassword, "password");
+
+  cfg.alarms.preAlarmTemperature = 30.0;  // temperature above wich the pre alarm is triggered
+  cfg.alarms.alarmTemperature = 35.0;     // temperature above wich the alarm sends a notify via email
+  cfg.alarms.alarmResetThreshold = 1.0;   // temperature threshold subtracted to the pre alarm threshold under which the alarm is reactivated
+  cfg.alarms.mesureInterval = 60;         // time intervall (seconds) beetween mesurements
+  cfg.alarms.alarmInterval = 10;          // time intervall (minutes) beetween alarm emails
+
+  strcpy(cfg.email.smtpServer, "smtp.email.something");
+  cfg.email.smtpPort = 465;
+  strcpy(cfg.email.senderAddress, "you@email.something");
+  strcpy(cfg.email.senderPassword, "password");
+  strcpy(cfg.email.authorName, "ESP32 - Server temp monitor");
+  cfg.email.imAliveInterval = 30;         // time intervall (hours) beetween "Im alive" emails
+}
+
+bool loadConfig(deviceConfig &cfg)
+{
+  static configBlob blob;  // Too big for the loop() stack
+
+  configStorage.begin("config", true);
+  size_t length = configStorage.getBytes("blob", &blob, sizeof(configBlob));
+  configStorage.end();
+
+  if (length == sizeof(configBlob) && blob.version == CONFIG_VERSION && blob.size == sizeof(deviceConfig)
+      && blob.crc == configCrc32((const uint8_t *)&blob.data, sizeof(deviceConfig)))
+  {
+    cfg = blob.data;
+    return true;
+  }
+
+  setDefaultConfig(cfg);
+  loadLegacyConfig(cfg);
+  return false;
+}
+
+bool saveConfig(const deviceConfig &cfg)
+{
+  static configBlob blob;
+
+  blob.version = CONFIG_VERSION;
+  blob.size = sizeof(deviceConfig);
+  blob.data = cfg;
+  blob.crc = configCrc32((const uint8_t *)&blob.data, sizeof(deviceConfig));
+
+  configStorage.begin("config");
+  size_t written = configStorage.putBytes("blob", &blob, sizeof(configBlob));
+  configStorage.end();
+  return written == sizeof(configBlob);
+}
+
+uint32_t configCrc32(const uint8_t *data, size_t length)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  while (length--)
+  {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
@@ -0,0 +1,67 @@
+#include "LedcLed.h"
+#include "driver/ledc.h"
+
+#define LED_SPEED_MODE LEDC_LOW_SPEED_MODE
+#define LED_TIMER LEDC_TIMER_0
+#define LED_FIRST_CHANNEL LEDC_CHANNEL_0  // Red, green and blue take three channels from here
+#define LED_RESOLUTION 14
+#define LED_MAX_DUTY (1UL << LED_RESOLUTION)
+// REF_TICK is 1 MHz and the divider has 8 fractional bits: divider = period * 1000 * 256 / 2^14
+#define LED_DIVIDER_PER_MS 15.625f
+#define LED_MIN_DIVIDER 256UL  // 1.0
+#define LED_MAX_DIVIDER 0x3FFFFUL  // 1023.996
+
+LedcLed::LedcLed(uint8_t redPin, uint8_t greenPin, uint8_t bluePin)
+{
+  _pins[0] = redPin;
+  _pins[1] = greenPin;
+  _pins[2] = bluePin;
+}
+
+void LedcLed::begin()
+{
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = LED_SPEED_MODE;
+  timer.duty_resolution = (ledc_timer_bit_t)LED_RESOLUTION;
+  timer.timer_num = LED_TIMER;
+  timer.freq_hz = 1;
+  timer.clk_cfg = LEDC_USE_REF_TICK;
+  ledc_timer_config(&timer);
+
+  for (int i = 0; i < 3; i++)
+  {
+    ledc_channel_config_t channel = {};
+    channel.gpio_num = _pins[i];
+    channel.speed_mode = LED_SPEED_MODE;
+    channel.channel = (ledc_channel_t)(LED_FIRST_CHANNEL + i);
+    channel.timer_sel = LED_TIMER;
+    channel.duty = 0;
+    channel.hpoint = 0;  // On at the start of the period
+    ledc_channel_config(&channel);
+  }
+}
+
+void LedcLed::blink(uint8_t color, uint16_t onTime, uint16_t offTime)
+{
+  uint32_t period = (uint32_t)onTime + offTime;
+  uint32_t duty = 0;
+  if (period > 0) duty = (uint32_t)((uint64_t)onTime * LED_MAX_DUTY / period);
+
+  if (duty > 0 && duty < LED_MAX_DUTY)
+  {
+    uint32_t divider = period * LED_DIVIDER_PER_MS + 0.5f;
+    if (divider < LED_MIN_DIVIDER) divider = LED_MIN_DIVIDER;
+    if (divider > LED_MAX_DIVIDER) divider = LED_MAX_DIVIDER;
+    ledc_timer_set(LED_SPEED_MODE, LED_TIMER, divider, LED_RESOLUTION, LEDC_REF_TICK);
+  }
+
+  // Colors bits are blue, green, red from the lowest
+  for (int i = 0; i < 3; i++)
+  {
+    ledc_channel_t channel = (ledc_channel_t)(LED_FIRST_CHANNEL + i);
+    ledc_set_duty(LED_SPEED_MODE, channel, (color & (4 >> i)) ? duty : 0);
+    ledc_update_duty(LED_SPEED_MODE, channel);
+  }
+  // Restarts the period so that the new pattern begins with its on time
+  ledc_timer_rst(LED_SPEED_MODE, LED_TIMER);
+}
@@ -0,0 +1,33 @@
+#include "LineEditor.h"
+
+line_event LineEditor::feed(char c)
+{
+  if (_done) clear();  // The line was taken, a new one starts
+  bool afterCR = _afterCR;
+  _afterCR = c == '\r';
+
+  if (c == '\n' && afterCR) return LINE_NONE;
+  if (c == '\r' || c == '\n')
+  {
+    _done = true;
+    return LINE_DONE;
+  }
+  if (c == '\b' || c == 127)
+  {
+    if (_length == 0) return LINE_NONE;
+    _buffer[--_length] = 0;
+    return LINE_ERASE;
+  }
+  if ((unsigned char)c < ' ') return LINE_NONE;  // Other control characters, e.g. the escape sequences of the arrow keys
+  if (_length == LINE_EDITOR_SIZE) return LINE_FULL;
+  _buffer[_length++] = c;
+  _buffer[_length] = 0;
+  return LINE_CHAR;
+}
+
+void LineEditor::clear()
+{
+  _length = 0;
+  _buffer[0] = 0;
+  _done = false;
+}
@@ -0,0 +1,120 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+// Appends to a fixed buffer, remembers when something did not fit
+struct metricsWriter {
+  char *buffer;
+  size_t size;
+  size_t length;
+  bool full;
+};
+
+static void print(metricsWriter &w, const char *format, ...)
+{
+  if (w.full) return;
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(w.buffer + w.length, w.size - w.length, format, args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= w.size - w.length) w.full = true;
+  else w.length += n;
+}
+
+static void put(metricsWriter &w, char c)
+{
+  if (w.full || w.length + 1 >= w.size) w.full = true;
+  else w.buffer[w.length++] = c;
+}
+
+static void family(metricsWriter &w, const char *name, const char *type, const char *help)
+{
+  print(w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Zone name and ROM code of the sensor as labels, backslash, quote and newline escaped in the name
+static void zoneLabels(metricsWriter &w, const zoneMetrics &z)
+{
+  print(w, "{zone=\"");
+  for (const char *c = z.name; *c && c < z.name + ZONE_NAME_SIZE; c++)
+  {
+    if (*c == '\\' || *c == '"') put(w, '\\');
+    if (*c == '\n')
+    {
+      put(w, '\\');
+      put(w, 'n');
+    }
+    else put(w, *c);
+  }
+  print(w, "\",sensor=\"");
+  const char *hex = "0123456789ABCDEF";
+  for (int i = 0; i < 8; i++)
+  {
+    put(w, hex[z.address[i] >> 4]);
+    put(w, hex[z.address[i] & 0x0F]);
+  }
+  put(w, '"');
+}
+
+size_t formatMetrics(const deviceMetrics &m, char *buffer, size_t size)
+{
+  metricsWriter w = {buffer, size, 0, size == 0};
+
+  family(w, "tempmon_uptime_seconds", "counter", "Seconds since startup");
+  print(w, "tempmon_uptime_seconds %u\n", (unsigned)m.uptime);
+  family(w, "tempmon_status", "gauge", "System status: 0 idle, 1 pre alarm, 2 alarm, 3 sensor failure, 4 configuration");
+  print(w, "tempmon_status %u\n", (unsigned)m.status);
+  if (m.wifiConnected)
+  {
+    family(w, "tempmon_wifi_rssi_dbm", "gauge", "Signal strength of the access point");
+    print(w, "tempmon_wifi_rssi_dbm %d\n", (int)m.rssi);
+  }
+  family(w, "tempmon_emails_sent_total", "counter", "Emails accepted by the SMTP server");
+  print(w, "tempmon_emails_sent_total %u\n", (unsigned)m.emailsSent);
+  family(w, "tempmon_emails_failed_total", "counter", "Emails that could not be sent");
+  print(w, "tempmon_emails_failed_total %u\n", (unsigned)m.emailsFailed);
+  family(w, "tempmon_emails_dropped_total", "counter", "Emails dropped because the queue was full");
+  print(w, "tempmon_emails_dropped_total %u\n", (unsigned)m.emailsDropped);
+
+  family(w, "tempmon_temperature_celsius", "gauge", "Last valid reading of the zone");
+  for (int i = 0; i < m.zoneCount; i++)
+  {
+    const zoneMetrics &z = m.zones[i];
+    if (z.raw == DEVICE_DISCONNECTED_RAW) continue;
+    print(w, "tempmon_temperature_celsius");
+    zoneLabels(w, z);
+    print(w, "} %.4f\n", z.raw / 128.0);
+  }
+  family(w, "tempmon_zone_status", "gauge", "Status of the zone, same values as tempmon_status");
+  for (int i = 0; i < m.zoneCount; i++)
+  {
+    print(w, "tempmon_zone_status");
+    zoneLabels(w, m.zones[i]);
+    print(w, "} %u\n", (unsigned)m.zones[i].status);
+  }
+  family(w, "tempmon_sensor_errors", "gauge", "Consecutive failed readings of the sensor");
+  for (int i = 0; i < m.zoneCount; i++)
+  {
+    print(w, "tempmon_sensor_errors");
+    zoneLabels(w, m.zones[i]);
+    print(w, "} %u\n", (unsigned)m.zones[i].failedReadings);
+  }
+  family(w, "tempmon_readings_rejected_total", "counter", "Readings dropped by the zone filter");
+  for (int i = 0; i < m.zoneCount; i++)
+  {
+    print(w, "tempmon_readings_rejected_total");
+    zoneLabels(w, m.zones[i]);
+    print(w, ",reason=\"power_on\"} %u\n", (unsigned)m.zones[i].rejectedPowerOn);
+    print(w, "tempmon_readings_rejected_total");
+    zoneLabels(w, m.zones[i]);
+    print(w, ",reason=\"slew\"} %u\n", (unsigned)m.zones[i].rejectedSlew);
+  }
+
+  if (w.full)
+  {
+    if (size) buffer[0] = 0;
+    return 0;
+  }
+  buffer[w.length] = 0;
+  return w.length;
+}
@@ -0,0 +1,309 @@
+#include "MqttTelemetry.h"
+#include <stdio.h>
+#include <string.h>
+
+// MQTT 3.1.1 control packet types, in the high nibble of the first byte
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH_QOS1 0x32
+#define MQTT_PUBLISH_DUP 0x08
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_CLEAN_SESSION 0x02
+
+// Writes a string with its 16 bit length, at most maxLength characters. Returns the bytes written
+static size_t putString(uint8_t *out, const char *s, size_t maxLength)
+{
+  size_t length = strlen(s);
+  if (length > maxLength) length = maxLength;
+  out[0] = length >> 8;
+  out[1] = length & 0xFF;
+  memcpy(out + 2, s, length);
+  return length + 2;
+}
+
+// Writes the fixed header: packet type and remaining length (1 to 4 bytes of 7 bits). Returns the bytes written
+static size_t putHeader(uint8_t *out, uint8_t type, uint32_t remaining)
+{
+  size_t n = 0;
+  out[n++] = type;
+  do
+  {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    out[n++] = remaining ? digit | 0x80 : digit;
+  } while (remaining);
+  return n;
+}
+
+// Milliseconds left of a wait started at "start"
+static uint32_t remaining(uint32_t start, uint32_t duration, uint32_t now)
+{
+  uint32_t elapsed = now - start;
+  return elapsed < duration ? duration - elapsed : 0;
+}
+
+MqttTelemetry::MqttTelemetry(MqttTransport &transport, const mqttSettings &settings, uint32_t seed)
+  : _transport(transport), _settings(settings), _retry(MQTT_BACKOFF_MIN, MQTT_BACKOFF_MAX, seed)
+{
+  if (_settings.batchSamples < 1) _settings.batchSamples = 1;
+  if (_settings.batchSamples > MQTT_BATCH_MAX_SAMPLES) _settings.batchSamples = MQTT_BATCH_MAX_SAMPLES;
+}
+
+void MqttTelemetry::add(const telemetrySample &sample, uint32_t now)
+{
+  if (_sampleCount == MQTT_BATCH_MAX_SAMPLES)
+  {
+    _sampleFirst = (_sampleFirst + 1) % MQTT_BATCH_MAX_SAMPLES;
+    _sampleCount--;
+    _stats.samplesDropped++;
+  }
+  if (_sampleCount == 0) _batchStart = now;
+  _samples[(_sampleFirst + _sampleCount) % MQTT_BATCH_MAX_SAMPLES] = sample;
+  _sampleCount++;
+}
+
+uint32_t MqttTelemetry::poll(uint32_t now)
+{
+  if (_state == DISCONNECTED && now - _stateTime >= _backoff) connectBroker(now);
+  if (_state != DISCONNECTED)
+  {
+    receive(now);
+    if (_state != DISCONNECTED && !_transport.connected()) fail(now);
+  }
+  if (_state == CONNECTING && now - _stateTime >= MQTT_CONNACK_TIMEOUT) fail(now);
+
+  // The batches are made even while disconnected, so that the readings wait in the window rather than being dropped
+  while (batchReady(now) && fillBatch(now));
+
+  bool waitingAnswer = _state == CONNECTING || _pingPending;
+  if (_state == CONNECTED)
+  {
+    for (int i = 0; i < MQTT_MAX_INFLIGHT && _state == CONNECTED; i++)
+    {
+      inflightBatch &b = _inflight[i];
+      if (!b.used) continue;
+      if (!b.sent) publish(b, false, now);
+      else if (now - b.sentTime >= MQTT_RETRY_TIME)
+      {
+        _stats.retransmitted++;
+        publish(b, true, now);
+      }
+      waitingAnswer = true;
+    }
+  }
+  if (_state == CONNECTED)
+  {
+    if (now - _lastReceive >= MQTT_KEEPALIVE * 1500UL) fail(now);  // The broker would have closed the connection too
+    else if (!_pingPending && now - _lastSend >= MQTT_KEEPALIVE * 750UL)
+    {
+      _packet[0] = MQTT_PINGREQ;
+      _packet[1] = 0;
+      if (sendPacket(2, now)) _pingPending = true;
+    }
+  }
+
+  uint32_t wait = MQTT_IDLE;
+  if (_state == DISCONNECTED) wait = remaining(_stateTime, _backoff, now);
+  else if (waitingAnswer) wait = MQTT_POLL_INTERVAL;
+  if (_state == CONNECTED)
+  {
+    uint32_t ping = remaining(_lastSend, MQTT_KEEPALIVE * 750UL, now);
+    if (ping < wait) wait = ping;
+  }
+  // With the window full the batch waits for a PUBACK, which is already polled for
+  bool slotFree = false;
+  for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) slotFree |= !_inflight[i].used;
+  if (_sampleCount && slotFree)
+  {
+    uint32_t batch = remaining(_batchStart, _settings.batchAge, now);
+    if (batch < wait) wait = batch;
+  }
+  return wait;
+}
+
+void MqttTelemetry::connectBroker(uint32_t now)
+{
+  if (!_transport.connect(_settings.host, _settings.port))
+  {
+    fail(now);
+    return;
+  }
+
+  uint8_t *body = _packet + 5;  // Room for the longest fixed header
+  size_t n = 0;
+  n += putString(body, "MQTT", 4);
+  body[n++] = 4;  // Protocol level of MQTT 3.1.1
+  body[n++] = MQTT_CLEAN_SESSION;
+  body[n++] = MQTT_KEEPALIVE >> 8;
+  body[n++] = MQTT_KEEPALIVE & 0xFF;
+  n += putString(body + n, _settings.clientId, MQTT_CLIENT_ID_SIZE);
+  size_t header = putHeader(_packet, MQTT_CONNECT, n);
+  memmove(_packet + header, body, n);
+
+  _state = CONNECTING;
+  _stateTime = now;
+  _rxStep = 0;
+  _pingPending = false;
+  _lastReceive = now;
+  // With a clean session the broker forgets the unacknowledged batches, they are published again
+  for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) _inflight[i].sent = false;
+  sendPacket(header + n, now);
+}
+
+// Drops the connection and waits before the next attempt, longer with each failure in a row
+void MqttTelemetry::fail(uint32_t now)
+{
+  _transport.stop();
+  _state = DISCONNECTED;
+  _stateTime = now;
+  _stats.connectFailures++;
+  _backoff = _retry.next();
+}
+
+bool MqttTelemetry::batchReady(uint32_t now) const
+{
+  return _sampleCount >= _settings.batchSamples || (_sampleCount > 0 && now - _batchStart >= _settings.batchAge);
+}
+
+// Moves the oldest readings into a free slot of the window, as many as fit the payload. Returns false if no slot is free
+bool MqttTelemetry::fillBatch(uint32_t now)
+{
+  inflightBatch *b = nullptr;
+  for (int i = 0; i < MQTT_MAX_INFLIGHT && !b; i++)
+    if (!_inflight[i].used) b = &_inflight[i];
+  if (!b) return false;
+
+  const char *end = "]}";
+  uint32_t t0 = _samples[_sampleFirst].time;
+  int length = snprintf(b->payload, MQTT_PAYLOAD_SIZE, "{\"t\":%u,\"s\":[", (unsigned)t0);
+  int taken = 0;
+  while (taken < _sampleCount)
+  {
+    const telemetrySample &s = _samples[(_sampleFirst + taken) % MQTT_BATCH_MAX_SAMPLES];
+    char item[40];
+    int n = snprintf(item, sizeof(item), "%s[%u,%u,%d]", taken ? "," : "", (unsigned)s.zone, (unsigned)(s.time - t0), (int)s.raw);
+    if (length + n + (int)strlen(end) >= MQTT_PAYLOAD_SIZE) break;
+    memcpy(b->payload + length, item, n);
+    length += n;
+    taken++;
+  }
+  memcpy(b->payload + length, end, strlen(end));
+  length += strlen(end);
+
+  b->used = true;
+  b->sent = false;
+  b->length = length;
+  b->packetId = _nextPacketId++;
+  if (_nextPacketId == 0) _nextPacketId = 1;  // 0 is not a valid packet id
+  _sampleFirst = (_sampleFirst + taken) % MQTT_BATCH_MAX_SAMPLES;
+  _sampleCount -= taken;
+  _batchStart = now;  // The readings left over are published with the next batch
+  return true;
+}
+
+void MqttTelemetry::publish(inflightBatch &batch, bool dup, uint32_t now)
+{
+  size_t topicLength = strlen(_settings.topic);
+  if (topicLength > MQTT_TOPIC_SIZE) topicLength = MQTT_TOPIC_SIZE;
+  size_t n = putHeader(_packet, MQTT_PUBLISH_QOS1 | (dup ? MQTT_PUBLISH_DUP : 0), 2 + topicLength + 2 + batch.length);
+  _packet[n++] = topicLength >> 8;
+  _packet[n++] = topicLength & 0xFF;
+  memcpy(_packet + n, _settings.topic, topicLength);
+  n += topicLength;
+  _packet[n++] = batch.packetId >> 8;
+  _packet[n++] = batch.packetId & 0xFF;
+  memcpy(_packet + n, batch.payload, batch.length);
+  n += batch.length;
+
+  if (!sendPacket(n, now)) return;
+  batch.sent = true;
+  batch.sentTime = now;
+  _stats.published++;
+}
+
+bool MqttTelemetry::sendPacket(size_t length, uint32_t now)
+{
+  if (_transport.write(_packet, length) != length)
+  {
+    fail(now);
+    return false;
+  }
+  _lastSend = now;
+  return true;
+}
+
+// Parses what the broker sent, byte by byte: fixed header, remaining length, then the body
+void MqttTelemetry::receive(uint32_t now)
+{
+  uint8_t data[32];
+  size_t count;
+  while (_state != DISCONNECTED && (count = _transport.read(data, sizeof(data))) > 0)
+  {
+    for (size_t i = 0; i < count && _state != DISCONNECTED; i++)
+    {
+      uint8_t c = data[i];
+      if (_rxStep == 0)
+      {
+        _rxHeader = c;
+        _rxRemaining = 0;
+        _rxMultiplier = 1;
+        _rxLength = 0;
+        _rxStep = 1;
+      }
+      else if (_rxStep == 1)
+      {
+        _rxRemaining += (c & 0x7F) * _rxMultiplier;
+        _rxMultiplier *= 128;
+        if (c & 0x80) continue;
+        if (_rxRemaining == 0) handlePacket(now);
+        else _rxStep = 2;
+      }
+      else
+      {
+        if (_rxLength < sizeof(_rxBody)) _rxBody[_rxLength++] = c;
+        if (--_rxRemaining == 0) handlePacket(now);
+      }
+    }
+  }
+}
+
+void MqttTelemetry::handlePacket(uint32_t now)
+{
+  _rxStep = 0;
+  _lastReceive = now;
+  switch (_rxHeader & 0xF0)
+  {
+    case MQTT_CONNACK:
+      if (_state != CONNECTING) break;
+      if (_rxLength < 2 || _rxBody[1] != 0)
+      {
+        fail(now);
+        break;
+      }
+      _state = CONNECTED;
+      _stateTime = now;
+      _retry.reset();
+      _stats.connects++;
+      break;
+
+    case MQTT_PUBACK:
+    {
+      if (_rxLength < 2) break;
+      uint16_t id = _rxBody[0] << 8 | _rxBody[1];
+      for (int i = 0; i < MQTT_MAX_INFLIGHT; i++)
+      {
+        if (!_inflight[i].used || _inflight[i].packetId != id) continue;
+        _inflight[i].used = false;
+        _stats.acked++;
+        break;
+      }
+      break;
+    }
+
+    case MQTT_PINGRESP:
+      _pingPending = false;
+      break;
+  }
+}
@@ -0,0 +1,77 @@
+#include "SampleFilter.h"
+
+// Median of the accepted readings in the window, sorted in a copy: at most FILTER_MAX_MEDIAN values
+static int16_t windowMedian(const sampleFilterState &state)
+{
+  int16_t sorted[FILTER_MAX_MEDIAN];
+  for (uint8_t i = 0; i < state.windowCount; i++)
+  {
+    int16_t value = state.window[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = value;
+  }
+  return sorted[(state.windowCount - 1) / 2];
+}
+
+uint8_t filterSample(sampleFilterState &state, const sampleFilterSettings &settings, uint32_t now, int16_t raw,
+                     int16_t &filtered)
+{
+  uint8_t result = FILTER_ACCEPTED;
+  int32_t change = state.windowCount ? (int32_t)raw - state.lastRaw : 0;
+  if (change < 0) change = -change;
+
+  if (raw == POWER_ON_RAW && (state.windowCount == 0 || change > FILTER_SLEW_MARGIN))
+    result = FILTER_REJECTED_POWER_ON;
+  else if (settings.maxSlew > 0 && state.windowCount)
+  {
+    int64_t allowed = FILTER_SLEW_MARGIN + (int64_t)settings.maxSlew * (uint32_t)(now - state.lastTime) / 60000;
+    if (change > allowed) result = FILTER_REJECTED_SLEW;
+  }
+
+  if (result != FILTER_ACCEPTED)
+  {
+    if (result == FILTER_REJECTED_POWER_ON || state.rejectsInRow < FILTER_MAX_REJECTS)
+    {
+      if (state.rejectsInRow < UINT8_MAX) state.rejectsInRow++;
+      if (result == FILTER_REJECTED_POWER_ON) state.rejectedPowerOn++;
+      else state.rejectedSlew++;
+      return result;
+    }
+    resetFilter(state);  // The readings agree with each other, not with the past ones
+    result = FILTER_ACCEPTED;
+  }
+
+  uint8_t length = settings.medianLength;
+  if (length < 1) length = 1;
+  if (length > FILTER_MAX_MEDIAN) length = FILTER_MAX_MEDIAN;
+  bool first = state.windowCount == 0;
+  if (state.windowCount > length) state.windowCount = length;
+  if (state.windowNext >= length) state.windowNext = 0;
+  state.window[state.windowNext] = raw;
+  state.windowNext = (state.windowNext + 1) % length;
+  if (state.windowCount < length) state.windowCount++;
+  state.lastRaw = raw;
+  state.lastTime = now;
+  state.rejectsInRow = 0;
+  state.accepted++;
+
+  int16_t median = windowMedian(state);
+  if (settings.emaShift == 0)
+  {
+    filtered = median;
+    return result;
+  }
+  if (first) state.emaSum = (int32_t)median << settings.emaShift;
+  else state.emaSum += median - (state.emaSum >> settings.emaShift);
+  filtered = (state.emaSum + (1 << (settings.emaShift - 1))) >> settings.emaShift;
+  return result;
+}
+
+void resetFilter(sampleFilterState &state)
+{
+  state.windowCount = 0;
+  state.windowNext = 0;
+  state.emaSum = 0;
+  state.rejectsInRow = 0;
+}
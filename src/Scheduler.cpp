@@ -0,0 +1,101 @@
+#include "Scheduler.h"
+
+int Scheduler::addJob(JobFunction *function)
+{
+  if (_jobCount >= SCHEDULER_MAX_JOBS) return -1;
+  job &j = _jobs[_jobCount];
+  j.function = function;
+  j.deadline = SCHEDULER_NEVER;
+  j.heapIndex = -1;
+  return _jobCount++;
+}
+
+void Scheduler::schedule(int jobId, uint64_t deadline)
+{
+  job &j = _jobs[jobId];
+  if (j.heapIndex < 0)
+  {
+    j.deadline = deadline;
+    place(_heapSize++, jobId);
+    siftUp(j.heapIndex);
+  }
+  else
+  {
+    bool earlier = deadline < j.deadline;
+    j.deadline = deadline;
+    if (earlier) siftUp(j.heapIndex);
+    else siftDown(j.heapIndex);
+  }
+}
+
+void Scheduler::scheduleNext(int jobId, uint64_t period, uint64_t now)
+{
+  uint64_t deadline = _jobs[jobId].deadline + period;
+  if (_jobs[jobId].deadline == SCHEDULER_NEVER || deadline <= now) deadline = now + period;
+  schedule(jobId, deadline);
+}
+
+void Scheduler::cancel(int jobId)
+{
+  if (_jobs[jobId].heapIndex >= 0) remove(_jobs[jobId].heapIndex);
+}
+
+int Scheduler::runDue(uint64_t now)
+{
+  int count = 0;
+  while (_heapSize && _jobs[_heap[0]].deadline <= now)
+  {
+    uint8_t jobId = _heap[0];
+    remove(0);
+    _jobs[jobId].function(jobId);
+    count++;
+  }
+  return count;
+}
+
+void Scheduler::place(uint8_t index, uint8_t jobId)
+{
+  _heap[index] = jobId;
+  _jobs[jobId].heapIndex = index;
+}
+
+void Scheduler::siftUp(uint8_t index)
+{
+  uint8_t jobId = _heap[index];
+  while (index > 0)
+  {
+    uint8_t parent = (index - 1) / 2;
+    if (_jobs[_heap[parent]].deadline <= _jobs[jobId].deadline) break;
+    place(index, _heap[parent]);
+    index = parent;
+  }
+  place(index, jobId);
+}
+
+void Scheduler::siftDown(uint8_t index)
+{
+  uint8_t jobId = _heap[index];
+  while (true)
+  {
+    uint8_t child = 2 * index + 1;
+    if (child >= _heapSize) break;
+    if (child + 1 < _heapSize && _jobs[_heap[child + 1]].deadline < _jobs[_heap[child]].deadline) child++;
+    if (_jobs[jobId].deadline <= _jobs[_heap[child]].deadline) break;
+    place(index, _heap[child]);
+    index = child;
+  }
+  place(index, jobId);
+}
+
+// Takes the entry at index out of the heap, the job keeps its deadline
+void Scheduler::remove(uint8_t index)
+{
+  uint8_t jobId = _heap[index];
+  _jobs[jobId].heapIndex = -1;
+  _heapSize--;
+  if (index == _heapSize) return;
+
+  place(index, _heap[_heapSize]);
+  if (index > 0 && _jobs[_heap[index]].deadline < _jobs[_heap[(index - 1) / 2]].deadline) siftUp(index);
+  else siftDown(index);
+}
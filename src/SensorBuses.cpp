@@ -0,0 +1,136 @@
+#include "SensorBuses.h"
+#include <string.h>
+
+int SensorBuses::addBus(DallasTemperature &sensors)
+{
+  if (_busCount >= MAX_BUSES) return -1;
+  busState &b = _buses[_busCount];
+  b.sensors = &sensors;
+  b.conversionStart = 0;
+  b.conversionTime = 0;
+  b.collected = true;
+  b.hasDs18s20 = false;
+  return _busCount++;
+}
+
+void SensorBuses::begin()
+{
+  _deviceCount = 0;
+  for (uint8_t i = 0; i < _busCount; i++)
+  {
+    DallasTemperature &sensors = *_buses[i].sensors;
+    sensors.begin();
+    sensors.setWaitForConversion(false);
+    _buses[i].hasDs18s20 = false;
+    for (uint8_t j = 0; j < sensors.getDeviceCount() && _deviceCount < MAX_BUS_DEVICES; j++)
+    {
+      sensorReading &r = _devices[_deviceCount];
+      if (!sensors.getAddress(r.address, j)) continue;
+      r.bus = i;
+      if (r.address[0] == DS18S20MODEL) _buses[i].hasDs18s20 = true;
+      r.raw = DEVICE_DISCONNECTED_RAW;
+      r.read = r.alarmed = r.watched = false;
+      _deviceCount++;
+    }
+  }
+}
+
+int SensorBuses::find(const uint8_t *address) const
+{
+  for (int i = 0; i < _deviceCount; i++)
+    if (memcmp(_devices[i].address, address, sizeof(DeviceAddress)) == 0) return i;
+  return -1;
+}
+
+DallasTemperature *SensorBuses::busOf(const uint8_t *address)
+{
+  int device = find(address);
+  return device < 0 ? nullptr : _buses[_devices[device].bus].sensors;
+}
+
+void SensorBuses::setResolution(uint8_t bits, bool save)
+{
+  for (uint8_t i = 0; i < _busCount; i++)
+  {
+    DallasTemperature &sensors = *_buses[i].sensors;
+    bool autoSave = sensors.getAutoSaveScratchPad();
+    sensors.setAutoSaveScratchPad(save);
+    sensors.setResolution(bits);
+    sensors.setAutoSaveScratchPad(autoSave);
+  }
+}
+
+int SensorBuses::configure(uint8_t bits, int8_t highAlarm, int8_t lowAlarm, bool save)
+{
+  int failed = 0;
+  for (uint8_t i = 0; i < _busCount; i++)
+  {
+    DallasTemperature &sensors = *_buses[i].sensors;
+    bool autoSave = sensors.getAutoSaveScratchPad();
+    sensors.setAutoSaveScratchPad(save);
+    failed += sensors.setConfigurationAll(bits, highAlarm, lowAlarm);
+    sensors.setAutoSaveScratchPad(autoSave);
+  }
+  return failed;
+}
+
+uint32_t SensorBuses::requestTemperatures(uint32_t now, bool alarmedOnly)
+{
+  _alarmedOnly = alarmedOnly;
+  for (uint8_t i = 0; i < _deviceCount; i++) _devices[i].read = _devices[i].alarmed = false;
+
+  uint32_t first = BUSES_COLLECTED;
+  for (uint8_t i = 0; i < _busCount; i++)
+  {
+    busState &b = _buses[i];
+    b.sensors->requestTemperatures();
+    b.conversionStart = now;
+    b.conversionTime = b.sensors->millisToWaitForConversion();
+    if (b.hasDs18s20) b.conversionTime = b.sensors->millisToWaitForConversion(12);
+    b.collected = false;
+    if (b.conversionTime < first) first = b.conversionTime;
+  }
+  return first;
+}
+
+uint32_t SensorBuses::collect(uint32_t now)
+{
+  uint32_t next = BUSES_COLLECTED;
+  for (uint8_t i = 0; i < _busCount; i++)
+  {
+    busState &b = _buses[i];
+    if (b.collected) continue;
+    uint32_t elapsed = now - b.conversionStart;
+    if (elapsed >= b.conversionTime) collectBus(i);
+    else if (b.conversionTime - elapsed < next) next = b.conversionTime - elapsed;
+  }
+  return next;
+}
+
+// Reads the devices of a bus whose conversion is over. When no device is in alarm the alarm search
+// ends after the first two bits
+void SensorBuses::collectBus(uint8_t busIndex)
+{
+  busState &b = _buses[busIndex];
+  b.collected = true;
+
+  if (_alarmedOnly)
+  {
+    DeviceAddress address;
+    b.sensors->resetAlarmSearch();
+    for (int n = 0; n < 2 * MAX_BUS_DEVICES && b.sensors->alarmSearch(address); n++)
+    {
+      int device = find(address);
+      if (device >= 0 && _devices[device].bus == busIndex) _devices[device].alarmed = true;
+    }
+  }
+
+  for (uint8_t i = 0; i < _deviceCount; i++)
+  {
+    sensorReading &r = _devices[i];
+    if (r.bus != busIndex || (_alarmedOnly && !r.watched && !r.alarmed)) continue;
+    if (_fastReadMaxJump) r.raw = b.sensors->getTempFast(r.address, r.raw, _fastReadMaxJump);
+    else r.raw = b.sensors->getTemp(r.address);
+    r.read = true;
+  }
+}
@@ -0,0 +1,43 @@
+#include "StatusLed.h"
+
+void LedSequencer::play(const ledPattern &pattern, uint32_t now)
+{
+  if (_pattern == &pattern) return;
+  _pattern = &pattern;
+  _step = 0;
+  startStep(now);
+}
+
+uint32_t LedSequencer::update(uint32_t now)
+{
+  if (_pattern == nullptr || _pattern->stepCount < 2) return LED_NO_CHANGE;
+
+  const ledStep *s = &_pattern->steps[_step];
+  if (s->repeat == 0) return LED_NO_CHANGE;
+
+  uint32_t duration = (uint32_t)s->repeat * (s->onTime + s->offTime);
+  if (duration == 0) return LED_NO_CHANGE;
+  // After a long pause whole cycles of the pattern are skipped instead of replayed
+  uint32_t cycle = 0;
+  for (int i = 0; i < _pattern->stepCount; i++)
+    cycle += (uint32_t)_pattern->steps[i].repeat * (_pattern->steps[i].onTime + _pattern->steps[i].offTime);
+  if (now - _stepStart >= cycle + duration) _stepStart += (now - _stepStart - duration) / cycle * cycle;
+
+  // Steps are chained on their planned end, so a late update() doesn't stretch the pattern
+  while (now - _stepStart >= duration)
+  {
+    _step = (_step + 1) % _pattern->stepCount;
+    startStep(_stepStart + duration);
+    s = &_pattern->steps[_step];
+    duration = (uint32_t)s->repeat * (s->onTime + s->offTime);
+    if (duration == 0) return LED_NO_CHANGE;
+  }
+  return duration - (now - _stepStart);
+}
+
+void LedSequencer::startStep(uint32_t now)
+{
+  const ledStep &s = _pattern->steps[_step];
+  _hal.blink(s.color, s.onTime, s.offTime);
+  _stepStart = now;
+}
@@ -0,0 +1,235 @@
+#include <string.h>
+#include "TempHistory.h"
+
+#define TAG_RUN 0
+#define TAG_COARSE_DELTA 1
+#define TAG_FINE_DELTA 2
+#define TAG_STEP 3
+#define COARSE_UNIT 8              // 1/16 °C in raw units
+#define MAX_TOKEN_SIZE 5           // A 32 bit varint
+#define MAX_RUN (1UL << 29)        // Longest run that fits in a token
+#define BLOCK_HEADER_SIZE (sizeof(historyBlock) - sizeof(((historyBlock *)0)->data))
+
+static inline uint32_t zigzag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+static inline int32_t unzigzag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+TempHistory::TempHistory()
+{
+  clear();
+}
+
+void TempHistory::clear()
+{
+  memset(_blocks, 0, sizeof(_blocks));
+  memset(_writers, 0, sizeof(_writers));
+  for (int i = 0; i < HISTORY_MAX_ZONES; i++) _writers[i].block = -1;
+  _nextBlock = 0;
+}
+
+void TempHistory::append(uint8_t zone, uint32_t time, int16_t raw)
+{
+  if (zone >= HISTORY_MAX_ZONES) return;
+  zoneWriter &w = _writers[zone];
+
+  if (w.block < 0)
+  {
+    startBlock(zone, time, raw);
+    return;
+  }
+
+  // A sample close enough to the expected time is stored as "one step later", so the jitter of
+  // loop() doesn't cost a step change on every sample
+  uint32_t expected = w.lastTime + w.step;
+  int32_t late = (int32_t)(time - expected);
+  bool stepChange = w.step == 0 || late > HISTORY_TIME_TOLERANCE || late < -HISTORY_TIME_TOLERANCE;
+  uint32_t newStep = time > w.lastTime ? time - w.lastTime : 0;
+
+  if (!stepChange && raw == w.lastValue && w.pendingRun < MAX_RUN)
+  {
+    w.pendingRun++;
+    w.lastTime = expected;
+    return;
+  }
+
+  historyBlock &b = _blocks[w.block];
+  // Room for run + step + delta, plus the run that may follow. A step that doesn't fit the header starts a new block too
+  if (b.length + 4 * MAX_TOKEN_SIZE > (int)sizeof(b.data) || (stepChange && newStep > 0xFFFF))
+  {
+    flushRun(w);
+    if (stepChange && newStep <= 0xFFFF) w.step = newStep;
+    startBlock(zone, time, raw);
+    return;
+  }
+
+  flushRun(w);
+  if (stepChange)
+  {
+    writeToken(b, newStep, TAG_STEP);
+    w.step = newStep;
+    w.lastTime = time;
+  }
+  else w.lastTime = expected;
+
+  int32_t delta = (int32_t)raw - w.lastValue;
+  if (delta % COARSE_UNIT == 0) writeToken(b, zigzag(delta / COARSE_UNIT), TAG_COARSE_DELTA);
+  else writeToken(b, zigzag(delta), TAG_FINE_DELTA);
+  w.lastValue = raw;
+}
+
+// Takes the oldest block of the pool for the zone, the first sample goes in the header
+void TempHistory::startBlock(uint8_t zone, uint32_t time, int16_t raw)
+{
+  uint16_t index = _nextBlock;
+  _nextBlock = (_nextBlock + 1) % HISTORY_BLOCK_COUNT;
+
+  // The zone still writing to the reused block has lost its tail, it will start over
+  for (int i = 0; i < HISTORY_MAX_ZONES; i++)
+  {
+    if (_writers[i].block == index)
+    {
+      _writers[i].block = -1;
+      _writers[i].pendingRun = 0;
+    }
+  }
+
+  zoneWriter &w = _writers[zone];
+  historyBlock &b = _blocks[index];
+  b.zone = zone;
+  b.used = 1;
+  b.length = 0;
+  b.startTime = time;
+  b.startValue = raw;
+  b.step = w.step;
+
+  w.block = index;
+  w.lastValue = raw;
+  w.lastTime = time;
+  w.pendingRun = 0;
+}
+
+void TempHistory::writeToken(historyBlock &block, uint32_t value, uint8_t tag)
+{
+  uint32_t token = (value << 2) | tag;
+  while (token >= 0x80)
+  {
+    block.data[block.length++] = (token & 0x7F) | 0x80;
+    token >>= 7;
+  }
+  block.data[block.length++] = token;
+}
+
+void TempHistory::flushRun(zoneWriter &writer)
+{
+  if (writer.pendingRun == 0) return;
+  writeToken(_blocks[writer.block], writer.pendingRun, TAG_RUN);
+  writer.pendingRun = 0;
+}
+
+uint32_t TempHistory::read(uint8_t zone, uint32_t from, uint32_t to, SampleHandler *handler, void *context) const
+{
+  if (zone >= HISTORY_MAX_ZONES) return 0;
+
+  uint32_t count = 0;
+  // Blocks are reused in order, so starting from the next one to be reused gives the oldest first
+  for (int i = 0; i < HISTORY_BLOCK_COUNT; i++)
+  {
+    int index = (_nextBlock + i) % HISTORY_BLOCK_COUNT;
+    const historyBlock &b = _blocks[index];
+    if (!b.used || b.zone != zone) continue;
+    if (b.startTime > to) break;
+    uint32_t pendingRun = _writers[zone].block == index ? _writers[zone].pendingRun : 0;
+    count += decode(b, pendingRun, from, to, handler, context);
+  }
+  return count;
+}
+
+uint32_t TempHistory::decode(const historyBlock &block, uint32_t pendingRun, uint32_t from, uint32_t to,
+                             SampleHandler *handler, void *context) const
+{
+  uint32_t time = block.startTime;
+  int32_t value = block.startValue;
+  uint32_t step = block.step;
+  uint32_t count = 0;
+  uint16_t pos = 0;
+
+  // Emits a sample, returns false once past the end of the range
+  auto emit = [&]() -> bool {
+    if (time > to) return false;
+    if (time >= from)
+    {
+      if (handler) handler(block.zone, time, (int16_t)value, context);
+      count++;
+    }
+    return true;
+  };
+  // Emits n samples equal to the last one, skipping the ones before the range without looping on them
+  auto emitRun = [&](uint32_t n) -> bool {
+    if (step > 0 && time < from)
+    {
+      uint32_t skip = (from - time - 1) / step;
+      if (skip > n) skip = n;
+      time += skip * step;
+      n -= skip;
+    }
+    while (n--)
+    {
+      time += step;
+      if (!emit()) return false;
+    }
+    return true;
+  };
+
+  if (!emit()) return count;
+
+  while (pos < block.length)
+  {
+    uint32_t token = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do
+    {
+      byte = block.data[pos++];
+      token |= (uint32_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while ((byte & 0x80) && pos < block.length);
+
+    uint32_t arg = token >> 2;
+    switch (token & 3)
+    {
+      case TAG_RUN:
+        if (!emitRun(arg)) return count;
+        break;
+      case TAG_COARSE_DELTA:
+        time += step;
+        value += unzigzag(arg) * COARSE_UNIT;
+        if (!emit()) return count;
+        break;
+      case TAG_FINE_DELTA:
+        time += step;
+        value += unzigzag(arg);
+        if (!emit()) return count;
+        break;
+      case TAG_STEP:
+        step = arg;
+        break;
+    }
+  }
+
+  emitRun(pendingRun);
+  return count;
+}
+
+uint32_t TempHistory::sampleCount(uint8_t zone) const
+{
+  return read(zone, 0, UINT32_MAX, nullptr, nullptr);
+}
+
+size_t TempHistory::bytesUsed() const
+{
+  size_t bytes = 0;
+  for (int i = 0; i < HISTORY_BLOCK_COUNT; i++)
+  {
+    if (_blocks[i].used) bytes += BLOCK_HEADER_SIZE + _blocks[i].length;
+  }
+  return bytes;
+}
@@ -0,0 +1,58 @@
+#include "WiFiReconnect.h"
+
+WiFiReconnect::WiFiReconnect(WiFiLink &link, uint32_t seed)
+  : _link(link), _retry(WIFI_BACKOFF_MIN, WIFI_BACKOFF_MAX, seed)
+{
+}
+
+void WiFiReconnect::reconnect(uint32_t now)
+{
+  _link.disconnect();
+  _retry.reset();
+  attempt(now);
+}
+
+uint32_t WiFiReconnect::poll(uint32_t now)
+{
+  bool up = _link.connected();
+  if (_state == LINK_UP && !up)
+  {
+    _stats.linkLosses++;
+    _retry.reset();
+    attempt(now);
+  }
+  else if (_state != LINK_UP && up)
+  {
+    _retry.reset();
+    setState(LINK_UP, now);
+  }
+  else if (_state == LINK_CONNECTING && now - _stateTime >= WIFI_CONNECT_TIMEOUT)
+  {
+    // Dropped so that the driver stops trying on its own, the wait doubles with each failure in a row
+    _link.disconnect();
+    _stats.failures++;
+    _backoff = _retry.next();
+    setState(LINK_WAITING, now);
+  }
+  else if (_state == LINK_WAITING && now - _stateTime >= _backoff) attempt(now);
+
+  // The link is checked every WIFI_CHECK_INTERVAL whatever the state, it can come back by itself
+  uint32_t wait = WIFI_CHECK_INTERVAL;
+  uint32_t elapsed = now - _stateTime;
+  if (_state == LINK_CONNECTING && WIFI_CONNECT_TIMEOUT - elapsed < wait) wait = WIFI_CONNECT_TIMEOUT - elapsed;
+  if (_state == LINK_WAITING && _backoff - elapsed < wait) wait = _backoff - elapsed;
+  return wait;
+}
+
+void WiFiReconnect::attempt(uint32_t now)
+{
+  _stats.attempts++;
+  _link.begin();
+  setState(LINK_CONNECTING, now);
+}
+
+void WiFiReconnect::setState(uint8_t state, uint32_t now)
+{
+  _state = state;
+  _stateTime = now;
+}
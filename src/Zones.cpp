@@ -0,0 +1,194 @@
+#include "Zones.h"
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+int mapZones(const SensorBuses &buses, deviceConfig &cfg, zone *zones, bool &configChanged)
+{
+  int zoneCount = 0;
+  for (int i = 0; i < buses.deviceCount() && zoneCount < MAX_ZONES; i++)
+  {
+    zone &z = zones[zoneCount];
+    z = zone();
+    memcpy(z.config.address, buses.reading(i).address, sizeof(DeviceAddress));
+    z.device = i;
+    for (int slot = 0; slot < MAX_ZONES; slot++)
+    {
+      if (cfg.zoneSlotUsed[slot] && memcmp(cfg.zones[slot].address, z.config.address, sizeof(DeviceAddress)) == 0)
+      {
+        z.config = cfg.zones[slot];
+        z.nvsSlot = slot;
+        break;
+      }
+    }
+    zoneCount++;
+  }
+
+  if (zoneCount == 0)
+  {
+    zones[0] = zone();
+    memset(zones[0].config.address, 0, sizeof(DeviceAddress));
+    zoneCount = 1;
+  }
+
+  for (int i = 0; i < zoneCount; i++)
+  {
+    zone &z = zones[i];
+    if (z.nvsSlot >= 0) continue;
+    snprintf(z.config.name, ZONE_NAME_SIZE, "Zone %d", i + 1);
+    z.config.preAlarmTemperature = cfg.alarms.preAlarmTemperature;
+    z.config.alarmTemperature = cfg.alarms.alarmTemperature;
+    // Takes a free slot, or the slot of a sensor which is no longer on the bus
+    for (int slot = 0; slot < MAX_ZONES && z.nvsSlot < 0; slot++)
+    {
+      bool taken = false;
+      for (int j = 0; j < zoneCount; j++) if (zones[j].nvsSlot == slot) taken = true;
+      if (!taken) z.nvsSlot = slot;
+    }
+    if (z.device >= 0)
+    {
+      cfg.zones[z.nvsSlot] = z.config;
+      cfg.zoneSlotUsed[z.nvsSlot] = true;
+      configChanged = true;
+    }
+  }
+
+  // The sensor alarm registers are programmed by configureSensors()
+  for (int i = 0; i < zoneCount; i++) setZoneThresholds(zones[i], cfg.alarms.alarmResetThreshold);
+  return zoneCount;
+}
+
+// The alarms behave as with the float comparisons. The reset levels are kept under their thresholds, as alarmStep()
+// expects
+void setZoneThresholds(zone &z, float resetThreshold)
+{
+  alarmThresholds &t = z.thresholds;
+  t.preAlarm = celsiusToRawCeil(z.config.preAlarmTemperature);
+  t.alarm = celsiusToRawCeil(z.config.alarmTemperature);
+  t.preAlarmReset = celsiusToRawFloor(z.config.preAlarmTemperature - resetThreshold);
+  t.alarmReset = celsiusToRawFloor(z.config.alarmTemperature - resetThreshold);
+  if (t.preAlarmReset >= t.preAlarm) t.preAlarmReset = t.preAlarm - 1;
+  if (t.alarmReset >= t.alarm) t.alarmReset = t.alarm - 1;
+}
+
+int8_t sensorHighAlarm(const zone &z)
+{
+  int highAlarm = floorf(z.config.preAlarmTemperature - SAMPLING_FAR_MARGIN / 128.0f);
+  return highAlarm < -55 ? -55 : highAlarm > 125 ? 125 : highAlarm;
+}
+
+// TH is SAMPLING_FAR_MARGIN under the pre alarm threshold, in whole degrees, so a zone is read as soon as it gets
+// close enough for the adaptive sampling to leave SAMPLING_SLOW, not only when it is about to reach the threshold.
+// TL is left at the bottom of the range
+void programSensorAlarm(SensorBuses &buses, const zone &z)
+{
+  if (z.device < 0) return;
+  DallasTemperature &bus = buses.bus(buses.reading(z.device).bus);
+  bus.setHighAlarmTemp(z.config.address, sensorHighAlarm(z));
+  bus.setLowAlarmTemp(z.config.address, -55);
+}
+
+// True when every sensor found belongs to a zone and all the zones have the same TH, returned in highAlarm
+static bool uniformSensorAlarm(const SensorBuses &buses, const zone *zones, int zoneCount, int8_t &highAlarm)
+{
+  int zonesWithSensor = 0;
+  for (int i = 0; i < zoneCount; i++)
+  {
+    if (zones[i].device < 0) continue;
+    if (zonesWithSensor++ == 0) highAlarm = sensorHighAlarm(zones[i]);
+    else if (sensorHighAlarm(zones[i]) != highAlarm) return false;
+  }
+  return zonesWithSensor > 0 && zonesWithSensor == buses.deviceCount();
+}
+
+// When all the zones share the same TH a single broadcast write per bus does both (see SensorBuses::configure()),
+// otherwise every sensor is written on its own
+int configureSensors(SensorBuses &buses, const zone *zones, int zoneCount, uint8_t bits, bool save)
+{
+  int8_t highAlarm;
+  if (uniformSensorAlarm(buses, zones, zoneCount, highAlarm)) return buses.configure(bits, highAlarm, -55, save);
+  buses.setResolution(bits, save);
+  if (save)
+    for (int i = 0; i < zoneCount; i++) programSensorAlarm(buses, zones[i]);
+  return 0;
+}
+
+// A zone that is not idle, whose sensor has failed or that the adaptive sampling follows closely is read even if
+// the sensor stays quiet: its rate of change needs every reading
+void watchZones(SensorBuses &buses, const zone *zones, int zoneCount)
+{
+  for (int i = 0; i < zoneCount; i++)
+  {
+    const zone &z = zones[i];
+    if (z.device >= 0) buses.setWatched(z.device, z.alarm.status != IDLE || z.alarm.failedReadings > 0 || z.samplingLevel != SAMPLING_SLOW);
+  }
+}
+
+uint8_t readZones(const SensorBuses &buses, zone *zones, int zoneCount, const zoneSettings &settings, uint32_t now,
+                  ZoneListener &listener)
+{
+  uint8_t actions = 0;
+
+  for (int i = 0; i < zoneCount; i++)
+  {
+    zone &z = zones[i];
+    int16_t raw = DEVICE_DISCONNECTED_RAW;
+    if (z.device >= 0)
+    {
+      const sensorReading &r = buses.reading(z.device);
+      // A quiet sensor of an idle zone is below TH, so below the pre alarm threshold: there is nothing to evaluate.
+      // Nothing is recorded either, the history and the telemetry only hold real readings and the last one still holds
+      if (!r.read)
+      {
+        listener.zoneRead(i, ZONE_NOT_READ, r.raw, 0);
+        continue;
+      }
+      raw = r.raw;
+    }
+    int16_t previousRaw = z.tempRaw;
+    uint32_t previousTime = z.readingTime;
+    uint8_t result = ZONE_FAILED;
+    if (raw != DEVICE_DISCONNECTED_RAW)
+    {
+      int16_t filtered;
+      // A rejected reading counts as a failed one, so a sensor whose readings keep being rejected ends in SENSOR_FAILURE
+      result = filterSample(z.filter, settings.filter, now, raw, filtered) == FILTER_ACCEPTED ? ZONE_READ : ZONE_REJECTED;
+      if (result == ZONE_READ)
+      {
+        z.tempRaw = filtered;
+        z.readingTime = now;
+      }
+    }
+    bool valid = result == ZONE_READ;
+    uint8_t zoneActions = alarmStep(z.alarm, z.thresholds, settings.alarm, now, valid, z.tempRaw);
+    uint32_t elapsed = valid && previousRaw != DEVICE_DISCONNECTED_RAW ? z.readingTime - previousTime : 0;
+    z.samplingLevel = samplingLevelFor(z.alarm.status, z.tempRaw, previousRaw, elapsed, z.thresholds);
+    listener.zoneRead(i, result, raw, zoneActions);
+    actions |= zoneActions;
+  }
+  return actions;
+}
+
+// Zones skipped by readZones() keep the level of their last reading
+uint8_t nextSamplingLevel(uint8_t level, uint8_t &holdCount, const zone *zones, int zoneCount)
+{
+  uint8_t wanted = SAMPLING_SLOW;
+  for (int i = 0; i < zoneCount; i++)
+    if (zones[i].samplingLevel > wanted) wanted = zones[i].samplingLevel;
+
+  if (wanted > level || (wanted < level && ++holdCount >= SAMPLING_HOLD_CYCLES))
+  {
+    holdCount = 0;
+    return wanted > level ? wanted : level - 1;
+  }
+  if (wanted == level) holdCount = 0;
+  return level;
+}
+
+uint8_t worstZoneStatus(const zone *zones, int zoneCount)
+{
+  uint8_t worst = IDLE;
+  for (int i = 0; i < zoneCount; i++)
+    if (zones[i].alarm.status > worst) worst = zones[i].alarm.status;
+  return worst;
+}
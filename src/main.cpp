@@ -21,37 +21,51 @@ Source code, license and documentation are availble at: https://github.com/mattV
 */
 
 #include <Arduino.h>
-#include <Preferences.h>
 #include <WiFi.h>
 #include "esp_wpa2.h"
 #include <OneWireNG.h>
 #include <DallasTemperature.h>
 #include <ESP_Mail_Client.h>
+#include "SPSCQueue.h"
+#include "DeviceConfig.h"
+#include "TempHistory.h"
+#include "AlarmEngine.h"
+#include "StatusLed.h"
+#include "LedcLed.h"
+#include "Scheduler.h"
+#include "SensorBuses.h"
+#include "AdaptiveSampling.h"
+#include "SampleFilter.h"
+#include "Metrics.h"
+#include "TripleBuffer.h"
+#include "MqttTelemetry.h"
+#include "LineEditor.h"
+#include "ConfigKeys.h"
+#include "WiFiReconnect.h"
+#include "Zones.h"
+#include "lwip/sockets.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+#include "esp_timer.h"
 
 
 //#define DEBUG
 //#define NO_MAIL
 //#define CONFIG_ON_STARTUP
+//#define FAST_READ  // Reads only the temperature bytes of the scratchpad, see getTempFast()
+//#define FIXED_SAMPLING  // Samples every mesurementInterval at 9 bits instead of adapting to the zones
+//#define MQTT_TELEMETRY  // Publishes every reading to MQTT_BROKER in batches, see MqttTelemetry.h
 
 #define ONE_WIRE_BUS 15
+//#define ONE_WIRE_BUS_2 16  // Second chain of sensors, more chains can be added in setup()
 const int ledBluePin = 18;
 const int ledGreenPin = 19;
 const int ledRedPin = 21;
 const int buttonPin = 4;
 
-enum system_status{IDLE, PRE_ALARM, ALARM, SENSOR_FAILURE, CONFIG};
-
-int status = IDLE; // System status IDLE/PRE_ALARM/ALARM/SENSOR_FAILURE/CONFIG
-int previousStatus = IDLE;  // System status at the end of the previous loop
-int tempReadingErrotCnt = 0; // Counts how many consecutive temperature reading errors happend
-unsigned long lastFailureEmailTime;   // Last time (millis) a failure email was sent
-unsigned long lastAlarmEmailTime;   // Last time (millis) an alarm email was sent
+int status = IDLE; // System status IDLE/PRE_ALARM/ALARM/SENSOR_FAILURE/CONFIG, the worst status among the zones. Only loop() writes it
 #define BUTTON_TIME_CONFIG 30 // Time to hold the button pressed to enable the configuration interface
-bool isPressed = false;
-int buttonCnt = 0;
-int buttonState;
-#define SERIAL_BUFFER_SIZE 64
-#define WIFI_SSID_SIZE 32
 #define MODE_CLEAR_TEXT 0
 #define MODE_PASSWORD 1
 
@@ -62,169 +76,356 @@ int buttonState;
 ### USE PREFERENCES IN SETUP ####
 #################################
 */
-// WiFi CONFIGURATION
-char *ssid;           // WiFi ssid
-char *passwd;         // WiFi password. Leave empty if using WPA2 enterprise
-
-char *EAP_ID;       // Enterprise WiFi credentials. Leave empty when not using WPA2 Enterprise
-char *EAP_USERNAME; // Enterprise WiFi credentials. Leave empty when not using WPA2 Enterprise
-char *EAP_PASSWORD; // Enterprise WiFi credentials. Leave empty when not using WPA2 Enterprise
-
-// TEMPERATURE CONFIGURATION
-float preAlarmTemperature; // Temperature above wich the pre alarm is triggered
-float alarmTemperature;     // Temperature above wich the alarm sends a notify via email
-float alarmResetThreshold; // Temperature threshold subtracted to the pre alarm threshold under which the alarm is reactivated
+// The configuration is kept in RAM in "config", see DeviceConfig.h
+// Time intervals converted from the configuration at startup
 unsigned long mesurementInterval;  // Time intervall (milliseconds) beetween mesurements
 unsigned long alarmEmailInterval;  // Time intervall (milliseconds) beetween each alarm email
-
-bool firstTempAlarm = true;  // Flag which is true until a temperature alarm is triggered
-bool firstSensorAlarm = true;  // Flag which is true until any sensor failure alarm is triggered
-
 unsigned long imAliveIntervall;  // Time intervall (milliseconds) beetween each "I'm alive" email
-unsigned long lastImAliveEmail = 0;   //  The last time (millis) an "I'm alive" email was sent
 /*
 #############################
 ##### CONFIGURATION END #####
 #############################
 */
 
-Preferences userSettings;
-
 hw_timer_t *buttonTimer = NULL;
-hw_timer_t *blinkerTimer = NULL;
 
-// Timer ISR to debounce the config button
+/*SCHEDULING*/
+// loop() runs the jobs whose deadline has passed and then sleeps until the next one, or until an ISR,
+// the serial port or the LED sequencer needs it
+Scheduler scheduler;
+int mesureJob;  // Starts a conversion every samplingPeriod
+int collectJob;  // Reads the sensors once the conversion is over
+int imAliveJob;  // Queues the "I'm alive" email every imAliveIntervall
+int wifiCheckJob;  // Follows the WiFi link, see WiFiReconnect.h
+int historyJob;  // Prints the readings asked by the history command, a chunk at a time
+#define LOOP_MAX_SLEEP 10000  // Longest wait of loop() (milliseconds), keeps the tick count in range
+TaskHandle_t loopTaskHandle = NULL;
+uint64_t loopBusyTime = 0;  // Time (microseconds) loop() was awake since the last report
+uint64_t loopStatsStart = 0;  // Time (microseconds) of the last report
+uint64_t nowMs();
+void wakeLoop();
+void waitForEvents(uint64_t deadline);
+void runMesurement(int job);
+void collectMesurement(int job);
+void sendImAlive(int job);
+void checkWiFi(int job);
+void printHistory(int job);
+
+// Events posted by the ISRs, loop() is the only consumer
+enum isr_event : uint8_t {BUTTON_LONG_PRESS};
+SPSCQueue<uint8_t, 4> isrEvents;  // onTimer() -> loop()
+void handleIsrEvents();
+
+// Timer ISR to debounce the config button. Its state is private, loop() learns about the press from isrEvents
 void IRAM_ATTR onTimer() 
 {
+  static bool isPressed = false;
+  static int buttonCnt = 0;
+
   if (!isPressed) {
-    buttonState = digitalRead(buttonPin);
-    if (!buttonState) buttonCnt++;
+    if (!digitalRead(buttonPin)) buttonCnt++;
     else 
     {
       buttonCnt = 0;
       return;
     }
     if (buttonCnt >= BUTTON_TIME_CONFIG) {
-      status = CONFIG;
+      isrEvents.push(BUTTON_LONG_PRESS);
       isPressed = !isPressed;
+      BaseType_t woken = pdFALSE;
+      if (loopTaskHandle) vTaskNotifyGiveFromISR(loopTaskHandle, &woken);
+      if (woken) portYIELD_FROM_ISR();
     }
   }
 }
 
-bool blinkerState = false;
-int RGB_LEDCode = 0;
-int interruptCnt = 0;
-int timeOn = 20;
-int timeOff = 1000;
-
-// Timer ISR to blink the RGB LED
-void IRAM_ATTR RGBtimerBlinker()
-{
-  interruptCnt++;
-  if (blinkerState)
-  {
-    if (interruptCnt >= timeOn)
-    {
-      blinkerState = !blinkerState;
-      digitalWrite(ledRedPin, LOW);
-      digitalWrite(ledGreenPin, LOW);
-      digitalWrite(ledBluePin, LOW);
-      interruptCnt = 0;
-    }
-  }
-  else
-  {
-    if (interruptCnt >= timeOff)
-    {
-
-      blinkerState = !blinkerState;
-
-      /*
-   The different colors available are coded as octal values, indicating which of the three LEDs are turned on.
-   Example:
-     0 = 000 => All three LEDs are off
-     1 = 001 => Only the blue LED is on
-     2 = 010 => Only the green LED is on
-     3 = 011 => Green and blue LEDs are on, resulting in aqua colored light
-     ...
-   */
-      switch (RGB_LEDCode)
-      {
-      case 0:
-        digitalWrite(ledRedPin, LOW);
-        digitalWrite(ledGreenPin, LOW);
-        digitalWrite(ledBluePin, LOW);
-        break;
-      case 1:
-        digitalWrite(ledRedPin, LOW);
-        digitalWrite(ledGreenPin, LOW);
-        digitalWrite(ledBluePin, HIGH);
-        break;
-      case 2:
-        digitalWrite(ledRedPin, LOW);
-        digitalWrite(ledGreenPin, HIGH);
-        digitalWrite(ledBluePin, LOW);
-        break;
-      case 3:
-        digitalWrite(ledRedPin, LOW);
-        digitalWrite(ledGreenPin, HIGH);
-        digitalWrite(ledBluePin, HIGH);
-        break;
-      case 4:
-        digitalWrite(ledRedPin, HIGH);
-        digitalWrite(ledGreenPin, LOW);
-        digitalWrite(ledBluePin, LOW);
-        break;
-      case 5:
-        digitalWrite(ledRedPin, HIGH);
-        digitalWrite(ledGreenPin, LOW);
-        digitalWrite(ledBluePin, HIGH);
-        break;
-      case 6:
-        digitalWrite(ledRedPin, HIGH);
-        digitalWrite(ledGreenPin, HIGH);
-        digitalWrite(ledBluePin, LOW);
-        break;
-      case 7:
-        digitalWrite(ledRedPin, HIGH);
-        digitalWrite(ledGreenPin, HIGH);
-        digitalWrite(ledBluePin, HIGH);
-        break;
-      default:
-        break;
-      }
-      
-      interruptCnt = 0;
-    }
-  }
-}
+// The LED blinks on the LEDC peripheral, the CPU only changes pattern
+LedcLed ledHardware(ledRedPin, ledGreenPin, ledBluePin);
+LedSequencer statusLed(ledHardware);
+
+// One blink pattern per system status, indexed by system_status
+const ledStep idleSteps[] = {{LED_GREEN, 50, 950, 0}};
+const ledStep preAlarmSteps[] = {{LED_YELLOW, 50, 950, 0}};
+const ledStep alarmSteps[] = {{LED_RED, 50, 950, 0}};
+const ledStep sensorFailureSteps[] = {{LED_RED, 50, 250, 0}};
+const ledStep configSteps[] = {{LED_BLUE, 50, 950, 0}};
+const ledPattern statusPatterns[] = {
+  {idleSteps, 1},
+  {preAlarmSteps, 1},
+  {alarmSteps, 1},
+  {sensorFailureSteps, 1},
+  {configSteps, 1},
+};
+// Fast blinking blue LED until start of the main loop
+const ledStep bootSteps[] = {{LED_BLUE, 50, 30, 0}};
+const ledPattern bootPattern = {bootSteps, 1};
 
 void printConfig(int mode);
 unsigned long TimeDiff(unsigned long lastTime, unsigned long currTime);
-int getStringFromSerial(char *serialBuffer, String prompt, int mode);
 String strToAst(String inputString);  // Converts input string as a string of asterisks, leaving clear only the first and the last charaters
-void serialConfiguration();
 void connectToWiFi();
 
 /*TEMPERATURE SENSOR STUFF AND FUNCTIONS*/
 OneWire oneWire(ONE_WIRE_BUS);
 DallasTemperature sensors(&oneWire);
-DeviceAddress rackThermometer;
-float tempC;
-unsigned long lastMesurementTime = 0;
-int getTemperature(float &tempVar);
+#ifdef ONE_WIRE_BUS_2
+OneWire oneWire2(ONE_WIRE_BUS_2);
+DallasTemperature sensors2(&oneWire2);
+#endif
+SensorBuses buses;  // The sensors of all the chains, converting together
+#define FAST_READ_MAX_JUMP 256  // Largest change (1/128 °C) between two readings accepted without a CRC check: 2 °C
+unsigned int mesurementCount = 0;  // Every FULL_READ_CYCLES mesurements all the sensors are read, see Zones.h
+// Unless FIXED_SAMPLING is defined the sampling interval and resolution follow the zone that needs them most,
+// see AdaptiveSampling.h. A faster level is taken at once, a slower one after SAMPLING_HOLD_CYCLES mesurements
+uint8_t samplingLevel = SAMPLING_NORMAL;
+uint8_t samplingHoldCount = 0;
+unsigned long samplingPeriod;  // Time (milliseconds) between mesurements at the current sampling level
+
+// The notify interval of the alarms is set in setup() from the configuration
+zoneSettings zoneRules = {{SENSOR_FAILURE_READINGS, 0}, {FILTER_MEDIAN_LENGTH, FILTER_EMA_SHIFT, FILTER_MAX_SLEW}};
+
+// The zones are kept by Zones.cpp, this side logs them, records their readings and sends their emails
+zone zones[MAX_ZONES];
+int zoneCount = 0;
+class ZoneLog : public ZoneListener
+{
+public:
+  void zoneRead(int zoneIndex, uint8_t result, int16_t raw, uint8_t actions) override;
+};
+ZoneLog zoneLog;
+void initZones();
+void configureZoneSensors(uint8_t bits, bool save);
+void recordReading(int zoneIndex);
+void notifyZone(zone &z, uint8_t actions);
+void setSamplingLevel(uint8_t level);
+void setStatusLED(int systemStatus);
+String addressToString(const uint8_t *address);
+TempHistory tempHistory;  // Readings of every zone since startup, oldest ones are overwritten when full
+uint32_t uptimeSeconds();
+
+/*SERIAL COMMANDS*/
+// Commands accepted on the serial port outside the configuration console. The upper case ones read and write
+// the configuration by key (see ConfigKeys.h) so that a script can provision a device. Their replies are
+// framed to be told apart from the log lines: zero or more "$ <key> <value>" lines, then "$<status> <name>"
+#define COMMAND_BUFFER_SIZE 128  // "SET <key> <value>" with the longest key and value
+char commandBuffer[COMMAND_BUFFER_SIZE + 1];  // Command being typed on the serial port
+int commandLength = 0;  // COMMAND_BUFFER_SIZE + 1 once the line is too long
+deviceConfig pendingConfig;  // Configuration with the values SET since the last COMMIT
+bool configPending = false;
+void readSerialCommand();
+void runSerialCommand(char *command);
+void replyValue(const char *key, const char *value);
+void replyEnd(config_status result);
+config_status findKey(deviceConfig &cfg, const char *name, const configKey *&key, void *&base);
+deviceConfig &shownConfig();
+// The history of a zone can hold thousands of readings: they are printed as much as the serial transmit
+// buffer takes without waiting, the rest by historyJob HISTORY_PRINT_INTERVAL later
+#define HISTORY_PRINT_INTERVAL 10  // Milliseconds, about the time the UART takes to send its FIFO
+#define HISTORY_LINE_SIZE 64  // Room asked to the transmit buffer for one line
+struct historyPrint {
+  int zoneIndex;  // Zone asked, -1 for every zone
+  int zone;  // Zone being printed, zoneCount when done
+  uint32_t from;  // Range asked, seconds since startup
+  uint32_t to;
+  uint32_t next;  // Time of the next reading of the zone to print
+  uint32_t count;  // Readings of the zone printed so far
+  bool started;  // The header of the zone was printed
+  bool full;  // The transmit buffer filled up during this chunk
+};
+historyPrint historyPrinting = {-1, 0, 0, 0, 0, 0, false, false};
+config_status commandHistory(char *args);  // history [zone] [from] [to]: stored readings, times in seconds since startup
+config_status commandFilter(char *args);  // filter: readings accepted and rejected by the filter of every zone
+config_status commandGet(char *args);  // GET <key>
+config_status commandSet(char *args);  // SET <key> <value>
+config_status commandDump(char *args);  // DUMP: every key
+config_status commandRead(char *args);  // READ: last reading of every zone
+config_status commandStats(char *args);  // STATS: counters of the device
+config_status commandCommit(char *args);  // COMMIT: saves and applies the values SET
+struct serialCommand {
+  const char *name;
+  config_status (*run)(char *args);
+  bool framed;
+};
+const serialCommand serialCommands[] = {
+  {"history", commandHistory, false},
+  {"filter", commandFilter, false},
+  {"GET", commandGet, true},
+  {"SET", commandSet, true},
+  {"DUMP", commandDump, true},
+  {"READ", commandRead, true},
+  {"STATS", commandStats, true},
+  {"COMMIT", commandCommit, true},
+};
+
+/*CONFIGURATION CONSOLE*/
+// The configuration asks one field at a time. loop() hands the console the characters received and goes on
+// with its jobs, so the mesurements, the alarms and the emails do not stop while a field is being typed
+enum console_step : uint8_t {
+  STEP_SSID, STEP_ENTERPRISE, STEP_PASSWORD, STEP_EAP_ID, STEP_EAP_USERNAME, STEP_EAP_PASSWORD,
+  STEP_PRE_ALARM, STEP_ALARM, STEP_RESET_THRESHOLD, STEP_MESURE_INTERVAL, STEP_ALARM_INTERVAL,
+  STEP_ZONE_NAME, STEP_ZONE_PRE_ALARM, STEP_ZONE_ALARM,
+  STEP_SMTP_SERVER, STEP_SMTP_PORT, STEP_SENDER_ADDRESS, STEP_SENDER_PASSWORD, STEP_AUTHOR_NAME, STEP_RECIPIENT, STEP_IM_ALIVE_INTERVAL,
+  STEP_TEST_EMAIL, STEP_CONFIRM, STEP_CLOSED
+};
+uint8_t consoleStep = STEP_CLOSED;  // Field being typed, STEP_CLOSED outside the configuration
+int consoleZone = 0;  // Zone of the STEP_ZONE_* fields
+bool consoleNetworkChanged = false;  // The WiFi settings changed, the connection is made again once they are saved
+// The answers go to a copy of the configuration, which replaces the one in use once the last field is answered:
+// the jobs of loop() never see a half typed configuration (e.g. a new SSID with the old password)
+deviceConfig consoleConfig;
+LineEditor consoleLine;
+void openConsole();
+void closeConsole();
+void stepConsole();
+bool consoleMasked();
+void enterConsoleStep(uint8_t step);
+void promptConsole();
+void answerConsole(const char *answer);
+bool parseConsoleTemperature(const char *answer, float &temperature);
+bool parseConsoleNumber(const char *answer, long &number);
+int nextConsoleZone(int from);
+zoneConfig &consoleZoneConfig();
+bool installConfig(const deviceConfig &newConfig);
+bool networkSettingsChanged(const networkConfig &from, const networkConfig &to);
+void applyConfig();
 
 /*EMAIL STUFF*/
+#define EMAIL_QUEUE_SIZE 8  // Alert events waiting to be sent, further events are dropped
+#define EMAIL_TASK_STACK_SIZE 16384
+#define EMAIL_TASK_CORE 0  // loop() runs on core 1
+#define EMAIL_TYPE_SIZE 16
+#define EMAIL_BATCH_WINDOW 500  // Time (milliseconds) waited after an event is queued so that close events share one SMTP connection
+#define EMAIL_LATE_NOTICE 60000  // An email sent this late (milliseconds) after its event says so
+#define EMAIL_RETRY_INTERVAL 60000  // Milliseconds before the queued emails are tried again when the SMTP server could not be reached
+
+// Copy of a zone taken when an alert event is queued, the email task never reads zones[]
+struct zoneReading {
+  DeviceAddress address;
+  char name[ZONE_NAME_SIZE];
+  float tempC;
+  int status;
+};
+
+// An email waiting to be sent by the email task
+struct emailEvent {
+  char messageType[EMAIL_TYPE_SIZE];
+  int zoneIndex;  // Zone the message refers to, -1 if none
+  int zoneCount;
+  zoneReading zones[MAX_ZONES];
+  unsigned long time;  // Time (millis) the event was queued
+};
+
+SPSCQueue<emailEvent, EMAIL_QUEUE_SIZE> emailQueue;  // Filled by loop(), emptied by the email task
+TaskHandle_t emailTaskHandle = NULL;
+// loop() owns "config", the email task gets its own copy of the email settings through this buffer.
+// Only the last settings matter: a queue that fills up would drop the newest ones
+TripleBuffer<emailConfig> emailSettingsUpdates;
+// Session config and message headers, used by the email task only
+ESP_Mail_Session session;
+emailConfig emailSettings;
+bool emailSettingsLoaded = false;
 // Define the SMTP Session object which used for SMTP transport
 SMTPSession smtp;
 // Define a callback function for smtp debug via the serial monitor
 void smtpCallback(SMTP_Status status);
-// Function to send email
-void sendEmail(String messageType);
+// Queues an email for the email task, z is the zone the message refers to (if any)
+void queueEmail(const char *messageType, zone *z = nullptr);
+// Email task body
+void emailTask(void *parameter);
+// Hands a copy of the email configuration to the email task
+void publishEmailSettings();
+// Applies the last email configuration published by loop()
+void loadEmailSettings();
+// Sends every queued email over a single SMTP connection
+void sendQueuedEmails();
+std::atomic<uint32_t> emailsSent{0};  // Written by the email task only
+std::atomic<uint32_t> emailsFailed{0};  // Written by the email task only
+// Fills the message according to the requested message type
+bool composeEmail(const emailEvent &event, SMTP_Message &message);
+
+/*MQTT TELEMETRY*/
+#ifdef MQTT_TELEMETRY
+// The readings are handed to a task on core 0 which batches and publishes them, so a slow broker or a
+// reconnection never delays the mesurements. The topic is tempmon/<client id>/readings
+#define MQTT_BROKER "192.168.1.10"
+#define MQTT_PORT 1883
+#define MQTT_BATCH_SAMPLES 12  // A batch is published with 12 readings...
+#define MQTT_BATCH_AGE 300000  // ...or when its first reading is 5 minutes old
+#define MQTT_QUEUE_SIZE 32  // Readings waiting to be taken by the task
+#define MQTT_CONNECT_TIMEOUT 3000  // Milliseconds
+#define MQTT_TASK_STACK_SIZE 4096
+#define MQTT_TASK_CORE 0
+
+// MqttTransport over a WiFiClient
+class WiFiTransport : public MqttTransport
+{
+public:
+  bool connect(const char *host, uint16_t port) override { return _client.connect(host, port, MQTT_CONNECT_TIMEOUT); }
+  bool connected() override { return _client.connected(); }
+  size_t write(const uint8_t *data, size_t length) override { return _client.write(data, length); }
+  size_t read(uint8_t *data, size_t length) override
+  {
+    int available = _client.available();
+    if (available <= 0) return 0;
+    int n = _client.read(data, (size_t)available < length ? available : length);
+    return n > 0 ? n : 0;
+  }
+  void stop() override { _client.stop(); }
+
+private:
+  WiFiClient _client;
+};
+
+char mqttClientId[MQTT_CLIENT_ID_SIZE + 1];  // tempmon-<last 3 bytes of the MAC address>, set in setup()
+char mqttTopic[MQTT_TOPIC_SIZE + 1];
+WiFiTransport mqttTransport;
+// Used by the telemetry task only
+MqttTelemetry telemetry(mqttTransport, {MQTT_BROKER, MQTT_PORT, mqttClientId, mqttTopic, MQTT_BATCH_SAMPLES, MQTT_BATCH_AGE}, esp_random());
+SPSCQueue<telemetrySample, MQTT_QUEUE_SIZE> telemetryQueue;  // Filled by loop(), emptied by the telemetry task
+TaskHandle_t telemetryTaskHandle = NULL;
+// Telemetry task body
+void telemetryTask(void *parameter);
+#endif
+
+/*WIFI*/
+// WiFiLink over the Arduino WiFi station
+class StationLink : public WiFiLink
+{
+public:
+  bool connected() override { return WiFi.status() == WL_CONNECTED; }
+  void begin() override { connectToWiFi(); }
+  void disconnect() override { WiFi.disconnect(); }
+};
+
+StationLink stationLink;
+WiFiReconnect wifi(stationLink, esp_random());  // Used by loop() only
+std::atomic<bool> wifiConnected{false};  // Written by loop(), read by the email task
+
+/*METRICS*/
+// A task on core 0 answers GET /metrics (see Metrics.h) from the last snapshot published by loop(), so scrapes
+// never wait for loop() and loop() never waits for them. Requests are served one at a time from static buffers
+#define METRICS_PORT 80
+#define METRICS_TASK_STACK_SIZE 4096
+#define METRICS_TASK_CORE 0
+#define METRICS_BACKLOG 4  // Connections waiting to be accepted
+#define METRICS_BUFFER_SIZE 7168  // The longest body, 8 zones with names made of escaped characters, is about 6.2 KB
+#define METRICS_REQUEST_SIZE 512
+#define METRICS_TIMEOUT 1000  // Time (milliseconds) waited for the request of a client, and for it to take each part of the answer
+TripleBuffer<deviceMetrics> metricsSnapshot;  // loop() -> metrics task
+TaskHandle_t metricsTaskHandle = NULL;
+// Publishes the state of the zones to the metrics task. Called by loop() only
+void publishMetrics();
+// Metrics task body
+void metricsTask(void *parameter);
+// Answers one HTTP connection
+void serveMetrics(int client);
+bool sendMetrics(int client, const char *data, size_t length);
 
 void setup()
 {
+  loopTaskHandle = xTaskGetCurrentTaskHandle();  // setup() and loop() run in the same task
   Serial.begin(115200);
+  Serial.onReceive(wakeLoop);
   delay(2000);
   // while(!Serial) {;}    //Waits for the serial port to open. uSE ONLY when debugging via serial port
   
@@ -263,32 +464,15 @@ void setup()
   Serial.println("###################################################################");
   Serial.println();
 
-  userSettings.begin("network");
-  userSettings.putString("ssid", "your_ssid");
-  userSettings.putString("isWpaEnterprise", "no");
-  userSettings.putString("passwd", "password");
-  userSettings.putString("eap_id", "id");
-  userSettings.putString("eap_username", "user");
-  userSettings.putString("eap_password", "password");
-  userSettings.end();
-
-  userSettings.begin("alarms");
-  userSettings.putFloat("pre_alarm", 30.0);       // temperature above wich the pre alarm is triggered
-  userSettings.putFloat("alarm_threshold", 35.0); // temperature above wich the alarm sends a notify via email
-  userSettings.putFloat("reset_threshold", 1.0);  // temperature threshold subtracted to the pre alarm threshold under which the alarm is reactivated
-  userSettings.putInt("mesure_interval", 60);   // time intervall (seconds) beetween mesurements
-  userSettings.putInt("alarm_interval", 10);   // time intervall (minutes) beetween alarm emails
-  userSettings.end();
-
-  userSettings.begin("email");
-  userSettings.putString("smtp_server", "smtp.email.something");
-  userSettings.putUInt("smpt_port", 465);
-  userSettings.putString("sender_address", "you@email.something");
-  userSettings.putString("sender_password", "password");
-  userSettings.putString("author_name", "ESP32 - Server temp monitor");
-  userSettings.putString("recipient_1", "");
-  userSettings.putInt("imAlive_intrvl", 30);  // time intervall (days) beetween "Im alive" emails
-  userSettings.end();
+  setDefaultConfig(config);
+  saveConfig(config);
+  #else
+  // Reads the whole configuration once, devices configured by older versions are migrated to the single blob
+  if (!loadConfig(config))
+  {
+    Serial.println("Configuration migrated to the new storage format.");
+    saveConfig(config);
+  }
   #endif
   
   #ifdef DEBUG
@@ -298,14 +482,8 @@ void setup()
   printConfig(MODE_PASSWORD);   // prints configuration covering passwords characters with asterisks
   #endif
 
-  pinMode(ledBluePin, OUTPUT);
-  pinMode(ledRedPin, OUTPUT);
-  pinMode(ledGreenPin, OUTPUT);
   pinMode(buttonPin, INPUT_PULLUP);
-
-  digitalWrite(ledBluePin, LOW);
-  digitalWrite(ledRedPin, LOW);
-  digitalWrite(ledGreenPin, LOW);
+  ledHardware.begin();
 
   Serial.print("Initializing timers . . .");
   // debounce timer
@@ -313,68 +491,61 @@ void setup()
   timerAttachInterrupt(buttonTimer, &onTimer, true);
   timerAlarmWrite(buttonTimer, 100000, true);
   timerAlarmEnable(buttonTimer);
-  // RGB LED blinker timer
-  blinkerTimer = timerBegin(1, 80, true);
-  timerAttachInterrupt(blinkerTimer, &RGBtimerBlinker, true);
-  timerAlarmWrite(blinkerTimer, 1000, true);  // Starting a 1kHz timer
-  timerAlarmEnable(blinkerTimer);
   Serial.println("DONE");
 
-  // Fast blinking blue LED until start of the main loop
-  timeOn = 50;
-  timeOff = 30;
-  RGB_LEDCode = 1;
+  statusLed.play(bootPattern, millis());
 
+  // The connection comes up in background, loop() reports it (checkWiFi)
   Serial.println("Connecting to WiFi");
-  connectToWiFi();
-  long wifiBeginMillis = millis();
-  while (WiFi.status() != WL_CONNECTED)
-    {
-    Serial.print(".");
-    if (millis() - wifiBeginMillis > 30000) break; 
-    delay(500);   
-    }
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println();
-      Serial.println("ERROR: WiFi connect timeout");
-      Serial.println("WiFi not connected. Check your network configuration.");
-      delay(2000);
-    } else {
-      Serial.println();
-      Serial.println(" DONE");
-      Serial.println("WiFi connected.");
-      Serial.print("IP address: ");
-      Serial.println(WiFi.localIP());
-    }
-    Serial.println();
+  wifi.reconnect(millis());
+  Serial.println();
 
   Serial.println("Initializing temperature sensor . . .");
-  // initialize DallasTemperature
-  sensors.begin();
-  sensors.setResolution(9);
-  // locate devices on the bus
+  buses.addBus(sensors);
+  #ifdef ONE_WIRE_BUS_2
+  buses.addBus(sensors2);
+  #endif
+  // locate devices on the buses, requestTemperatures() returns immediately and the result is collected by loop()
+  buses.begin();
+  #ifdef FAST_READ
+  buses.setFastRead(FAST_READ_MAX_JUMP);
+  #endif
   Serial.print("Found ");
-  Serial.print(sensors.getDeviceCount(), DEC);
-  Serial.println(" devices.");
+  Serial.print(buses.deviceCount(), DEC);
+  Serial.print(" devices on ");
+  Serial.print(buses.busCount(), DEC);
+  Serial.println(" buses.");
   Serial.println();
 
   // ALARMS CONFIGURATION
-  userSettings.begin("alarms");
-  preAlarmTemperature = userSettings.getFloat("pre_alarm");
-  alarmTemperature = userSettings.getFloat("alarm_threshold");
-  alarmResetThreshold = userSettings.getFloat("reset_threshold");
-  mesurementInterval = userSettings.getInt("mesure_interval")*1000;
-  alarmEmailInterval = userSettings.getInt("alarm_interval")*60000;   // 1 min = 60000 ms
-  userSettings.end();
-  userSettings.begin("email");
-  imAliveIntervall = userSettings.getInt("imAlive_intrvl")*3600000;  // 1 hr = 3600000 ms
-  userSettings.end();
+  mesurementInterval = config.alarms.mesureInterval*1000;
+  #ifdef FIXED_SAMPLING
+  samplingPeriod = mesurementInterval;
+  #else
+  samplingPeriod = samplingInterval(samplingLevel, mesurementInterval);
+  #endif
+  alarmEmailInterval = config.alarms.alarmInterval*60000;   // 1 min = 60000 ms
+  imAliveIntervall = config.email.imAliveInterval*3600000;  // 1 hr = 3600000 ms
+  zoneRules.alarm.notifyInterval = alarmEmailInterval;
+
+  // Maps every sensor found to its zone
+  initZones();
+  #ifdef FIXED_SAMPLING
+  configureZoneSensors(9, true);
+  #else
+  configureZoneSensors(samplingLevels[samplingLevel].resolution, true);  // Saved in the sensors EEPROM, later changes are not
+  #endif
+  for (int i = 0; i < zoneCount; i++)
+  {
+    Serial.println("Zone " + String(zones[i].config.name) + " - sensor " + addressToString(zones[i].config.address));
+  }
+  Serial.println();
 
   #ifdef DEBUG
   Serial.println();
-  Serial.println(preAlarmTemperature);
-  Serial.println(alarmTemperature);
-  Serial.println(alarmResetThreshold);
+  Serial.println(config.alarms.preAlarmTemperature);
+  Serial.println(config.alarms.alarmTemperature);
+  Serial.println(config.alarms.alarmResetThreshold);
   Serial.println(mesurementInterval);
   Serial.println(alarmEmailInterval);
   Serial.println();
@@ -384,199 +555,489 @@ void setup()
   smtp.debug(0);
   // Set the callback function to get the sending results
   smtp.callback(smtpCallback);
+  // Emails are sent by a dedicated task so that a slow SMTP server doesn't delay the mesurements
+  publishEmailSettings();
+  xTaskCreatePinnedToCore(emailTask, "email", EMAIL_TASK_STACK_SIZE, NULL, 1, &emailTaskHandle, EMAIL_TASK_CORE);
+  #ifdef MQTT_TELEMETRY
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(mqttClientId, sizeof(mqttClientId), "tempmon-%02x%02x%02x", mac[3], mac[4], mac[5]);
+  snprintf(mqttTopic, sizeof(mqttTopic), "tempmon/%s/readings", mqttClientId);
+  xTaskCreatePinnedToCore(telemetryTask, "telemetry", MQTT_TASK_STACK_SIZE, NULL, 1, &telemetryTaskHandle, MQTT_TASK_CORE);
+  #endif
+  publishMetrics();
+  xTaskCreatePinnedToCore(metricsTask, "metrics", METRICS_TASK_STACK_SIZE, NULL, 1, &metricsTaskHandle, METRICS_TASK_CORE);
+
+  #if CONFIG_PM_ENABLE
+  // The CPU drops to 80 MHz while every task is waiting. Light sleep is not enabled: it would stop the
+  // LEDC blinking and the button timer
+  esp_pm_config_esp32_t pm = {};
+  pm.max_freq_mhz = 240;
+  pm.min_freq_mhz = 80;
+  pm.light_sleep_enable = false;
+  if (esp_pm_configure(&pm) == ESP_OK) Serial.println("Dynamic frequency scaling enabled.");
+  #endif
 
-  timeOn = 50;
-  timeOff = 950;
-  RGB_LEDCode = 2;
+  mesureJob = scheduler.addJob(runMesurement);
+  collectJob = scheduler.addJob(collectMesurement);
+  imAliveJob = scheduler.addJob(sendImAlive);
+  wifiCheckJob = scheduler.addJob(checkWiFi);
+  historyJob = scheduler.addJob(printHistory);
+  scheduler.schedule(mesureJob, samplingPeriod);
+  scheduler.schedule(imAliveJob, imAliveIntervall);
+  scheduler.schedule(wifiCheckJob, nowMs());
+  loopStatsStart = esp_timer_get_time();
+
+  setStatusLED(IDLE);
 }
 
 void loop()
 {
-  if (TimeDiff(lastMesurementTime, millis()) > mesurementInterval && status != CONFIG)
+  handleIsrEvents();
+  scheduler.runDue(nowMs());
+
+  if (consoleStep != STEP_CLOSED) stepConsole();
+  else readSerialCommand();
+
+  uint64_t deadline = scheduler.nextDeadline();
+  uint32_t ledDelay = statusLed.update(millis());
+  if (ledDelay != LED_NO_CHANGE && nowMs() + ledDelay < deadline) deadline = nowMs() + ledDelay;
+  waitForEvents(deadline);
+}
+
+// Starts a new conversion on every bus, the results are collected by collectMesurement() as each bus finishes
+void runMesurement(int job)
+{
+  #ifdef DEBUG
+  Serial.println("Mesurement late by " + String((int)(nowMs() - scheduler.deadline(job))) + " ms");
+  #endif
+  bool fullRead = mesurementCount++ % FULL_READ_CYCLES == 0;
+  watchZones(buses, zones, zoneCount);
+  uint32_t wait = buses.requestTemperatures(millis(), !fullRead);
+  scheduler.schedule(collectJob, nowMs() + wait);
+  scheduler.scheduleNext(job, samplingPeriod, nowMs());
+}
+
+// Reads the buses whose conversion is over, the zones are evaluated once every bus has been read
+void collectMesurement(int job)
+{
+  uint32_t wait = buses.collect(millis());
+  if (wait != BUSES_COLLECTED)
   {
-    Serial.print(millis());
-    #ifdef DEBUG
-    Serial.print(" | Last mesure time diff ");
-    Serial.print(TimeDiff(lastMesurementTime, millis()));
-    #endif
+    scheduler.schedule(job, nowMs() + wait);
+    return;
+  }
 
-    // Getting temperature and counting reading errors
-    if (getTemperature(tempC))
-    {
-      tempReadingErrotCnt++;
-      if (tempReadingErrotCnt >= 5) 
-      {
-        status = SENSOR_FAILURE;
-        timeOn = 50;
-        timeOff = 250;
-        RGB_LEDCode = 4;
-      }
-      Serial.print(" - Failed temp");
-    }
-    else 
-    {
-      if (status == SENSOR_FAILURE)
-      {
-        status = IDLE;
-        timeOn = 50;
-        timeOff = 950;
-        RGB_LEDCode = 2;
-        firstSensorAlarm = true;
-        tempReadingErrotCnt = 0;
-        Serial.print(" - Temperature: " + String(tempC));
-      }
-      else
-      {
-        tempReadingErrotCnt = 0;
-        Serial.print(" - Temperature: " + String(tempC));
-      }
-    }
-    
-    #ifdef DEBUG
-    Serial.print(" | Fail count: " + String(tempReadingErrotCnt));
-    #endif
-    lastMesurementTime = millis();
-    // Finish getting tem & counting ev. errors
+  Serial.print(millis());
+  uint8_t actions = readZones(buses, zones, zoneCount, zoneRules, millis(), zoneLog);
+  #ifdef MQTT_TELEMETRY
+  if (telemetryTaskHandle != NULL) xTaskNotifyGive(telemetryTaskHandle);
+  #endif
+  #ifndef FIXED_SAMPLING
+  uint8_t level = nextSamplingLevel(samplingLevel, samplingHoldCount, zones, zoneCount);
+  if (level != samplingLevel) setSamplingLevel(level);
+  #endif
+
+  if ((actions & ACTION_STATUS_CHANGED) && status != CONFIG)
+  {
+    status = worstZoneStatus(zones, zoneCount);
+    setStatusLED(status);
+  }
+  publishMetrics();
+  Serial.print(" | System status: " + String(status));
+  Serial.print(" | Email queue: " + String((int)emailQueue.depth()) + " waiting, " + String(emailQueue.dropped()) + " dropped");
+
+  uint64_t now = esp_timer_get_time();
+  Serial.println(" | loop() busy " + String(100.0 * loopBusyTime / (now - loopStatsStart), 2) + "%");
+  loopBusyTime = 0;
+  loopStatsStart = now;
+}
 
-    if ((status == IDLE || status == PRE_ALARM) && (tempC >= preAlarmTemperature && tempC < alarmTemperature))
+void sendImAlive(int job)
+{
+  queueEmail("IM_ALIVE");
+  scheduler.scheduleNext(job, imAliveIntervall, nowMs());
+}
+
+// Follows the WiFi link and reconnects in background. The mesurements and the alarms go on while it is down,
+// the emails wait in the queue and are sent when it comes back
+void checkWiFi(int job)
+{
+  uint32_t wait = wifi.poll(millis());
+  if (wifi.connected() != wifiConnected)  // Also after a reconnect() with new settings
+  {
+    wifiConnected = wifi.connected();
+    if (wifiConnected)
     {
-      if (firstTempAlarm || TimeDiff(lastAlarmEmailTime, millis()) > alarmEmailInterval)
-      {
-        status = PRE_ALARM;
-        timeOn = 50;
-        timeOff = 950;
-        RGB_LEDCode = 6;
-        firstTempAlarm = false;
-        sendEmail("PRE_ALARM");
-        lastAlarmEmailTime = millis();
-      }
+      Serial.print("WiFi connected, IP address: ");
+      Serial.println(WiFi.localIP());
+      WiFi.setSleep(true);  // Modem sleep: the radio is off between the AP beacons
+      if (emailTaskHandle != NULL) xTaskNotifyGive(emailTaskHandle);  // Sends what was queued meanwhile
     }
-    else if ((status == IDLE || status == PRE_ALARM || status == ALARM) && tempC >= alarmTemperature)
+    else Serial.println("ERROR: WiFi disconnected, reconnecting in background");
+  }
+  scheduler.schedule(job, nowMs() + wait);
+}
+
+// Milliseconds since startup on the 64 bit clock used by the scheduler
+uint64_t nowMs()
+{
+  return esp_timer_get_time() / 1000;
+}
+
+// Wakes loop() up before its deadline, e.g. when a character arrives on the serial port
+void wakeLoop()
+{
+  xTaskNotifyGive(loopTaskHandle);
+}
+
+// Blocks loop() until the deadline or until woken up, letting the CPU idle. Counts the time loop() was awake
+void waitForEvents(uint64_t deadline)
+{
+  static uint64_t awakeSince = 0;
+  uint64_t now = esp_timer_get_time();
+  if (awakeSince) loopBusyTime += now - awakeSince;
+
+  uint64_t nowMillis = now / 1000;
+  if (deadline > nowMillis)
+  {
+    uint64_t wait = deadline - nowMillis;
+    if (wait > LOOP_MAX_SLEEP) wait = LOOP_MAX_SLEEP;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+  }
+  awakeSince = esp_timer_get_time();
+}
+
+// Function to calulate time differences using millis(), safe in case millis() overflows
+unsigned long TimeDiff(unsigned long lastTime, unsigned long currTime)
+{
+  if (currTime < lastTime)
+
+    return (0xffffffff - lastTime + currTime);
+
+  return (currTime- lastTime);
+}
+
+// Applies the events posted by the ISRs
+void handleIsrEvents()
+{
+  uint8_t event;
+  while (isrEvents.pop(event))
+  {
+    switch (event)
     {
-      status = ALARM;
-      if (previousStatus != status) firstTempAlarm = true;
-      if (firstTempAlarm || TimeDiff(lastAlarmEmailTime, millis()) > alarmEmailInterval)
-      {
-        timeOn = 50;
-        timeOff = 950;
-        RGB_LEDCode = 4;
-        firstTempAlarm = false;
-        sendEmail("ALARM");
-        lastAlarmEmailTime = millis();
-      }
+    case BUTTON_LONG_PRESS:
+      if (consoleStep == STEP_CLOSED) openConsole();
+      break;
     }
-    if ((status == PRE_ALARM) && tempC <= preAlarmTemperature - alarmResetThreshold)
-    {
-      status = IDLE;
-      timeOn = 50;
-      timeOff = 950;
-      RGB_LEDCode = 2;
-      firstTempAlarm = true;
-      sendEmail("ALARM_RESET");
-    } else if ((status == ALARM) && tempC <= alarmTemperature - alarmResetThreshold)
+  }
+}
+
+// Seconds since startup, does not overflow like millis()
+uint32_t uptimeSeconds()
+{
+  return esp_timer_get_time() / 1000000;
+}
+
+// Collects the characters available on the serial port without waiting and runs the command once a line is complete
+void readSerialCommand()
+{
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+    if (c == '\n' || c == '\r')
     {
-      status = PRE_ALARM;
-      timeOn = 50;
-      timeOff = 950;
-      RGB_LEDCode = 2;
-      firstTempAlarm = true;
-      sendEmail("PRE_ALARM");
+      if (commandLength == 0) continue;
+      bool tooLong = commandLength > COMMAND_BUFFER_SIZE;
+      if (!tooLong) commandBuffer[commandLength] = 0;
+      commandLength = 0;
+      if (tooLong) replyEnd(CONFIG_BAD_ARGUMENTS);  // Truncated, running it could set a wrong value
+      else runSerialCommand(commandBuffer);
     }
-
-    #ifdef DEBUG
-    Serial.print(" | Last alarm  time diff ");
-    Serial.print(TimeDiff(lastAlarmEmailTime, millis()));
-    Serial.print(" | Last failure time diff ");
-    Serial.print(TimeDiff(lastFailureEmailTime, millis()));
-    #endif
-    Serial.print(" | System status: " + String(status));
-    Serial.println(" | Previous system status: " + String(previousStatus));
+    else if (commandLength < COMMAND_BUFFER_SIZE) commandBuffer[commandLength++] = c;
+    else commandLength = COMMAND_BUFFER_SIZE + 1;  // Dropped at the end of the line
   }
+}
+
+// Looks the first word of the line up in serialCommands and runs it with the rest of the line
+void runSerialCommand(char *command)
+{
+  char *args = command;
+  while (*args && *args != ' ') args++;
+  if (*args) *args++ = 0;
 
-  if(TimeDiff(lastImAliveEmail, millis()) > imAliveIntervall) {
-    lastImAliveEmail = millis();
-    sendEmail("IM_ALIVE");
+  for (const serialCommand &c : serialCommands)
+  {
+    if (strcmp(c.name, command) != 0) continue;
+    config_status result = c.run(args);
+    if (c.framed) replyEnd(result);
+    return;
   }
+  Serial.println("Available commands: history [zone] [from] [to], filter, GET <key>, SET <key> <value>, DUMP, READ, STATS, COMMIT");
+  replyEnd(CONFIG_UNKNOWN_COMMAND);
+}
 
-  if (status == SENSOR_FAILURE)
+// Data line of a framed reply
+void replyValue(const char *key, const char *value)
+{
+  Serial.print("$ ");
+  Serial.print(key);
+  Serial.print(' ');
+  Serial.println(value);
+}
+
+// Last line of a framed reply
+void replyEnd(config_status result)
+{
+  Serial.print('$');
+  Serial.print((int)result);
+  Serial.print(' ');
+  Serial.println(configStatusName(result));
+}
+
+// Finds a key, "zone.<n>.<field>" or a device field, in the given configuration: base is where the key table
+// offset starts from
+config_status findKey(deviceConfig &cfg, const char *name, const configKey *&key, void *&base)
+{
+  if (strncmp(name, "zone.", 5) == 0)
   {
-    if (firstSensorAlarm || TimeDiff(lastFailureEmailTime, millis()) > alarmEmailInterval)
-    {
-      firstSensorAlarm = false;
-      lastFailureEmailTime = millis();
-      sendEmail("SENSOR_FAILURE");
-    }
+    char *end;
+    long index = strtol(name + 5, &end, 10) - 1;
+    if (end == name + 5 || *end != '.' || index < 0 || index >= zoneCount || zones[index].nvsSlot < 0) return CONFIG_UNKNOWN_KEY;
+    key = findConfigKey(zoneKeys, zoneKeyCount, end + 1);
+    base = &cfg.zones[zones[index].nvsSlot];
   }
-  if (status == CONFIG)
+  else
   {
-    timeOn = 50;
-    timeOff = 950;
-    RGB_LEDCode = 1;
-    serialConfiguration();
+    key = findConfigKey(deviceKeys, deviceKeyCount, name);
+    base = &cfg;
   }
+  return key ? CONFIG_OK : CONFIG_UNKNOWN_KEY;
+}
 
-  // Check wether the system is still connected to the network
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println();
-    Serial.println("ERROR: WiFi disconnected");
-    delay(2000);
-    ESP.restart();
+// The values the protocol shows: the ones not yet committed if any
+deviceConfig &shownConfig()
+{
+  return configPending ? pendingConfig : config;
+}
+
+config_status commandHistory(char *args)
+{
+  char *arg = strtok(args, " ");
+  int zoneIndex = arg ? atoi(arg) - 1 : -1;
+  arg = strtok(NULL, " ");
+  uint32_t from = arg ? strtoul(arg, NULL, 10) : 0;
+  arg = strtok(NULL, " ");
+  uint32_t to = arg ? strtoul(arg, NULL, 10) : UINT32_MAX;
+
+  if (zoneIndex >= zoneCount)
+  {
+    Serial.println("ERROR: zone " + String(zoneIndex + 1) + " does not exist");
+    return CONFIG_BAD_ARGUMENTS;
   }
+  Serial.println("Uptime: " + String(uptimeSeconds()) + "s | History memory: " + String((int)tempHistory.bytesUsed()) + "/" + String((int)TempHistory::memorySize()) + " bytes");
+  // A history still being printed is dropped for the new one
+  historyPrinting = {zoneIndex, zoneIndex < 0 ? 0 : zoneIndex, from, to, from, 0, false, false};
+  scheduler.schedule(historyJob, nowMs());
+  return CONFIG_OK;
+}
 
-  previousStatus = status;
+config_status commandFilter(char *args)
+{
+  for (int i = 0; i < zoneCount; i++)
+  {
+    const sampleFilterState &f = zones[i].filter;
+    Serial.println(String(i + 1) + " " + String(zones[i].config.name) + ": " + String(f.accepted) + " accepted, " +
+                   String(f.rejectedPowerOn) + " rejected at power-on value, " + String(f.rejectedSlew) + " rejected over max slew");
+  }
+  return CONFIG_OK;
 }
 
-// Function to calulate time differences using millis(), safe in case millis() overflows
-unsigned long TimeDiff(unsigned long lastTime, unsigned long currTime)
+config_status commandGet(char *args)
 {
-  if (currTime < lastTime)
+  const configKey *key;
+  void *base;
+  if (*args == 0 || strchr(args, ' ')) return CONFIG_BAD_ARGUMENTS;
+  config_status result = findKey(shownConfig(), args, key, base);
+  if (result != CONFIG_OK) return result;
+  char value[CONFIG_VALUE_SIZE];
+  formatConfigValue(base, *key, value, sizeof(value));
+  replyValue(args, value);
+  return CONFIG_OK;
+}
 
-    return (0xffffffff - lastTime + currTime);
+// The value is the rest of the line, spaces included. The first SET takes a copy of the configuration, the
+// device keeps running with the old values until COMMIT
+config_status commandSet(char *args)
+{
+  char *value = args;
+  while (*value && *value != ' ') value++;
+  if (*value) *value++ = 0;
+  if (*args == 0) return CONFIG_BAD_ARGUMENTS;
+
+  if (!configPending) pendingConfig = config;
+  const configKey *key;
+  void *base;
+  config_status result = findKey(pendingConfig, args, key, base);
+  if (result == CONFIG_OK) result = parseConfigValue(base, *key, value);
+  if (result == CONFIG_OK) configPending = true;
+  return result;
+}
 
-  return (currTime- lastTime);
+config_status commandDump(char *args)
+{
+  deviceConfig &cfg = shownConfig();
+  char value[CONFIG_VALUE_SIZE];
+  for (size_t k = 0; k < deviceKeyCount; k++)
+  {
+    formatConfigValue(&cfg, deviceKeys[k], value, sizeof(value));
+    replyValue(deviceKeys[k].name, value);
+  }
+  for (int i = 0; i < zoneCount; i++)
+  {
+    if (zones[i].nvsSlot < 0) continue;
+    for (size_t k = 0; k < zoneKeyCount; k++)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "zone.%d.%s", i + 1, zoneKeys[k].name);
+      formatConfigValue(&cfg.zones[zones[i].nvsSlot], zoneKeys[k], value, sizeof(value));
+      replyValue(name, value);
+    }
+  }
+  return CONFIG_OK;
 }
 
-// Read a string interactively from the serial port
-int getStringFromSerial(char *serialBuffer, String prompt, int mode)
+// Last reading of every zone: temperature (nan if none yet), status, reading errors in a row and age in seconds
+config_status commandRead(char *args)
 {
-  int i = 0;
-  int incomingByte = 0; // for incoming serial data
+  char name[24], value[16];
+  for (int i = 0; i < zoneCount; i++)
+  {
+    const zone &z = zones[i];
+    bool valid = z.tempRaw != DEVICE_DISCONNECTED_RAW;
+    snprintf(name, sizeof(name), "zone.%d.temperature", i + 1);
+    snprintf(value, sizeof(value), valid ? "%.2f" : "nan", DallasTemperature::rawToCelsius(z.tempRaw));
+    replyValue(name, value);
+    snprintf(name, sizeof(name), "zone.%d.status", i + 1);
+    snprintf(value, sizeof(value), "%d", z.alarm.status);
+    replyValue(name, value);
+    snprintf(name, sizeof(name), "zone.%d.errors", i + 1);
+    snprintf(value, sizeof(value), "%u", (unsigned)z.alarm.failedReadings);
+    replyValue(name, value);
+    snprintf(name, sizeof(name), "zone.%d.age", i + 1);
+    snprintf(value, sizeof(value), "%lu", valid ? (millis() - z.readingTime) / 1000 : 0UL);
+    replyValue(name, value);
+  }
+  return CONFIG_OK;
+}
 
-  Serial.print(prompt);
-  while (incomingByte != 13 && i <= SERIAL_BUFFER_SIZE)
+config_status commandStats(char *args)
+{
+  char value[16];
+  uint32_t accepted = 0, rejected = 0;
+  for (int i = 0; i < zoneCount; i++)
+  {
+    accepted += zones[i].filter.accepted;
+    rejected += zones[i].filter.rejectedPowerOn + zones[i].filter.rejectedSlew;
+  }
+  const struct { const char *name; uint32_t value; } stats[] = {
+    {"uptime", uptimeSeconds()},
+    {"status", (uint32_t)status},
+    {"zones", (uint32_t)zoneCount},
+    {"wifi.connected", wifi.connected()},
+    {"wifi.losses", wifi.stats().linkLosses},
+    {"wifi.attempts", wifi.stats().attempts},
+    {"emails.sent", emailsSent.load()},
+    {"emails.failed", emailsFailed.load()},
+    {"emails.queued", (uint32_t)emailQueue.depth()},
+    {"emails.dropped", (uint32_t)emailQueue.dropped()},
+    {"readings.accepted", accepted},
+    {"readings.rejected", rejected},
+    {"history.bytes", (uint32_t)tempHistory.bytesUsed()},
+    {"config.pending", configPending},
+  };
+  for (const auto &s : stats)
+  {
+    snprintf(value, sizeof(value), "%u", (unsigned)s.value);
+    replyValue(s.name, value);
+  }
+  if (wifi.connected())
   {
-    if (Serial.available()  > 0)
+    snprintf(value, sizeof(value), "%d", (int)WiFi.RSSI());
+    replyValue("wifi.rssi", value);
+  }
+  return CONFIG_OK;
+}
+
+// Checks the values set, saves them and applies them as the configuration console does. A change of the
+// network settings drops the WiFi link and connects again with them. The values are applied even if they could
+// not be saved, SAVE_FAILED then means they are lost at the next restart
+config_status commandCommit(char *args)
+{
+  if (!configPending)
+  {
+    replyValue("reconnect", "no");
+    return CONFIG_OK;
+  }
+  bool valid = pendingConfig.alarms.preAlarmTemperature < pendingConfig.alarms.alarmTemperature;
+  if (!valid) replyValue("invalid", "alarms.preAlarmTemperature");
+  for (int i = 0; i < zoneCount; i++)
+  {
+    if (zones[i].nvsSlot < 0) continue;
+    const zoneConfig &zc = pendingConfig.zones[zones[i].nvsSlot];
+    if (zc.preAlarmTemperature < zc.alarmTemperature) continue;
+    char name[32];
+    snprintf(name, sizeof(name), "zone.%d.preAlarmTemperature", i + 1);
+    replyValue("invalid", name);
+    valid = false;
+  }
+  if (!valid) return CONFIG_INVALID;
+
+  bool networkChanged = networkSettingsChanged(config.network, pendingConfig.network);
+  bool saved = installConfig(pendingConfig);
+  configPending = false;
+  if (networkChanged) wifi.reconnect(millis());
+  replyValue("reconnect", networkChanged ? "yes" : "no");
+  return saved ? CONFIG_OK : CONFIG_SAVE_FAILED;
+}
+
+// Prints the readings asked by the history command, one "time;temperature" line each, as long as the serial
+// transmit buffer has room. Schedules itself again until every zone asked is done
+void printHistory(int job)
+{
+  historyPrint &p = historyPrinting;
+  while (p.zone < zoneCount && (p.zoneIndex < 0 || p.zone == p.zoneIndex))
+  {
+    if (Serial.availableForWrite() < HISTORY_LINE_SIZE) break;
+    if (!p.started)
     {
-      incomingByte = Serial.read(); // read the incoming byte:
-      if (incomingByte == 13) {
-        break;  // exits the function if CR is received
-      } else if (incomingByte == 127) {
-        if (i>0) i--;
-        else Serial.write(' ');
-        Serial.write(incomingByte);
-        serialBuffer[i] = 0;
-      } else {
-        serialBuffer[i] = incomingByte; // saves the incoming byte to the buffer
-        i++;
-      }
-      if (mode == 0 && incomingByte != 127) Serial.write(incomingByte); // print the received byte
-      else if (mode == 1 && incomingByte != 127)  {
-        Serial.write(incomingByte);
-        delay(300);
-        Serial.write(127);
-        Serial.write('*');
-      }
-      if (i == SERIAL_BUFFER_SIZE+1)
+      Serial.println("# " + String(p.zone + 1) + " " + String(zones[p.zone].config.name));
+      p.started = true;
+      continue;
+    }
+    // Readings already printed are skipped by their time, they are one second apart at least
+    p.full = false;
+    tempHistory.read(p.zone, p.next, p.to, [](uint8_t zone, uint32_t time, int16_t raw, void *context) {
+      historyPrint &p = *(historyPrint *)context;
+      if (p.full || Serial.availableForWrite() < HISTORY_LINE_SIZE)
       {
-        i--;
-        serialBuffer[i] = 0;
-        Serial.write(127);
-        Serial.write(7);
+        p.full = true;
+        return;
       }
-    }
+      char line[24];
+      snprintf(line, sizeof(line), "%u;%.2f", (unsigned)time, DallasTemperature::rawToCelsius(raw));
+      Serial.println(line);
+      p.count++;
+      p.next = time + 1;
+    }, &p);
+    if (p.full) break;
+    Serial.println("# " + String(p.count) + " readings");
+    p.zone = p.zoneIndex < 0 ? p.zone + 1 : zoneCount;
+    p.next = p.from;
+    p.count = 0;
+    p.started = false;
   }
-  serialBuffer[i] = 0;
-  return(i);
+  if (p.zone < zoneCount) scheduler.schedule(job, nowMs() + HISTORY_PRINT_INTERVAL);
 }
 
 // Converts a clear text string to a string in which every character is replaced by an asterisk, excluding the first and the last character.
@@ -586,111 +1047,178 @@ String strToAst(String inputString) {
   return inputString;
 }
 
-// Print the configuration currently saved in the NVS
+// Print the current configuration
 void printConfig(int mode) {
   Serial.println();
   Serial.println("## Current configuration ##");
   Serial.println("Network:");
-  userSettings.begin("network");
-  Serial.println("    ssid - " + userSettings.getString("ssid"));
-  Serial.println("    Is an enterprise login? - " + userSettings.getString("isWpaEnterprise"));
-  if (String(userSettings.getString("isWpaEnterprise")) == String("no")) {
+  Serial.println("    ssid - " + String(config.network.ssid));
+  Serial.println("    Is an enterprise login? - " + String(config.network.isWpaEnterprise ? "yes" : "no"));
+  if (!config.network.isWpaEnterprise) {
     Serial.print("    Password - ");
-    if (mode == 0) Serial.print(userSettings.getString("passwd"));
-    else if (mode == 1) Serial.print(strToAst(userSettings.getString("passwd")));
+    if (mode == 0) Serial.print(config.network.passwd);
+    else if (mode == 1) Serial.print(strToAst(config.network.passwd));
     Serial.println();
-  } else if (String(userSettings.getString("isWpaEnterprise")) == String("yes")) {
+  } else {
   Serial.println("  WPA2 enterprise login:");
-  Serial.println("    User ID - " + userSettings.getString("eap_id"));
-  Serial.println("    Username - " + userSettings.getString("eap_username"));
+  Serial.println("    User ID - " + String(config.network.eapID));
+  Serial.println("    Username - " + String(config.network.eapUsername));
   Serial.print("    Password - ");
-    if (mode == 0) Serial.print(userSettings.getString("eap_password"));
-    else if (mode == 1) Serial.print(strToAst(userSettings.getString("eap_password")));
+    if (mode == 0) Serial.print(config.network.eapPassword);
+    else if (mode == 1) Serial.print(strToAst(config.network.eapPassword));
     Serial.println();
   }
-  userSettings.end();
   Serial.println("Temperature:");
-  userSettings.begin("alarms");
-  Serial.println("    Pre alarm temperature - " + String(userSettings.getFloat("pre_alarm")) + " °C");
-  Serial.println("    Alarm temperature - " + String(userSettings.getFloat("alarm_threshold")) + " °C");
-  Serial.println("    Alarm reset threshold - " + String(userSettings.getFloat("reset_threshold")) + " °C");
-  Serial.println("    Time intervall beetween mesurements - " + String(userSettings.getInt("mesure_interval")) + " seconds");
-  Serial.println("    Time intervall beetween alarm email - " + String(userSettings.getInt("alarm_interval")) + " minutes");
-  userSettings.end();
+  Serial.println("    Pre alarm temperature - " + String(config.alarms.preAlarmTemperature) + " °C");
+  Serial.println("    Alarm temperature - " + String(config.alarms.alarmTemperature) + " °C");
+  Serial.println("    Alarm reset threshold - " + String(config.alarms.alarmResetThreshold) + " °C");
+  Serial.println("    Time intervall beetween mesurements - " + String(config.alarms.mesureInterval) + " seconds");
+  Serial.println("    Time intervall beetween alarm email - " + String(config.alarms.alarmInterval) + " minutes");
+  Serial.println("Zones:");
+  for (int i = 0; i < zoneCount; i++)
+  {
+    Serial.println("    " + String(zones[i].config.name) + " (" + addressToString(zones[i].config.address) + ") - pre alarm " + String(zones[i].config.preAlarmTemperature) + " °C, alarm " + String(zones[i].config.alarmTemperature) + " °C");
+  }
   Serial.println("Email:");
-  userSettings.begin("email");
-  Serial.println("    Smtp server - " + userSettings.getString("smtp_server"));
-  Serial.println("    Port - " + String(userSettings.getUInt("smpt_port")));
-  Serial.println("    Sender address - " + userSettings.getString("sender_address"));
+  Serial.println("    Smtp server - " + String(config.email.smtpServer));
+  Serial.println("    Port - " + String(config.email.smtpPort));
+  Serial.println("    Sender address - " + String(config.email.senderAddress));
   Serial.print("    SMTP password - ");
-    if (mode == 0) Serial.print(userSettings.getString("sender_password"));
-    else if (mode == 1) Serial.print(strToAst(userSettings.getString("sender_password")));
+    if (mode == 0) Serial.print(config.email.senderPassword);
+    else if (mode == 1) Serial.print(strToAst(config.email.senderPassword));
     Serial.println();
-  Serial.println("    Author name - " + userSettings.getString("author_name"));
-  Serial.println("    Email recipient - " + userSettings.getString("recipient_1"));
-  Serial.println("    Time intervall beetween ""I'm Alive"" email - " + String(userSettings.getInt("imAlive_intrvl"))+" hours");
-  userSettings.end();
+  Serial.println("    Author name - " + String(config.email.authorName));
+  Serial.println("    Email recipient - " + String(config.email.recipient));
+  Serial.println("    Time intervall beetween ""I'm Alive"" email - " + String(config.email.imAliveInterval)+" hours");
   Serial.println();
 }
 
 // Connects to the wifi network using the current configuration
 void connectToWiFi()
 {
-  char ssidBuff[WIFI_SSID_SIZE];
-  char passwdBuff[SERIAL_BUFFER_SIZE];
-  char eapIDBuff[SERIAL_BUFFER_SIZE];
-  char eapUsernameBuff[SERIAL_BUFFER_SIZE];
-  char eapPasswordBuff[SERIAL_BUFFER_SIZE];
-
-  userSettings.begin("network");
-  if (userSettings.getString("isWpaEnterprise") == String("no"))
+  if (!config.network.isWpaEnterprise)
   {
     Serial.println("Not using wpa enterprise.");
-    userSettings.getString("ssid").toCharArray(ssidBuff, 32);
-    ssid = ssidBuff;
-    userSettings.getString("passwd").toCharArray(passwdBuff, 50);
-    passwd = passwdBuff;
-    WiFi.begin(ssid, passwd);
+    esp_wifi_sta_wpa2_ent_disable();  // In case the settings were enterprise until now
+    WiFi.begin(config.network.ssid, config.network.passwd);
   }
   else
   {
     Serial.println("Using wpa enterprise.");
-    userSettings.getString("ssid").toCharArray(ssidBuff, 32);
-    ssid = ssidBuff;
-    userSettings.getString("eap_id").toCharArray(eapIDBuff, 50);
-    EAP_ID = eapIDBuff;
-    userSettings.getString("eap_username").toCharArray(eapUsernameBuff, 50);
-    EAP_USERNAME = eapUsernameBuff;
-    userSettings.getString("eap_password").toCharArray(eapPasswordBuff, 50);
-    EAP_PASSWORD = eapPasswordBuff;
 
     // WPA2 enterprise magic starts here.
     WiFi.disconnect(true);
     WiFi.mode(WIFI_STA);
-    esp_wifi_sta_wpa2_ent_set_identity((uint8_t *)EAP_ID, strlen(EAP_ID));
-    esp_wifi_sta_wpa2_ent_set_username((uint8_t *)EAP_USERNAME, strlen(EAP_USERNAME));
-    esp_wifi_sta_wpa2_ent_set_password((uint8_t *)EAP_PASSWORD, strlen(EAP_PASSWORD));
+    esp_wifi_sta_wpa2_ent_set_identity((uint8_t *)config.network.eapID, strlen(config.network.eapID));
+    esp_wifi_sta_wpa2_ent_set_username((uint8_t *)config.network.eapUsername, strlen(config.network.eapUsername));
+    esp_wifi_sta_wpa2_ent_set_password((uint8_t *)config.network.eapPassword, strlen(config.network.eapPassword));
     esp_wifi_sta_wpa2_ent_enable();
     // WPA2 enterprise magic ends here
-    WiFi.begin(ssid);
+    WiFi.begin(config.network.ssid);
   }
-  userSettings.end();
 }
 
-// Reads the temperature from the sensor
-int getTemperature(float &tempVar)
+// Formats a sensor ROM code as a hex string
+String addressToString(const uint8_t *address)
+{
+  char buf[17];
+  for (int i = 0; i < 8; i++) sprintf(buf + 2 * i, "%02X", address[i]);
+  return String(buf);
+}
+
+// Maps every sensor found to its zone (see mapZones()) and saves the settings of the sensors seen for the first time
+void initZones()
+{
+  bool configChanged = false;
+  zoneCount = mapZones(buses, config, zones, configChanged);
+  if (configChanged) saveConfig(config);
+}
+
+// Sets the resolution of every sensor and, when save is set, their alarm registers, see configureSensors()
+void configureZoneSensors(uint8_t bits, bool save)
+{
+  int failed = configureSensors(buses, zones, zoneCount, bits, save);
+  if (failed > 0) Serial.println(String(failed) + " sensors could not be configured");
+}
+
+// Called by readZones() for every zone
+void ZoneLog::zoneRead(int zoneIndex, uint8_t result, int16_t raw, uint8_t actions)
 {
-  sensors.requestTemperatures();
-  // variable to store temperature value
-  float matt = sensors.getTempCByIndex(0);
-  // Check if reading was successful
-  if (matt != DEVICE_DISCONNECTED_C)
+  zone &z = zones[zoneIndex];
+  switch (result)
   {
-    tempVar = matt;
-    return 0;
+  case ZONE_NOT_READ:
+    Serial.print(" - " + String(z.config.name) + ": no alarm");
+    return;
+  case ZONE_READ:
+    recordReading(zoneIndex);
+    Serial.print(" - " + String(z.config.name) + ": " + String(DallasTemperature::rawToCelsius(z.tempRaw)));
+    break;
+  case ZONE_REJECTED:
+    Serial.print(" - " + String(z.config.name) + ": rejected " + String(DallasTemperature::rawToCelsius(raw)));
+    break;
+  default:
+    Serial.print(" - " + String(z.config.name) + ": failed temp");
   }
-  else
-    return 1;
+  notifyZone(z, actions);
+}
+
+// Adds the reading just taken of a zone to the history and to the telemetry
+void recordReading(int zoneIndex)
+{
+  int16_t raw = zones[zoneIndex].tempRaw;
+  #ifdef MQTT_TELEMETRY
+  if (!telemetryQueue.push({(uint8_t)zoneIndex, uptimeSeconds(), raw})) Serial.print(" | Telemetry queue full");
+  #endif
+  tempHistory.append(zoneIndex, uptimeSeconds(), raw);
+}
+
+// Called after the sensors have been read, so no conversion is running while the resolution changes
+void setSamplingLevel(uint8_t level)
+{
+  unsigned long previousPeriod = samplingPeriod;
+  samplingLevel = level;
+  samplingHoldCount = 0;
+  samplingPeriod = samplingInterval(level, mesurementInterval);
+
+  // The resolution changes with the level, so it is not saved in the sensors EEPROM (limited write cycles)
+  if (buses.getResolution() != samplingLevels[level].resolution) configureZoneSensors(samplingLevels[level].resolution, false);
+
+  // The next mesurement was planned with the previous period: a shorter one brings it forward
+  if (samplingPeriod < previousPeriod)
+  {
+    uint64_t next = scheduler.deadline(mesureJob) - previousPeriod + samplingPeriod;
+    if (next < nowMs()) next = nowMs();
+    scheduler.schedule(mesureJob, next);
+  }
+
+  #ifdef DEBUG
+  Serial.print(" | Sampling level " + String(level) + ": " + String(samplingPeriod) + " ms, " + String(samplingLevels[level].resolution) + " bits");
+  #endif
+}
+
+// Queues the notifications asked by the alarm engine for a zone
+void notifyZone(zone &z, uint8_t actions)
+{
+  if (actions & ACTION_NOTIFY_PRE_ALARM) queueEmail("PRE_ALARM", &z);
+  if (actions & ACTION_NOTIFY_ALARM) queueEmail("ALARM", &z);
+  if (actions & ACTION_NOTIFY_ALARM_RESET) queueEmail("ALARM_RESET", &z);
+  if (actions & ACTION_NOTIFY_SENSOR_FAILURE) queueEmail("SENSOR_FAILURE", &z);
+
+  #ifdef DEBUG
+  Serial.print(" (fail count: " + String(z.alarm.failedReadings) + ")");
+  Serial.print(" | " + String(z.config.name) + " last alarm time diff ");
+  Serial.print(TimeDiff(z.alarm.lastTempNotify, millis()));
+  Serial.print(" last failure time diff ");
+  Serial.print(TimeDiff(z.alarm.lastFailureNotify, millis()));
+  Serial.print(" status " + String(z.alarm.status));
+  #endif
+}
+
+// Sets the RGB LED blinking pattern of a system status
+void setStatusLED(int systemStatus)
+{
+  statusLed.play(statusPatterns[systemStatus], millis());
 }
 
 // Callback function providing insights of the email sending process. Used only when DEBUG is defined (see top)
@@ -721,353 +1249,679 @@ void smtpCallback(SMTP_Status status)
   #endif
 }
 
-// Sends the email message according to the requested message type
-void sendEmail(String messageType)
+// Queues an email with a snapshot of the zones. Never blocks: if the queue is full the event is dropped
+void queueEmail(const char *messageType, zone *z)
 {
-  #ifndef NO_MAIL 
-  // Declare the session config data
-  ESP_Mail_Session session;
-  // Set the session config
-  userSettings.begin("email");
-  session.server.host_name = userSettings.getString("smtp_server");
-  session.server.port = userSettings.getUInt("smpt_port");
-  session.login.email = userSettings.getString("sender_address");
-  session.login.password = userSettings.getString("sender_password");
+  static emailEvent event;  // Only loop() queues emails, keeps the event off the stack
+  strncpy(event.messageType, messageType, EMAIL_TYPE_SIZE - 1);
+  event.messageType[EMAIL_TYPE_SIZE - 1] = 0;
+  event.zoneIndex = (z == nullptr) ? -1 : (int)(z - zones);
+  event.zoneCount = zoneCount;
+  for (int i = 0; i < zoneCount; i++)
+  {
+    memcpy(event.zones[i].address, zones[i].config.address, sizeof(DeviceAddress));
+    memcpy(event.zones[i].name, zones[i].config.name, ZONE_NAME_SIZE);
+    event.zones[i].tempC = DallasTemperature::rawToCelsius(zones[i].tempRaw);
+    event.zones[i].status = zones[i].alarm.status;
+  }
+  event.time = millis();
+
+  if (!emailQueue.push(event))
+  {
+    Serial.print(" | Email queue full, " + String(messageType) + " dropped");
+    return;
+  }
+  if (emailTaskHandle != NULL) xTaskNotifyGive(emailTaskHandle);
+}
+
+// Sends the queued emails, sleeps until loop() queues a new one. Emails left in the queue by an unreachable SMTP
+// server are tried again every EMAIL_RETRY_INTERVAL
+void emailTask(void *parameter)
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, emailQueue.depth() > 0 ? pdMS_TO_TICKS(EMAIL_RETRY_INTERVAL) : portMAX_DELAY);
+    // Events raised together (e.g. PRE_ALARM and ALARM on different zones) go out in the same transaction
+    vTaskDelay(pdMS_TO_TICKS(EMAIL_BATCH_WINDOW));
+    loadEmailSettings();
+    // Without the link the emails wait in the queue, loop() wakes the task up when it comes back
+    if (wifiConnected) sendQueuedEmails();
+  }
+}
+
+// Hands a copy of the email configuration to the email task. Called by loop() only
+void publishEmailSettings()
+{
+  emailSettingsUpdates.back() = config.email;
+  emailSettingsUpdates.publish();
+  if (emailTaskHandle != NULL) xTaskNotifyGive(emailTaskHandle);
+}
+
+// Applies the last email configuration published by loop(), if any
+void loadEmailSettings()
+{
+  if (!emailSettingsUpdates.fresh()) return;
+  emailSettings = emailSettingsUpdates.latest();
+
+  session.server.host_name = emailSettings.smtpServer;
+  session.server.port = emailSettings.smtpPort;
+  session.login.email = emailSettings.senderAddress;
+  session.login.password = emailSettings.senderPassword;
   session.login.user_domain = "";
-  userSettings.end();
 
-  // Set the NTP config time
-  Serial.println(F("Getting time from NTP server..."));
-  session.time.ntp_server = "pool.ntp.org";
-  session.time.gmt_offset = 1;
-  session.time.day_light_offset = 0;
-  Serial.println(F("Done."));
+  // The clock is synced in background once, instead of on every connection
+  if (!emailSettingsLoaded) configTime(3600, 0, "pool.ntp.org");
+  emailSettingsLoaded = true;
+}
+
+// Sends every queued email. The SMTP connection is opened for the first message and closed after the last one.
+// If the server cannot be reached the emails stay queued, the failure is counted once
+void sendQueuedEmails()
+{
+  static emailEvent event;
+  while (emailQueue.depth() > 0)
+  {
+    #ifndef NO_MAIL
+    if (!smtp.connected())
+    {
+      Serial.println(F("Connecting..."));
+      if (!smtp.connect(&session))
+      {
+        Serial.println("Error connecting to the SMTP server, " + smtp.errorReason());
+        emailsFailed++;
+        break;
+      }
+    }
+    #endif
+    emailQueue.pop(event);
+    SMTP_Message message;
+    if (!composeEmail(event, message)) continue;
+    #ifndef NO_MAIL
+    Serial.println(F("Sending..."));
+    if (!MailClient.sendMail(&smtp, &message, false))
+    {
+      Serial.println("Error sending Email, " + smtp.errorReason());
+      emailsFailed++;
+    }
+    else
+    {
+      Serial.println(F("Email sent successfully"));
+      emailsSent++;
+    }
+    #endif
+    #ifdef NO_MAIL
+    Serial.print("  | Sending mail " + String(event.messageType) + "  | ");
+    #endif
+  }
+  #ifndef NO_MAIL
+  if (smtp.connected()) smtp.closeSession();
+  #endif
+}
+
+// Fills the message according to the requested message type. Returns false for unknown types
+bool composeEmail(const emailEvent &event, SMTP_Message &message)
+{
+  String messageType = event.messageType;
+  const zoneReading *z = (event.zoneIndex >= 0) ? &event.zones[event.zoneIndex] : nullptr;
 
-  // Declare the message class
-  SMTP_Message message;
+  // Alarm and failure messages always refer to a zone
+  if (z == nullptr && messageType != "IM_ALIVE" && messageType != "TEST") return false;
+
+  // Set the message headers
+  message.sender.name = emailSettings.authorName;
+  message.sender.email = emailSettings.senderAddress;
 
   if (messageType == "PRE_ALARM")
   {
-    Serial.println("Setting email headers.");
-    // Set the message headers
-    userSettings.begin("email");
-    message.sender.name = userSettings.getString("author_name");
-    message.sender.email = userSettings.getString("sender_address");
-    message.subject = "Temperatura sala server - Soglia di attenzione superata";
-    message.addRecipient("Recipient 1", userSettings.getString("recipient_1"));
-    userSettings.end();
+    message.subject = "Temperatura sala server - " + String(z->name) + " - Soglia di attenzione superata";
+    message.addRecipient("Recipient 1", emailSettings.recipient);
     // Set the message content
-    message.text.content = "La temperatura ha superato i " + String(tempC) + " °C.";
+    message.text.content = "La temperatura nella zona " + String(z->name) + " ha superato i " + String(z->tempC) + " °C.";
   }
   else if (messageType == "ALARM")
   {
-    Serial.println("Setting email headers.");
-    // Set the message headers
-    userSettings.begin("email");
-    message.sender.name = userSettings.getString("author_name");
-    message.sender.email = userSettings.getString("sender_address");
-    message.subject = "Temperatura sala server - ALLARME";
-    message.addRecipient("Recipient 1", userSettings.getString("recipient_1"));
-
-    userSettings.end();
+    message.subject = "Temperatura sala server - " + String(z->name) + " - ALLARME";
+    message.addRecipient("Recipient 1", emailSettings.recipient);
     // Set the message content
-    message.text.content = "La temperatura ha superato i " + String(tempC) + " °C.";
+    message.text.content = "La temperatura nella zona " + String(z->name) + " ha superato i " + String(z->tempC) + " °C.";
   }
   else if (messageType == "ALARM_RESET")
   {
-    Serial.println("Setting email headers.");
-    // Set the message headers
-    userSettings.begin("email");
-    message.sender.name = userSettings.getString("author_name");
-    message.sender.email = userSettings.getString("sender_address");
-    message.subject = "Temperatura sala server - Allarme rientrato";
-    message.addRecipient("Tecnici", userSettings.getString("recipient_1"));
-    userSettings.end();
+    message.subject = "Temperatura sala server - " + String(z->name) + " - Allarme rientrato";
+    message.addRecipient("Tecnici", emailSettings.recipient);
     // Set the message content
-    message.text.content = "La temperatura è tornata sotto la soglia di attenzione. L'ultima misurazione è stata di " + String(tempC) + " °C.";
+    message.text.content = "La temperatura nella zona " + String(z->name) + " è tornata sotto la soglia di attenzione. L'ultima misurazione è stata di " + String(z->tempC) + " °C.";
   }
   else if (messageType == "SENSOR_FAILURE")
   {
-    // Set the message headers
-    userSettings.begin("email");
-    message.sender.name = userSettings.getString("author_name");
-    message.sender.email = userSettings.getString("sender_address");
-    message.subject = "Server Temp Monitor - SENSORE GUASTO";
-    message.addRecipient("Tecnici", userSettings.getString("recipient_1"));
-    userSettings.end();
+    message.subject = "Server Temp Monitor - " + String(z->name) + " - SENSORE GUASTO";
+    message.addRecipient("Tecnici", emailSettings.recipient);
     // Set the message content
-    message.text.content = "Le ultime 5 letture della temperatura non hanno avuto successo. \nLa temperatura della sala server non è sotto controllo. \n\nControllare il sensore.";
-    tempReadingErrotCnt = 0;
+    message.text.content = "Le ultime 5 letture della temperatura nella zona " + String(z->name) + " non hanno avuto successo. \nLa temperatura della zona non è sotto controllo. \n\nControllare il sensore " + addressToString(z->address) + ".";
   }
   else if (messageType == "IM_ALIVE")
   {
-    // Set the message headers
-    userSettings.begin("email");
-    message.sender.name = userSettings.getString("author_name");
-    message.sender.email = userSettings.getString("sender_address");
     message.subject = "Temperatura sala server - I'm alive!";
-    message.addRecipient("Tecnici", userSettings.getString("recipient_1"));
-    userSettings.end();
+    message.addRecipient("Tecnici", emailSettings.recipient);
     // Set the message content
-    message.text.content = "Sono vivo e sto controllando la sala server. L'ultima misurazione è stata di " + String(tempC) + " °C." + "\nSono acceso da " + String(millis()/1000) + " secondi. La prossima email di questo tipo sarà inviata tra "+String(imAliveIntervall/3600000)+" ore";
+    message.text.content = "Sono vivo e sto controllando la sala server. Le ultime misurazioni sono state:";
+    for (int i = 0; i < event.zoneCount; i++)
+    {
+      if (event.zones[i].status == SENSOR_FAILURE) message.text.content += "\n  " + String(event.zones[i].name) + ": sensore guasto";
+      else message.text.content += "\n  " + String(event.zones[i].name) + ": " + String(event.zones[i].tempC) + " °C";
+    }
+    message.text.content += "\nSono acceso da " + String(millis()/1000) + " secondi. La prossima email di questo tipo sarà inviata tra "+String(emailSettings.imAliveInterval)+" ore";
   }
   else if (messageType == "TEST")
   {
-    // Set the message headers
-    userSettings.begin("email");
-    message.sender.name = userSettings.getString("author_name");
-    message.sender.email = userSettings.getString("sender_address");
     message.subject = "Email di test - Temperatura sala server";
-    message.addRecipient("Tecnici", userSettings.getString("recipient_1"));
-    userSettings.end();
+    message.addRecipient("Tecnici", emailSettings.recipient);
     // Set the message content
     message.text.content = "Questa è un'email di prova del sistema di monitoraggio della temperatura.";
   }
   else
-    return;
+    return false;
 
-  Serial.println(F("Connecting..."));
-  smtp.connect(&session);
-  // Start sending Email and close the session
-  Serial.println(F("Sending..."));
-  if (!MailClient.sendMail(&smtp, &message))
-    Serial.println("Error sending Email, " + smtp.errorReason());
-  else
-    Serial.println(F("Email sent successfully"));
-  #endif
-  #ifdef NO_MAIL
-  
-  Serial.print("  | Sending mail " + messageType + "  | ");
+  // Queued while the WiFi was down: the temperatures are those of the time of the event
+  unsigned long late = millis() - event.time;
+  if (late >= EMAIL_LATE_NOTICE) message.text.content += "\n\nMessaggio inviato con " + String(late / 60000) + " minuti di ritardo rispetto all'evento.";
 
-  #endif
+  return true;
 }
 
-// Editing of the configuration via the serial interface
-void serialConfiguration() 
+// Copies a value typed in the configuration console to a config field, always terminating it
+void setConfigString(char *field, const char *value, size_t size)
 {
-  char buf[SERIAL_BUFFER_SIZE+1];
-  float floatBuf;
-  int intBuf;
-  bool networkConfigChanged = false;
+  strncpy(field, value, size - 1);
+  field[size - 1] = 0;
+}
 
-  while(true) {
+// Opens the configuration console at its first field. The console only prints and returns: loop() hands it the
+// characters as they arrive, see stepConsole()
+void openConsole()
+{
+  status = CONFIG;
+  setStatusLED(CONFIG);
+  publishMetrics();
+  consoleNetworkChanged = false;
+  consoleConfig = config;
+  configPending = false;  // The values SET are dropped
+  consoleLine.clear();
   Serial.println("\n\n ---- CONFIGURATION ---- ");
   Serial.println("\nYou can digit using your keyboard. Press <ENTER> to confirm the inserted value. If <ENTER> is pressed the previously configured value will remain in memory.");
-  
-  Serial.println("\nNetwork configuration:");
-  userSettings.begin("network");
-  getStringFromSerial(buf, "  SSID (" + userSettings.getString("ssid") + "): ", MODE_CLEAR_TEXT);
-  if(String(buf) != String("")) 
-  {
-    userSettings.putString("ssid", String(buf));
-    networkConfigChanged = true;
-  }
+  Serial.println("The mesurements and the alarms go on while the configuration is open.");
+  enterConsoleStep(STEP_SSID);
+}
 
-  while(true) {
-    Serial.println();
-    getStringFromSerial(buf, "  Are you using enterprise login? yes/no (" + userSettings.getString("isWpaEnterprise") + "): ", MODE_CLEAR_TEXT);
-    if(String(buf) == String("")) break;
-    else if (String(buf) == String("yes") || String(buf) == String("no")) {
-      userSettings.putString("isWpaEnterprise", String(buf));
+// Closes the console, the system status is again the one of the zones
+void closeConsole()
+{
+  consoleStep = STEP_CLOSED;
+  status = worstZoneStatus(zones, zoneCount);
+  setStatusLED(status);
+  publishMetrics();
+  Serial.println("Configuration closed.");
+}
+
+// Feeds the characters received to the line being typed, without waiting for more. A complete line is the
+// answer to the current field
+void stepConsole()
+{
+  while (consoleStep != STEP_CLOSED && Serial.available() > 0)
+  {
+    switch (consoleLine.feed(Serial.read()))
+    {
+    case LINE_CHAR:
+      Serial.write(consoleMasked() ? '*' : consoleLine.line()[consoleLine.length() - 1]);
+      break;
+    case LINE_ERASE:
+      Serial.print("\b \b");
+      break;
+    case LINE_FULL:
+      Serial.write(7);
+      break;
+    case LINE_DONE:
       Serial.println();
+      answerConsole(consoleLine.line());
+      break;
+    default:
       break;
     }
   }
-  Serial.println();
-  if (String(userSettings.getString("isWpaEnterprise")) == String("no")) {
-    getStringFromSerial(buf, "  Password (" + strToAst(userSettings.getString("passwd")) + "): ", MODE_PASSWORD);
-    if(String(buf) != String("")) 
-    {
-      userSettings.putString("passwd", String(buf));
-      networkConfigChanged = true;
-    }
-    Serial.println();
-  } 
-  else if (String(userSettings.getString("isWpaEnterprise")) == String("yes")) 
+}
+
+// Password fields are echoed as asterisks
+bool consoleMasked()
+{
+  return consoleStep == STEP_PASSWORD || consoleStep == STEP_EAP_PASSWORD || consoleStep == STEP_SENDER_PASSWORD;
+}
+
+// Moves to a field, printing the title of its section first
+void enterConsoleStep(uint8_t step)
+{
+  consoleStep = step;
+  switch (step)
   {
-    getStringFromSerial(buf, "  User ID (" + userSettings.getString("eap_id") + "): ", MODE_CLEAR_TEXT);
-    if(String(buf) != String("")) {
-      userSettings.putString("eap_id", String(buf));
-      networkConfigChanged = true;
+  case STEP_SSID:
+    Serial.println("\nNetwork configuration:");
+    break;
+  case STEP_PRE_ALARM:
+    Serial.println("\nTemperature and alarm configuration");
+    Serial.println("Note: Temperatures cannot be set at 0.00 °C");
+    break;
+  case STEP_ZONE_NAME:
+    Serial.println("\nZones configuration");
+    Serial.println("  Sensor " + addressToString(zones[consoleZone].config.address));
+    break;
+  case STEP_SMTP_SERVER:
+    Serial.println("\nEmail configuration");
+    break;
+  }
+  promptConsole();
+}
+
+// Prints the question of the current field with the value in memory
+void promptConsole()
+{
+  switch (consoleStep)
+  {
+  case STEP_SSID: Serial.print("  SSID (" + String(consoleConfig.network.ssid) + "): "); break;
+  case STEP_ENTERPRISE: Serial.print("  Are you using enterprise login? yes/no (" + String(consoleConfig.network.isWpaEnterprise ? "yes" : "no") + "): "); break;
+  case STEP_PASSWORD: Serial.print("  Password (" + strToAst(consoleConfig.network.passwd) + "): "); break;
+  case STEP_EAP_ID: Serial.print("  User ID (" + String(consoleConfig.network.eapID) + "): "); break;
+  case STEP_EAP_USERNAME: Serial.print("  Username (" + String(consoleConfig.network.eapUsername) + "): "); break;
+  case STEP_EAP_PASSWORD: Serial.print("  Password (" + strToAst(consoleConfig.network.eapPassword) + "): "); break;
+  case STEP_PRE_ALARM: Serial.print("  Pre alarm temperature (" + String(consoleConfig.alarms.preAlarmTemperature) + "°C ): "); break;
+  case STEP_ALARM: Serial.print("  Alarm temperature (" + String(consoleConfig.alarms.alarmTemperature) + "°C ): "); break;
+  case STEP_RESET_THRESHOLD: Serial.print("  Alarm reset threshold (" + String(consoleConfig.alarms.alarmResetThreshold) + "°C ): "); break;
+  case STEP_MESURE_INTERVAL: Serial.print("  Intervall between mesurements (" + String(consoleConfig.alarms.mesureInterval) + " seconds): "); break;
+  case STEP_ALARM_INTERVAL: Serial.print("  Time intervall between alarm emails (" + String(consoleConfig.alarms.alarmInterval) + " minutes): "); break;
+  case STEP_ZONE_NAME: Serial.print("  Zone name (" + String(consoleZoneConfig().name) + "): "); break;
+  case STEP_ZONE_PRE_ALARM: Serial.print("  Pre alarm temperature (" + String(consoleZoneConfig().preAlarmTemperature) + "°C ): "); break;
+  case STEP_ZONE_ALARM: Serial.print("  Alarm temperature (" + String(consoleZoneConfig().alarmTemperature) + "°C ): "); break;
+  case STEP_SMTP_SERVER: Serial.print("  SMTP server address (" + String(consoleConfig.email.smtpServer) + "): "); break;
+  case STEP_SMTP_PORT: Serial.print("  SMTP port (" + String(consoleConfig.email.smtpPort) + "): "); break;
+  case STEP_SENDER_ADDRESS: Serial.print("  Sender email address (" + String(consoleConfig.email.senderAddress) + "): "); break;
+  case STEP_SENDER_PASSWORD: Serial.print("  Sender password (" + strToAst(consoleConfig.email.senderPassword) + "): "); break;
+  case STEP_AUTHOR_NAME: Serial.print("  Sender name (" + String(consoleConfig.email.authorName) + "): "); break;
+  case STEP_RECIPIENT: Serial.print("  Recipient email address (" + String(consoleConfig.email.recipient) + "): "); break;
+  case STEP_IM_ALIVE_INTERVAL: Serial.print("  Time intervall between ""I'm alive"" emails (" + String(consoleConfig.email.imAliveInterval) + " hours): "); break;
+  case STEP_TEST_EMAIL: Serial.print("\nDo you want to send a test email? yes/no: "); break;
+  case STEP_CONFIRM: Serial.print("\nConfirm the current configuration? yes/no: "); break;
+  }
+}
+
+// Applies the answer to the current field and moves to the next one. An invalid answer asks the same field again,
+// an empty one keeps the value in memory
+void answerConsole(const char *answer)
+{
+  bool empty = answer[0] == 0;
+  bool yes = strcmp(answer, "yes") == 0;
+  bool yesNo = yes || strcmp(answer, "no") == 0;
+  float temperature;
+  long number;
+  int next;
+
+  switch (consoleStep)
+  {
+  case STEP_SSID:
+    if (!empty)
+    {
+      setConfigString(consoleConfig.network.ssid, answer, sizeof(consoleConfig.network.ssid));
+      consoleNetworkChanged = true;
     }
-    Serial.println();
-    getStringFromSerial(buf, "  Username (" + userSettings.getString("eap_username") + "): ", MODE_CLEAR_TEXT);
-    if(String(buf) != String("")) {
-      userSettings.putString("eap_username", String(buf));
-      networkConfigChanged = true;
+    enterConsoleStep(STEP_ENTERPRISE);
+    return;
+  case STEP_ENTERPRISE:
+    if (!empty && !yesNo) break;
+    if (!empty && consoleConfig.network.isWpaEnterprise != yes)
+    {
+      consoleConfig.network.isWpaEnterprise = yes;
+      consoleNetworkChanged = true;
     }
-    Serial.println();
-    getStringFromSerial(buf, "  Password (" + strToAst(userSettings.getString("eap_password")) + "): ", MODE_PASSWORD);
-    if(String(buf) != String("")) {
-      userSettings.putString("eap_password", String(buf));
-      networkConfigChanged = true;
+    enterConsoleStep(consoleConfig.network.isWpaEnterprise ? STEP_EAP_ID : STEP_PASSWORD);
+    return;
+  case STEP_PASSWORD:
+  case STEP_EAP_ID:
+  case STEP_EAP_USERNAME:
+  case STEP_EAP_PASSWORD:
+    if (!empty)
+    {
+      char *field = consoleStep == STEP_PASSWORD ? consoleConfig.network.passwd :
+                    consoleStep == STEP_EAP_ID ? consoleConfig.network.eapID :
+                    consoleStep == STEP_EAP_USERNAME ? consoleConfig.network.eapUsername : consoleConfig.network.eapPassword;
+      setConfigString(field, answer, CONFIG_STRING_SIZE);
+      consoleNetworkChanged = true;
     }
-    Serial.println();
-  }
-  userSettings.end();
+    enterConsoleStep(consoleStep == STEP_EAP_ID ? STEP_EAP_USERNAME : consoleStep == STEP_EAP_USERNAME ? STEP_EAP_PASSWORD : STEP_PRE_ALARM);
+    return;
 
-  Serial.println("\nTemperature and alarm configuration");
-  Serial.println("Note: Temperatures cannot be set at 0.00 °C");
-  
-  userSettings.begin("alarms");
-  while(true) {
-    do
+  case STEP_PRE_ALARM:
+    if (!empty && !parseConsoleTemperature(answer, temperature)) break;
+    if (!empty) consoleConfig.alarms.preAlarmTemperature = temperature;
+    consoleStep = STEP_ALARM;
+    promptConsole();
+    return;
+  case STEP_ALARM:
+    if (!empty && !parseConsoleTemperature(answer, temperature)) break;
+    if (!empty) consoleConfig.alarms.alarmTemperature = temperature;
+    if (consoleConfig.alarms.preAlarmTemperature >= consoleConfig.alarms.alarmTemperature)
     {
-      Serial.println();
-      getStringFromSerial(buf, "  Pre alarm temperature (" + String(userSettings.getFloat("pre_alarm")) + "°C ): ", MODE_CLEAR_TEXT);
-      if (String(buf).toFloat() != float(0.0) /*This basically means isNaN(buf)*/ && String(buf) != String(""))
-      {
-        userSettings.putFloat("pre_alarm", String(buf).toFloat());
-      }
-      else if (String(buf) == String("")) break;
-    } while (String(buf).toFloat() == float(0.0));
-    
-    do
+      Serial.println("  ERROR! PRE-ALARM TEMPERATURE CANNOT BE GRATER THAN THE ALARM TEMPERATURE!");
+      Serial.println("  Retry.");
+      consoleStep = STEP_PRE_ALARM;
+      promptConsole();
+      return;
+    }
+    enterConsoleStep(STEP_RESET_THRESHOLD);
+    return;
+  case STEP_RESET_THRESHOLD:
+    if (!empty && !parseConsoleTemperature(answer, temperature)) break;
+    if (!empty) consoleConfig.alarms.alarmResetThreshold = temperature;
+    enterConsoleStep(STEP_MESURE_INTERVAL);
+    return;
+  case STEP_MESURE_INTERVAL:
+  case STEP_ALARM_INTERVAL:
+    if (!empty && !parseConsoleNumber(answer, number)) break;
+    if (!empty && consoleStep == STEP_MESURE_INTERVAL) consoleConfig.alarms.mesureInterval = number;
+    else if (!empty) consoleConfig.alarms.alarmInterval = number;
+    if (consoleStep == STEP_MESURE_INTERVAL)
     {
-      Serial.println();
-      getStringFromSerial(buf, "  Alarm temperature (" + String(userSettings.getFloat("alarm_threshold")) + "°C ): ", MODE_CLEAR_TEXT);
-      if (String(buf).toFloat() != float(0.0) && String(buf) != String(""))
-      {
-        userSettings.putFloat("alarm_threshold", String(buf).toFloat());
-      }
-      else if (String(buf) == String("")) break;
-    } while (String(buf).toFloat() == float(0.0));
+      enterConsoleStep(STEP_ALARM_INTERVAL);
+      return;
+    }
+    next = nextConsoleZone(0);
+    if (next == zoneCount)
+    {
+      enterConsoleStep(STEP_SMTP_SERVER);
+      return;
+    }
+    consoleZone = next;
+    enterConsoleStep(STEP_ZONE_NAME);
+    return;
 
-    if(userSettings.getFloat("pre_alarm") < userSettings.getFloat("alarm_threshold")) break;
-    else {
-      Serial.println();
+  case STEP_ZONE_NAME:
+    if (!empty) setConfigString(consoleZoneConfig().name, answer, ZONE_NAME_SIZE);
+    consoleStep = STEP_ZONE_PRE_ALARM;
+    promptConsole();
+    return;
+  case STEP_ZONE_PRE_ALARM:
+    if (!empty && !parseConsoleTemperature(answer, temperature)) break;
+    if (!empty) consoleZoneConfig().preAlarmTemperature = temperature;
+    consoleStep = STEP_ZONE_ALARM;
+    promptConsole();
+    return;
+  case STEP_ZONE_ALARM:
+    if (!empty && !parseConsoleTemperature(answer, temperature)) break;
+    if (!empty) consoleZoneConfig().alarmTemperature = temperature;
+    if (consoleZoneConfig().preAlarmTemperature >= consoleZoneConfig().alarmTemperature)
+    {
       Serial.println("  ERROR! PRE-ALARM TEMPERATURE CANNOT BE GRATER THAN THE ALARM TEMPERATURE!");
       Serial.println("  Retry.");
+      consoleStep = STEP_ZONE_PRE_ALARM;
+      promptConsole();
+      return;
     }
-  }
-
-do
+    next = nextConsoleZone(consoleZone + 1);
+    if (next < zoneCount)
     {
-      Serial.println();
-      getStringFromSerial(buf, "  Alarm reset threshold (" + String(userSettings.getFloat("reset_threshold")) + "°C ): ", MODE_CLEAR_TEXT);
-      if (String(buf).toFloat() != float(0.0) && String(buf) != String(""))
-        userSettings.putFloat("reset_threshold", String(buf).toFloat());
-      else if (String(buf) == String("")) break;
-    } while (String(buf).toFloat() == float(0.0));
+      consoleZone = next;
+      Serial.println("\n  Sensor " + addressToString(zones[consoleZone].config.address));
+      consoleStep = STEP_ZONE_NAME;
+      promptConsole();
+    }
+    else enterConsoleStep(STEP_SMTP_SERVER);
+    return;
 
-  do
+  case STEP_SMTP_SERVER:
+    if (!empty) setConfigString(consoleConfig.email.smtpServer, answer, CONFIG_STRING_SIZE);
+    enterConsoleStep(STEP_SMTP_PORT);
+    return;
+  case STEP_SMTP_PORT:
+    if (!empty && !parseConsoleNumber(answer, number)) break;
+    if (!empty) consoleConfig.email.smtpPort = number;
+    enterConsoleStep(STEP_SENDER_ADDRESS);
+    return;
+  case STEP_SENDER_ADDRESS:
+  case STEP_SENDER_PASSWORD:
+  case STEP_AUTHOR_NAME:
+  case STEP_RECIPIENT:
+    if (!empty)
     {
-      Serial.println();
-      getStringFromSerial(buf, "  Intervall between mesurements (" + String(userSettings.getInt("mesure_interval")) + " seconds): ", MODE_CLEAR_TEXT);
-      sscanf(buf, "%04d", &intBuf);
-      if (intBuf != 0 && String(buf) != String(""))
-      {
-        userSettings.putInt("mesure_interval", intBuf);
-      }
-      else if (String(buf) == String("")) break;
-    } while (String(buf).toInt() == long(0));
+      char *field = consoleStep == STEP_SENDER_ADDRESS ? consoleConfig.email.senderAddress :
+                    consoleStep == STEP_SENDER_PASSWORD ? consoleConfig.email.senderPassword :
+                    consoleStep == STEP_AUTHOR_NAME ? consoleConfig.email.authorName : consoleConfig.email.recipient;
+      setConfigString(field, answer, CONFIG_STRING_SIZE);
+    }
+    enterConsoleStep(consoleStep + 1);
+    return;
+  case STEP_IM_ALIVE_INTERVAL:
+    if (!empty && !parseConsoleNumber(answer, number)) break;
+    if (!empty) consoleConfig.email.imAliveInterval = number;
+    // All the changes are used and written to the NVS at once
+    if (!installConfig(consoleConfig)) Serial.println("ERROR: the configuration could not be saved.");
+    if (consoleNetworkChanged) wifi.reconnect(millis());
+    consoleNetworkChanged = false;
+    enterConsoleStep(STEP_TEST_EMAIL);
+    return;
 
-    do
+  case STEP_TEST_EMAIL:
+    if (!yesNo) break;
+    if (yes)
     {
-      Serial.println();
-      getStringFromSerial(buf, "  Time intervall between alarm emails (" + String(userSettings.getInt("alarm_interval")) + " minutes): ", MODE_CLEAR_TEXT);
-      sscanf(buf, "%04d", &intBuf);
-      if (intBuf != 0 && String(buf) != String(""))
-      {
-        userSettings.putInt("alarm_interval", intBuf);
-      }
-      else if (String(buf) == String("")) break;
-    } while (String(buf).toInt() == long(0));
-    Serial.println();
-  
-  userSettings.end();
+      Serial.println("Test email queued, it will be sent in background as soon as the WiFi is connected ...");
+      queueEmail("TEST");
+    }
+    Serial.println("\nConfiguration completed.");
+    #ifdef DEBUG
+    printConfig(MODE_CLEAR_TEXT);
+    #endif
+    #ifndef DEBUG
+    printConfig(MODE_PASSWORD);
+    #endif
+    enterConsoleStep(STEP_CONFIRM);
+    return;
+  case STEP_CONFIRM:
+    if (!yesNo) break;
+    if (!yes) openConsole();
+    else closeConsole();
+    return;
+  }
+  promptConsole();  // Invalid answer
+}
 
-  Serial.println("Email configuration");
-  userSettings.begin("email");
-  getStringFromSerial(buf, "  SMTP server address (" + userSettings.getString("smtp_server") + "): ", MODE_CLEAR_TEXT);
-  if(String(buf) != String("")) userSettings.putString("smtp_server", String(buf));
+// A temperature typed in the console, 0 is refused like text
+bool parseConsoleTemperature(const char *answer, float &temperature)
+{
+  temperature = String(answer).toFloat();
+  return temperature != float(0.0);
+}
 
-  do {
-    Serial.println();
-    getStringFromSerial(buf, "  SMTP port (" + String(userSettings.getUInt("smpt_port")) + "): ", MODE_CLEAR_TEXT);
-    sscanf(buf, "%04u", &intBuf);
-    if(intBuf != 0 && String(buf) != String("")) {
-      userSettings.putUInt("smpt_port", intBuf);
-    }
-    else if (String(buf) == String("")) break;
-  } while(String(buf).toInt() == long(0));
+// A positive number of at most 4 digits typed in the console
+bool parseConsoleNumber(const char *answer, long &number)
+{
+  char *end;
+  number = strtol(answer, &end, 10);
+  return *end == 0 && number > 0 && number <= 9999;
+}
 
-  Serial.println();
-  getStringFromSerial(buf, "  Sender email address (" + userSettings.getString("sender_address") + "): ", MODE_CLEAR_TEXT);
-  if(String(buf) != String("")) userSettings.putString("sender_address", String(buf));
-  Serial.println();
-  getStringFromSerial(buf, "  Sender password (" + strToAst((userSettings.getString("sender_password"))) + "): ", MODE_PASSWORD);
-  if(String(buf) != String("")) userSettings.putString("sender_password", String(buf));
-  Serial.println();
-  getStringFromSerial(buf, "  Sender name (" + userSettings.getString("author_name") + "): ", MODE_CLEAR_TEXT);
-  if(String(buf) != String("")) userSettings.putString("author_name", String(buf));
-  Serial.println();
-  getStringFromSerial(buf, "  Recipient email address (" + userSettings.getString("recipient_1") + "): ", MODE_CLEAR_TEXT);
-  if(String(buf) != String("")) userSettings.putString("recipient_1", String(buf));
-  
-  do
-    {
-      Serial.println();
-      getStringFromSerial(buf, "  Time intervall between ""I'm alive"" emails (" + String(userSettings.getInt("imAlive_intrvl")) + " hours): ", MODE_CLEAR_TEXT);
-      sscanf(buf, "%04d", &intBuf);
-      if (intBuf != 0 && String(buf) != String(""))
-      {
-        userSettings.putInt("imAlive_intrvl", intBuf);
-      }
-      else if (String(buf) == String("")) break;
-    } while (String(buf).toInt() == long(0));
-    Serial.println();
+// Index of the first zone with a sensor from "from" on, zoneCount if none
+int nextConsoleZone(int from)
+{
+  while (from < zoneCount && zones[from].device < 0) from++;
+  return from;
+}
 
-  userSettings.end();
-  
-  while(true) {
-    Serial.println();
-    
-    getStringFromSerial(buf, "Do you want to send a test email? yes/no: ", MODE_CLEAR_TEXT);
-    if (String(buf) == String("yes") || String(buf) == String("no")) break;
+// Settings of the zone being edited in consoleConfig. The console only edits zones with a sensor, which have a slot
+zoneConfig &consoleZoneConfig()
+{
+  return consoleConfig.zones[zones[consoleZone].nvsSlot];
+}
+
+// Makes newConfig the configuration in use and saves it. The zones are evaluated against their new thresholds from
+// the next reading and the email task uses the new settings from the next message. The configuration is applied
+// even if the NVS write fails, so that the device never runs with values that differ from "config"; false is
+// returned in that case
+bool installConfig(const deviceConfig &newConfig)
+{
+  config = newConfig;
+  bool saved = saveConfig(config);
+  publishEmailSettings();
+  for (int i = 0; i < zoneCount; i++)
+  {
+    zone &z = zones[i];
+    if (z.nvsSlot < 0) continue;
+    z.config = config.zones[z.nvsSlot];
+    programSensorAlarm(buses, z);
   }
-  Serial.println();
-  if (String(buf) == String("yes")) {
-    if(networkConfigChanged)
-    {
-      Serial.println("WARNING: The network configuration has changed. A reboot is needed to establish the connection. Before the reboot emails could NOT be sent.");
-      delay(6000);
-      Serial.println("After the reboot, you can come back here without making further changes to send a test email. To reboot answer 'yes' to the next question.");
-      delay(6000);
-    } 
-    else 
+  applyConfig();
+  publishMetrics();
+  return saved;
+}
+
+// Compares the settings the WiFi connection is made with. Field by field: the bytes after the terminator of the
+// strings and the padding of the structure may differ between two equal configurations
+bool networkSettingsChanged(const networkConfig &from, const networkConfig &to)
+{
+  return strcmp(from.ssid, to.ssid) != 0 || from.isWpaEnterprise != to.isWpaEnterprise ||
+         strcmp(from.passwd, to.passwd) != 0 || strcmp(from.eapID, to.eapID) != 0 ||
+         strcmp(from.eapUsername, to.eapUsername) != 0 || strcmp(from.eapPassword, to.eapPassword) != 0;
+}
+
+// Converts the intervals of the configuration to the running values, the zones keep their alarm state
+void applyConfig()
+{
+  unsigned long previousImAlive = imAliveIntervall;
+  mesurementInterval = config.alarms.mesureInterval*1000;
+  #ifdef FIXED_SAMPLING
+  samplingPeriod = mesurementInterval;
+  #else
+  samplingPeriod = samplingInterval(samplingLevel, mesurementInterval);
+  #endif
+  alarmEmailInterval = config.alarms.alarmInterval*60000;   // 1 min = 60000 ms
+  imAliveIntervall = config.email.imAliveInterval*3600000;  // 1 hr = 3600000 ms
+  zoneRules.alarm.notifyInterval = alarmEmailInterval;
+  for (int i = 0; i < zoneCount; i++) setZoneThresholds(zones[i], config.alarms.alarmResetThreshold);  // The reset threshold may have changed
+  if (imAliveIntervall != previousImAlive) scheduler.schedule(imAliveJob, nowMs() + imAliveIntervall);
+}
+
+#ifdef MQTT_TELEMETRY
+// Adds the readings queued by loop() to the batch and lets the client work, then sleeps until it needs to run
+// again or loop() queues new readings
+void telemetryTask(void *parameter)
+{
+  uint32_t wait = 0;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, wait == MQTT_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+    telemetrySample sample;
+    while (telemetryQueue.pop(sample)) telemetry.add(sample, millis());
+    // Without WiFi a connection could only fail, the readings keep being batched
+    wait = WiFi.status() == WL_CONNECTED ? telemetry.poll(millis()) : WIFI_CHECK_INTERVAL;
+  }
+}
+#endif
+
+// Copies the zones to the metrics snapshot, the metrics task adds the values it can read by itself
+void publishMetrics()
+{
+  deviceMetrics &m = metricsSnapshot.back();
+  m.status = status;
+  m.zoneCount = zoneCount;
+  for (int i = 0; i < zoneCount; i++)
+  {
+    zoneMetrics &zm = m.zones[i];
+    memcpy(zm.address, zones[i].config.address, sizeof(DeviceAddress));
+    memcpy(zm.name, zones[i].config.name, ZONE_NAME_SIZE);
+    zm.raw = zones[i].tempRaw;
+    zm.status = zones[i].alarm.status;
+    zm.failedReadings = zones[i].alarm.failedReadings;
+    zm.rejectedPowerOn = zones[i].filter.rejectedPowerOn;
+    zm.rejectedSlew = zones[i].filter.rejectedSlew;
+  }
+  metricsSnapshot.publish();
+}
+
+// Accepts the connections on METRICS_PORT one after the other, sleeping in accept() between them
+void metricsTask(void *parameter)
+{
+  for (;;)
+  {
+    int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(METRICS_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, METRICS_BACKLOG) < 0)
     {
-      delay(500);
-      Serial.println("Sending email ...");
-      delay(300);
-      sendEmail("TEST");
+      Serial.println("ERROR: metrics server not started, retrying");
+      if (listener >= 0) close(listener);
+      vTaskDelay(pdMS_TO_TICKS(10000));
+      continue;
     }
-  } else delay(500);
 
-  Serial.println();
-  Serial.println();
-  delay(700);
-  Serial.println("Configuration completed.");
-  delay(700);
+    int client;
+    while ((client = accept(listener, NULL, NULL)) >= 0)
+    {
+      serveMetrics(client);
+      close(client);
+    }
+    close(listener);
+  }
+}
 
-  #ifdef DEBUG
-  printConfig(MODE_CLEAR_TEXT);
-  #endif
-  #ifndef DEBUG
-  printConfig(MODE_PASSWORD);
-  #endif
+// Reads the request head and answers GET /metrics with the latest snapshot, anything else with 404. A client that
+// stops reading gets METRICS_TIMEOUT per send(), then the answer is dropped and metricsTask() closes the socket
+void serveMetrics(int client)
+{
+  static char request[METRICS_REQUEST_SIZE];
+  static char body[METRICS_BUFFER_SIZE];
+  static deviceMetrics metrics;
+
+  timeval timeout = {METRICS_TIMEOUT / 1000, (METRICS_TIMEOUT % 1000) * 1000};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  size_t length = 0;
+  while (length < sizeof(request) - 1)
+  {
+    int n = recv(client, request + length, sizeof(request) - 1 - length, 0);
+    if (n <= 0) break;
+    length += n;
+    request[length] = 0;
+    if (strstr(request, "\r\n\r\n")) break;
+  }
+  request[length] = 0;
 
-  while(true) {
-    Serial.println();
-    getStringFromSerial(buf, "Confirm the current configuration? yes/no: ", MODE_CLEAR_TEXT);
-    if (String(buf) == String("yes") || String(buf) == String("no")) break;
+  const char *notFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  if (strncmp(request, "GET /metrics", 12) != 0 || (request[12] != ' ' && request[12] != '?'))
+  {
+    sendMetrics(client, notFound, strlen(notFound));
+    return;
   }
-  Serial.println();
-  if (String(buf) == String("yes")) {
-    delay(500);
-    Serial.println("Restarting system ...");
-    delay(500);
-    ESP.restart();
-  } else delay(1500);
+
+  metrics = metricsSnapshot.latest();
+  metrics.uptime = uptimeSeconds();
+  metrics.wifiConnected = WiFi.status() == WL_CONNECTED;
+  metrics.rssi = metrics.wifiConnected ? WiFi.RSSI() : 0;
+  metrics.emailsSent = emailsSent.load(std::memory_order_relaxed);
+  metrics.emailsFailed = emailsFailed.load(std::memory_order_relaxed);
+  metrics.emailsDropped = emailQueue.dropped();
+  size_t bodyLength = formatMetrics(metrics, body, sizeof(body));
+
+  char head[128];
+  int headLength = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: %u\r\nConnection: close\r\n\r\n", (unsigned)bodyLength);
+  if (sendMetrics(client, head, headLength)) sendMetrics(client, body, bodyLength);
+}
+
+// Sends all the data, false if the client went away or did not take it within METRICS_TIMEOUT
+bool sendMetrics(int client, const char *data, size_t length)
+{
+  for (size_t sent = 0; sent < length;)
+  {
+    int n = send(client, data + sent, length - sent, 0);
+    if (n <= 0) return false;
+    sent += n;
   }
+  return true;
 }
@@ -0,0 +1,63 @@
+// Retry waits of the WiFi link and the MQTT client:
+//   pio test -e native -f test_backoff
+
+#include <unity.h>
+#include "Backoff.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_the_wait_doubles_in_its_upper_half()
+{
+  Backoff backoff(1000, 300000, 42);
+  uint32_t limit = 1000;
+  for (int i = 0; i < 8; i++)
+  {
+    uint32_t wait = backoff.next();
+    TEST_ASSERT_TRUE(wait >= limit / 2 && wait <= limit);
+    limit *= 2;
+  }
+  TEST_ASSERT_EQUAL(8, backoff.failures());
+}
+
+void test_the_wait_stops_at_the_maximum()
+{
+  Backoff backoff(5000, 300000, 7);
+  for (int i = 0; i < 300; i++)
+  {
+    uint32_t wait = backoff.next();
+    TEST_ASSERT_TRUE(wait <= 300000);
+    if (i >= 6) TEST_ASSERT_TRUE(wait >= 150000);  // 5000 << 6 is over the maximum
+  }
+  TEST_ASSERT_EQUAL(UINT8_MAX, backoff.failures());  // Saturates, the shift never overflows
+}
+
+void test_reset_starts_from_the_minimum()
+{
+  Backoff backoff(1000, 300000, 42);
+  for (int i = 0; i < 10; i++) backoff.next();
+  backoff.reset();
+  TEST_ASSERT_EQUAL(0, backoff.failures());
+  TEST_ASSERT_TRUE(backoff.next() <= 1000);
+}
+
+void test_the_seed_spreads_the_waits()
+{
+  Backoff a(300000, 300000, 1);
+  Backoff b(300000, 300000, 2);
+  Backoff zero(300000, 300000, 0);  // Would stay 0 forever in xorshift, taken as 1
+  TEST_ASSERT_TRUE(a.next() != b.next());
+  Backoff one(300000, 300000, 1);
+  TEST_ASSERT_EQUAL(one.next(), zero.next());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_the_wait_doubles_in_its_upper_half);
+  RUN_TEST(test_the_wait_stops_at_the_maximum);
+  RUN_TEST(test_reset_starts_from_the_minimum);
+  RUN_TEST(test_the_seed_spreads_the_waits);
+  return UNITY_END();
+}
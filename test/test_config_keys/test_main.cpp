@@ -0,0 +1,183 @@
+// Configuration fields read and written as text by the serial commands:
+//   pio test -e native -f test_config_keys
+
+#include <unity.h>
+#include <string.h>
+#include "ConfigKeys.h"
+
+deviceConfig cfg;
+char value[CONFIG_VALUE_SIZE];
+
+const configKey &deviceKey(const char *name)
+{
+  const configKey *key = findConfigKey(deviceKeys, deviceKeyCount, name);
+  TEST_ASSERT_NOT_NULL(key);
+  return *key;
+}
+
+const configKey &zoneKey(const char *name)
+{
+  const configKey *key = findConfigKey(zoneKeys, zoneKeyCount, name);
+  TEST_ASSERT_NOT_NULL(key);
+  return *key;
+}
+
+// Sets the key from "text" and reads it back
+const char *roundTrip(void *base, const configKey &key, const char *text)
+{
+  TEST_ASSERT_EQUAL(CONFIG_OK, parseConfigValue(base, key, text));
+  formatConfigValue(base, key, value, sizeof(value));
+  return value;
+}
+
+void setUp()
+{
+  memset(&cfg, 0, sizeof(cfg));
+}
+
+void tearDown() {}
+
+void test_unknown_keys_are_not_found()
+{
+  TEST_ASSERT_NULL(findConfigKey(deviceKeys, deviceKeyCount, "network"));
+  TEST_ASSERT_NULL(findConfigKey(deviceKeys, deviceKeyCount, "name"));  // A zone key
+  TEST_ASSERT_NULL(findConfigKey(zoneKeys, zoneKeyCount, "network.ssid"));
+}
+
+void test_every_key_is_found_inside_its_structure()
+{
+  for (size_t i = 0; i < deviceKeyCount; i++)
+  {
+    TEST_ASSERT_TRUE(findConfigKey(deviceKeys, deviceKeyCount, deviceKeys[i].name) == &deviceKeys[i]);
+    TEST_ASSERT_TRUE(deviceKeys[i].offset + deviceKeys[i].size <= sizeof(deviceConfig));
+  }
+  for (size_t i = 0; i < zoneKeyCount; i++)
+  {
+    TEST_ASSERT_TRUE(findConfigKey(zoneKeys, zoneKeyCount, zoneKeys[i].name) == &zoneKeys[i]);
+    TEST_ASSERT_TRUE(zoneKeys[i].offset + zoneKeys[i].size <= sizeof(zoneConfig));
+  }
+}
+
+void test_string()
+{
+  const configKey &key = deviceKey("network.ssid");
+  TEST_ASSERT_EQUAL_STRING("Casa Rossi 2.4", roundTrip(&cfg, key, "Casa Rossi 2.4"));
+  TEST_ASSERT_EQUAL_STRING("Casa Rossi 2.4", cfg.network.ssid);
+  TEST_ASSERT_EQUAL_STRING("", roundTrip(&cfg, key, ""));
+}
+
+void test_string_too_long_is_refused()
+{
+  char ssid[WIFI_SSID_SIZE + 2];
+  memset(ssid, 'a', sizeof(ssid) - 1);
+  ssid[WIFI_SSID_SIZE] = 0;
+  TEST_ASSERT_EQUAL_STRING(ssid, roundTrip(&cfg, deviceKey("network.ssid"), ssid));  // Just fits
+  ssid[WIFI_SSID_SIZE] = 'b';
+  ssid[WIFI_SSID_SIZE + 1] = 0;
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, deviceKey("network.ssid"), ssid));
+  TEST_ASSERT_EQUAL(WIFI_SSID_SIZE, strlen(cfg.network.ssid));  // Left as it was
+}
+
+void test_secret_is_masked()
+{
+  const configKey &key = deviceKey("network.passwd");
+  TEST_ASSERT_EQUAL_STRING("s******3", roundTrip(&cfg, key, "segreto3"));
+  TEST_ASSERT_EQUAL_STRING("segreto3", cfg.network.passwd);
+  TEST_ASSERT_EQUAL_STRING("ab", roundTrip(&cfg, key, "ab"));
+  TEST_ASSERT_EQUAL_STRING("", roundTrip(&cfg, key, ""));
+}
+
+void test_bool()
+{
+  const configKey &key = deviceKey("network.isWpaEnterprise");
+  TEST_ASSERT_EQUAL_STRING("yes", roundTrip(&cfg, key, "yes"));
+  TEST_ASSERT_TRUE(cfg.network.isWpaEnterprise);
+  TEST_ASSERT_EQUAL_STRING("no", roundTrip(&cfg, key, "no"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "1"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "YES"));
+  TEST_ASSERT_FALSE(cfg.network.isWpaEnterprise);
+}
+
+void test_float_and_its_limits()
+{
+  const configKey &key = deviceKey("alarms.alarmTemperature");
+  TEST_ASSERT_EQUAL_STRING("37.50", roundTrip(&cfg, key, "37.5"));
+  TEST_ASSERT_EQUAL_STRING("-55.00", roundTrip(&cfg, key, "-55"));
+  TEST_ASSERT_EQUAL_STRING("125.00", roundTrip(&cfg, key, "125"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "125.1"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "-55.5"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "nan"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "30 C"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, ""));
+  TEST_ASSERT_FLOAT_WITHIN(0, 125, cfg.alarms.alarmTemperature);
+}
+
+void test_int_and_its_limits()
+{
+  const configKey &key = deviceKey("email.smtpPort");
+  TEST_ASSERT_EQUAL_STRING("465", roundTrip(&cfg, key, "465"));
+  TEST_ASSERT_EQUAL(465, cfg.email.smtpPort);
+  TEST_ASSERT_EQUAL_STRING("65535", roundTrip(&cfg, key, "65535"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "0"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "65536"));
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&cfg, key, "25.5"));
+  TEST_ASSERT_EQUAL_STRING("30", roundTrip(&cfg, deviceKey("alarms.mesureInterval"), "30"));
+  TEST_ASSERT_EQUAL(30, cfg.alarms.mesureInterval);
+}
+
+void test_zone_keys()
+{
+  zoneConfig &zone = cfg.zones[0];
+  TEST_ASSERT_EQUAL_STRING("Cella frigo", roundTrip(&zone, zoneKey("name"), "Cella frigo"));
+  TEST_ASSERT_EQUAL_STRING("Cella frigo", zone.name);
+  TEST_ASSERT_EQUAL_STRING("-18.25", roundTrip(&zone, zoneKey("preAlarmTemperature"), "-18.25"));
+  char name[ZONE_NAME_SIZE + 1];
+  memset(name, 'n', ZONE_NAME_SIZE);
+  name[ZONE_NAME_SIZE] = 0;
+  TEST_ASSERT_EQUAL(CONFIG_BAD_VALUE, parseConfigValue(&zone, zoneKey("name"), name));
+}
+
+void test_address_is_read_only()
+{
+  const uint8_t address[8] = {0x28, 0xFF, 0x4C, 0x01, 0xA2, 0x16, 0x03, 0x9B};
+  memcpy(cfg.zones[1].address, address, 8);
+  const configKey &key = zoneKey("address");
+  TEST_ASSERT_EQUAL(16, formatConfigValue(&cfg.zones[1], key, value, sizeof(value)));
+  TEST_ASSERT_EQUAL_STRING("28FF4C01A216039B", value);
+  TEST_ASSERT_EQUAL(CONFIG_READ_ONLY, parseConfigValue(&cfg.zones[1], key, "0000000000000000"));
+  TEST_ASSERT_EQUAL_MEMORY(address, cfg.zones[1].address, 8);
+}
+
+void test_a_value_that_does_not_fit_gives_nothing()
+{
+  strcpy(cfg.email.recipient, "allarmi@example.com");
+  const configKey &key = deviceKey("email.recipient");
+  TEST_ASSERT_EQUAL(0, formatConfigValue(&cfg, key, value, 10));
+  TEST_ASSERT_EQUAL_STRING("", value);
+  TEST_ASSERT_EQUAL(19, formatConfigValue(&cfg, key, value, 20));
+}
+
+void test_status_names()
+{
+  TEST_ASSERT_EQUAL_STRING("OK", configStatusName(CONFIG_OK));
+  TEST_ASSERT_EQUAL_STRING("SAVE_FAILED", configStatusName(CONFIG_SAVE_FAILED));
+  TEST_ASSERT_EQUAL_STRING("ERROR", configStatusName((config_status)(CONFIG_SAVE_FAILED + 1)));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_unknown_keys_are_not_found);
+  RUN_TEST(test_every_key_is_found_inside_its_structure);
+  RUN_TEST(test_string);
+  RUN_TEST(test_string_too_long_is_refused);
+  RUN_TEST(test_secret_is_masked);
+  RUN_TEST(test_bool);
+  RUN_TEST(test_float_and_its_limits);
+  RUN_TEST(test_int_and_its_limits);
+  RUN_TEST(test_zone_keys);
+  RUN_TEST(test_address_is_read_only);
+  RUN_TEST(test_a_value_that_does_not_fit_gives_nothing);
+  RUN_TEST(test_status_names);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+// Line typed on the serial port, one byte at a time:
+//   pio test -e native -f test_line_editor
+
+#include <unity.h>
+#include <string.h>
+#include "LineEditor.h"
+
+LineEditor editor;
+
+// Feeds the bytes and returns the event of the last one
+line_event feed(const char *bytes)
+{
+  line_event event = LINE_NONE;
+  for (const char *c = bytes; *c; c++) event = editor.feed(*c);
+  return event;
+}
+
+void setUp()
+{
+  editor = LineEditor();
+}
+
+void tearDown() {}
+
+void test_characters_are_added()
+{
+  TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('a'));
+  TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('b'));
+  TEST_ASSERT_EQUAL_STRING("ab", editor.line());
+  TEST_ASSERT_EQUAL(2, editor.length());
+}
+
+void test_crlf_ends_one_line()
+{
+  feed("ssid");
+  TEST_ASSERT_EQUAL(LINE_DONE, editor.feed('\r'));
+  TEST_ASSERT_EQUAL_STRING("ssid", editor.line());
+  // The LF of the pair neither ends an empty line nor clears the one taken
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed('\n'));
+  TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('x'));
+  TEST_ASSERT_EQUAL_STRING("x", editor.line());
+}
+
+void test_lf_only_ends_the_line()
+{
+  TEST_ASSERT_EQUAL(LINE_DONE, feed("yes\n"));
+  TEST_ASSERT_EQUAL_STRING("yes", editor.line());
+  TEST_ASSERT_EQUAL(LINE_DONE, feed("no\n"));
+  TEST_ASSERT_EQUAL_STRING("no", editor.line());
+}
+
+void test_cr_only_ends_the_line()
+{
+  TEST_ASSERT_EQUAL(LINE_DONE, feed("25\r"));
+  TEST_ASSERT_EQUAL_STRING("25", editor.line());
+  TEST_ASSERT_EQUAL(LINE_DONE, feed("30\r"));
+  TEST_ASSERT_EQUAL_STRING("30", editor.line());
+}
+
+void test_empty_lines()
+{
+  // An empty answer keeps the value in memory, it must come through as an empty line
+  TEST_ASSERT_EQUAL(LINE_DONE, editor.feed('\n'));
+  TEST_ASSERT_EQUAL_STRING("", editor.line());
+  TEST_ASSERT_EQUAL(LINE_DONE, editor.feed('\n'));
+  TEST_ASSERT_EQUAL(LINE_DONE, feed("\r\n\r"));
+  TEST_ASSERT_EQUAL(0, editor.length());
+}
+
+void test_backspace_and_del_erase()
+{
+  feed("abc");
+  TEST_ASSERT_EQUAL(LINE_ERASE, editor.feed('\b'));
+  TEST_ASSERT_EQUAL_STRING("ab", editor.line());
+  TEST_ASSERT_EQUAL(LINE_ERASE, editor.feed(127));
+  TEST_ASSERT_EQUAL_STRING("a", editor.line());
+}
+
+void test_backspace_at_column_0()
+{
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed('\b'));
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed(127));
+  TEST_ASSERT_EQUAL(0, editor.length());
+  feed("a\b");
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed('\b'));
+  TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('b'));
+  TEST_ASSERT_EQUAL_STRING("b", editor.line());
+}
+
+void test_control_characters_are_ignored()
+{
+  // ESC of an arrow key sequence, and tab
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed(27));
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed('\t'));
+  TEST_ASSERT_EQUAL(0, editor.length());
+}
+
+void test_overflow_drops_the_extra_characters()
+{
+  for (int i = 0; i < LINE_EDITOR_SIZE; i++) TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('a' + i % 26));
+  TEST_ASSERT_EQUAL(LINE_FULL, editor.feed('x'));
+  TEST_ASSERT_EQUAL(LINE_FULL, editor.feed('y'));
+  TEST_ASSERT_EQUAL(LINE_EDITOR_SIZE, editor.length());
+  TEST_ASSERT_EQUAL(LINE_EDITOR_SIZE, strlen(editor.line()));
+  // Room again after an erase, and the line still ends normally
+  TEST_ASSERT_EQUAL(LINE_ERASE, editor.feed('\b'));
+  TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('z'));
+  TEST_ASSERT_EQUAL(LINE_DONE, editor.feed('\n'));
+  TEST_ASSERT_EQUAL('z', editor.line()[LINE_EDITOR_SIZE - 1]);
+  TEST_ASSERT_EQUAL(LINE_CHAR, editor.feed('n'));
+  TEST_ASSERT_EQUAL_STRING("n", editor.line());
+}
+
+void test_clear_keeps_the_lf_of_a_crlf_pair()
+{
+  // The console clears the editor when a command line, ended by CR, opens it
+  feed("config\r");
+  editor.clear();
+  TEST_ASSERT_EQUAL(LINE_NONE, editor.feed('\n'));
+  TEST_ASSERT_EQUAL(LINE_DONE, editor.feed('\n'));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_characters_are_added);
+  RUN_TEST(test_crlf_ends_one_line);
+  RUN_TEST(test_lf_only_ends_the_line);
+  RUN_TEST(test_cr_only_ends_the_line);
+  RUN_TEST(test_empty_lines);
+  RUN_TEST(test_backspace_and_del_erase);
+  RUN_TEST(test_backspace_at_column_0);
+  RUN_TEST(test_control_characters_are_ignored);
+  RUN_TEST(test_overflow_drops_the_extra_characters);
+  RUN_TEST(test_clear_keeps_the_lf_of_a_crlf_pair);
+  return UNITY_END();
+}
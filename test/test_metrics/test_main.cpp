@@ -0,0 +1,133 @@
+// Prometheus rendering of the monitor state, compared with the expected text:
+//   pio test -e native -f test_metrics
+
+#include <unity.h>
+#include <string.h>
+#include "AlarmEngine.h"
+#include "Metrics.h"
+
+deviceMetrics metrics;
+char body[4096];
+
+// Two zones: one in pre alarm with a name to escape, one whose sensor never gave a reading
+void setUp()
+{
+  metrics = deviceMetrics();
+  metrics.uptime = 3600;
+  metrics.status = PRE_ALARM;
+  metrics.wifiConnected = true;
+  metrics.rssi = -67;
+  metrics.emailsSent = 12;
+  metrics.emailsFailed = 1;
+  metrics.emailsDropped = 0;
+  metrics.zoneCount = 2;
+
+  zoneMetrics &rack = metrics.zones[0];
+  const uint8_t rackAddress[8] = {0x28, 0xD4, 0xC3, 0xB2, 0xA1, 0x00, 0x00, 0x5E};
+  memcpy(rack.address, rackAddress, 8);
+  strcpy(rack.name, "Rack \"A\"\\1\nnord");
+  rack.raw = 3904;  // 30.5 °C
+  rack.status = PRE_ALARM;
+  rack.failedReadings = 0;
+  rack.rejectedPowerOn = 2;
+  rack.rejectedSlew = 5;
+
+  zoneMetrics &cellar = metrics.zones[1];
+  const uint8_t cellarAddress[8] = {0x10, 0x01, 0x00, 0xFE, 0xCA, 0x00, 0x00, 0x9A};
+  memcpy(cellar.address, cellarAddress, 8);
+  strcpy(cellar.name, "Cellar");
+  cellar.raw = DEVICE_DISCONNECTED_RAW;
+  cellar.status = SENSOR_FAILURE;
+  cellar.failedReadings = 7;
+  cellar.rejectedPowerOn = 0;
+  cellar.rejectedSlew = 0;
+}
+
+void tearDown() {}
+
+const char *golden =
+  "# HELP tempmon_uptime_seconds Seconds since startup\n"
+  "# TYPE tempmon_uptime_seconds counter\n"
+  "tempmon_uptime_seconds 3600\n"
+  "# HELP tempmon_status System status: 0 idle, 1 pre alarm, 2 alarm, 3 sensor failure, 4 configuration\n"
+  "# TYPE tempmon_status gauge\n"
+  "tempmon_status 1\n"
+  "# HELP tempmon_wifi_rssi_dbm Signal strength of the access point\n"
+  "# TYPE tempmon_wifi_rssi_dbm gauge\n"
+  "tempmon_wifi_rssi_dbm -67\n"
+  "# HELP tempmon_emails_sent_total Emails accepted by the SMTP server\n"
+  "# TYPE tempmon_emails_sent_total counter\n"
+  "tempmon_emails_sent_total 12\n"
+  "# HELP tempmon_emails_failed_total Emails that could not be sent\n"
+  "# TYPE tempmon_emails_failed_total counter\n"
+  "tempmon_emails_failed_total 1\n"
+  "# HELP tempmon_emails_dropped_total Emails dropped because the queue was full\n"
+  "# TYPE tempmon_emails_dropped_total counter\n"
+  "tempmon_emails_dropped_total 0\n"
+  "# HELP tempmon_temperature_celsius Last valid reading of the zone\n"
+  "# TYPE tempmon_temperature_celsius gauge\n"
+  "tempmon_temperature_celsius{zone=\"Rack \\\"A\\\"\\\\1\\nnord\",sensor=\"28D4C3B2A100005E\"} 30.5000\n"
+  "# HELP tempmon_zone_status Status of the zone, same values as tempmon_status\n"
+  "# TYPE tempmon_zone_status gauge\n"
+  "tempmon_zone_status{zone=\"Rack \\\"A\\\"\\\\1\\nnord\",sensor=\"28D4C3B2A100005E\"} 1\n"
+  "tempmon_zone_status{zone=\"Cellar\",sensor=\"100100FECA00009A\"} 3\n"
+  "# HELP tempmon_sensor_errors Consecutive failed readings of the sensor\n"
+  "# TYPE tempmon_sensor_errors gauge\n"
+  "tempmon_sensor_errors{zone=\"Rack \\\"A\\\"\\\\1\\nnord\",sensor=\"28D4C3B2A100005E\"} 0\n"
+  "tempmon_sensor_errors{zone=\"Cellar\",sensor=\"100100FECA00009A\"} 7\n"
+  "# HELP tempmon_readings_rejected_total Readings dropped by the zone filter\n"
+  "# TYPE tempmon_readings_rejected_total counter\n"
+  "tempmon_readings_rejected_total{zone=\"Rack \\\"A\\\"\\\\1\\nnord\",sensor=\"28D4C3B2A100005E\",reason=\"power_on\"} 2\n"
+  "tempmon_readings_rejected_total{zone=\"Rack \\\"A\\\"\\\\1\\nnord\",sensor=\"28D4C3B2A100005E\",reason=\"slew\"} 5\n"
+  "tempmon_readings_rejected_total{zone=\"Cellar\",sensor=\"100100FECA00009A\",reason=\"power_on\"} 0\n"
+  "tempmon_readings_rejected_total{zone=\"Cellar\",sensor=\"100100FECA00009A\",reason=\"slew\"} 0\n";
+
+void test_golden_output()
+{
+  size_t length = formatMetrics(metrics, body, sizeof(body));
+  TEST_ASSERT_EQUAL_STRING(golden, body);
+  TEST_ASSERT_EQUAL(strlen(golden), length);
+}
+
+void test_rssi_is_absent_without_wifi()
+{
+  metrics.wifiConnected = false;
+  TEST_ASSERT_TRUE(formatMetrics(metrics, body, sizeof(body)) > 0);
+  TEST_ASSERT_NULL(strstr(body, "tempmon_wifi_rssi_dbm"));
+}
+
+void test_a_negative_reading()
+{
+  metrics.zones[0].raw = -1000;  // -7.8125 °C
+  formatMetrics(metrics, body, sizeof(body));
+  TEST_ASSERT_NOT_NULL(strstr(body, "sensor=\"28D4C3B2A100005E\"} -7.8125\n"));
+}
+
+void test_no_zones()
+{
+  metrics.zoneCount = 0;
+  formatMetrics(metrics, body, sizeof(body));
+  TEST_ASSERT_NULL(strstr(body, "{zone="));
+  TEST_ASSERT_NOT_NULL(strstr(body, "# TYPE tempmon_zone_status gauge\n"));
+}
+
+void test_a_buffer_too_small_gives_nothing()
+{
+  size_t length = strlen(golden);
+  memset(body, 'x', sizeof(body));
+  TEST_ASSERT_EQUAL(0, formatMetrics(metrics, body, length));  // No room for the terminator
+  TEST_ASSERT_EQUAL(0, body[0]);
+  TEST_ASSERT_EQUAL(length, formatMetrics(metrics, body, length + 1));
+  TEST_ASSERT_EQUAL(0, formatMetrics(metrics, body, 0));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_golden_output);
+  RUN_TEST(test_rssi_is_absent_without_wifi);
+  RUN_TEST(test_a_negative_reading);
+  RUN_TEST(test_no_zones);
+  RUN_TEST(test_a_buffer_too_small_gives_nothing);
+  return UNITY_END();
+}
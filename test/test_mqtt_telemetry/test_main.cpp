@@ -0,0 +1,257 @@
+// MQTT batches of readings, published to a fake broker connection:
+//   pio test -e native -f test_mqtt_telemetry
+
+#include <unity.h>
+#include <string.h>
+#include "MqttTelemetry.h"
+
+#define BATCH_SAMPLES 12  // As the device
+#define BATCH_AGE 300000
+
+// Takes the packets the client writes, one per write(). CONNACK and PINGRESP are answered at once, the PUBACKs
+// only while acking is set
+class FakeBroker : public MqttTransport
+{
+public:
+  bool online = true;
+  bool acking = true;
+  bool open = false;
+  int connects = 0;
+  int publishes = 0;
+  int samples = 0;  // Readings in the payloads, duplicates apart
+  char firstPayload[MQTT_PAYLOAD_SIZE + 1] = {};
+  uint16_t lastId = 0;
+  bool lastDup = false;
+  char lastPayload[MQTT_PAYLOAD_SIZE + 1] = {};
+  uint8_t output[64];
+  size_t outputLength = 0;
+
+  bool connect(const char *, uint16_t) override
+  {
+    connects++;
+    open = online;
+    outputLength = 0;
+    return open;
+  }
+  bool connected() override { return open; }
+  void stop() override { open = false; }
+
+  size_t write(const uint8_t *data, size_t length) override
+  {
+    if (!open) return 0;
+    size_t n = 1, remaining = 0, multiplier = 1;
+    do
+    {
+      remaining += (data[n] & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while (data[n++] & 0x80);
+    const uint8_t *body = data + n;
+    switch (data[0] & 0xF0)
+    {
+      case 0x10:  // CONNECT
+        answer(0x20, 0);
+        break;
+      case 0x30:  // PUBLISH
+      {
+        size_t topicLength = body[0] << 8 | body[1];
+        size_t payload = 2 + topicLength + 2;
+        publishes++;
+        lastId = body[2 + topicLength] << 8 | body[3 + topicLength];
+        lastDup = data[0] & 0x08;
+        memcpy(lastPayload, body + payload, remaining - payload);
+        lastPayload[remaining - payload] = 0;
+        if (publishes == 1) strcpy(firstPayload, lastPayload);
+        if (!lastDup)
+        {
+          for (const char *c = lastPayload; *c; c++) samples += *c == '[';
+          samples--;  // The "[" of the list
+        }
+        if (acking) ack(lastId);
+        break;
+      }
+      case 0xC0:  // PINGREQ
+        output[outputLength++] = 0xD0;
+        output[outputLength++] = 0;
+        break;
+    }
+    return length;
+  }
+
+  size_t read(uint8_t *data, size_t length) override
+  {
+    if (!open) return 0;
+    if (length > outputLength) length = outputLength;
+    memcpy(data, output, length);
+    memmove(output, output + length, outputLength - length);
+    outputLength -= length;
+    return length;
+  }
+
+  void ack(uint16_t id) { answer(0x40, id); }
+
+  void answer(uint8_t type, uint16_t id)
+  {
+    output[outputLength++] = type;
+    output[outputLength++] = 2;
+    output[outputLength++] = id >> 8;
+    output[outputLength++] = id & 0xFF;
+  }
+};
+
+FakeBroker broker;
+const mqttSettings settings = {"broker", 1883, "tempmon-test", "tempmon/test", BATCH_SAMPLES, BATCH_AGE};
+
+// Readings of zone 0, one per second from "first"
+void addReadings(MqttTelemetry &client, int count, uint32_t first, uint32_t now)
+{
+  for (int i = 0; i < count; i++) client.add({0, first + i, (int16_t)(2560 + first + i)}, now);
+}
+
+// Polls at the times the client asks for, as loop() does, up to "until" excluded. Returns the time reached
+uint32_t run(MqttTelemetry &client, uint32_t now, uint32_t until)
+{
+  while (now < until)
+  {
+    uint32_t wait = client.poll(now);
+    now = wait < until - now ? now + wait : until;
+  }
+  return now;
+}
+
+void setUp()
+{
+  broker = FakeBroker();
+}
+
+void tearDown() {}
+
+void test_a_batch_is_published_at_12_readings()
+{
+  MqttTelemetry client(broker, settings, 1);
+  client.poll(0);
+  TEST_ASSERT_TRUE(client.connected());
+
+  addReadings(client, BATCH_SAMPLES - 1, 0, 1000);
+  client.poll(1000);
+  TEST_ASSERT_EQUAL(0, broker.publishes);
+  addReadings(client, 1, BATCH_SAMPLES - 1, 2000);
+  client.poll(2000);
+  TEST_ASSERT_EQUAL(1, broker.publishes);
+  TEST_ASSERT_EQUAL(BATCH_SAMPLES, broker.samples);
+  TEST_ASSERT_EQUAL_STRING("{\"t\":0,\"s\":[[0,0,2560],[0,1,2561],[0,2,2562],[0,3,2563],[0,4,2564],[0,5,2565],"
+                           "[0,6,2566],[0,7,2567],[0,8,2568],[0,9,2569],[0,10,2570],[0,11,2571]]}", broker.lastPayload);
+  client.poll(2100);
+  TEST_ASSERT_EQUAL(1, client.stats().acked);
+}
+
+void test_a_batch_is_published_when_5_minutes_old()
+{
+  MqttTelemetry client(broker, settings, 1);
+  client.poll(0);
+  addReadings(client, 3, 10, 10000);
+  run(client, 10000, 10000 + BATCH_AGE - 1);
+  client.poll(10000 + BATCH_AGE - 1);
+  TEST_ASSERT_EQUAL(0, broker.publishes);
+  client.poll(10000 + BATCH_AGE);
+  TEST_ASSERT_EQUAL(1, broker.publishes);
+  TEST_ASSERT_EQUAL(3, broker.samples);
+  TEST_ASSERT_TRUE(client.connected());  // Kept alive by the pings meanwhile
+}
+
+void test_a_batch_is_sent_again_until_its_puback()
+{
+  MqttTelemetry client(broker, settings, 1);
+  client.poll(0);
+  broker.acking = false;
+  addReadings(client, BATCH_SAMPLES, 0, 1000);
+  client.poll(1000);
+  uint16_t id = broker.lastId;
+  TEST_ASSERT_FALSE(broker.lastDup);
+  char payload[MQTT_PAYLOAD_SIZE + 1];
+  strcpy(payload, broker.lastPayload);
+
+  client.poll(1000 + MQTT_RETRY_TIME - 1);
+  TEST_ASSERT_EQUAL(1, broker.publishes);
+  for (int i = 1; i <= 3; i++)
+  {
+    client.poll(1000 + i * MQTT_RETRY_TIME);
+    TEST_ASSERT_EQUAL(1 + i, broker.publishes);
+    TEST_ASSERT_TRUE(broker.lastDup);
+    TEST_ASSERT_EQUAL(id, broker.lastId);
+    TEST_ASSERT_EQUAL_STRING(payload, broker.lastPayload);
+  }
+  TEST_ASSERT_EQUAL(3, client.stats().retransmitted);
+
+  broker.ack(id);
+  client.poll(1000 + 3 * MQTT_RETRY_TIME + 100);
+  TEST_ASSERT_EQUAL(1, client.stats().acked);
+  client.poll(1000 + 5 * MQTT_RETRY_TIME);
+  TEST_ASSERT_EQUAL(4, broker.publishes);
+}
+
+void test_an_unacknowledged_batch_is_published_again_after_a_reconnection()
+{
+  MqttTelemetry client(broker, settings, 1);
+  client.poll(0);
+  broker.acking = false;
+  addReadings(client, BATCH_SAMPLES, 0, 1000);
+  client.poll(1000);
+  uint16_t id = broker.lastId;
+
+  broker.open = false;  // Connection lost
+  broker.acking = true;
+  uint32_t now = 1100;
+  while (broker.connects < 2) now += client.poll(now);
+  client.poll(now + 100);
+  TEST_ASSERT_EQUAL(2, broker.publishes);
+  TEST_ASSERT_EQUAL(id, broker.lastId);
+  TEST_ASSERT_EQUAL(1, client.stats().acked);
+}
+
+void test_the_batch_keeps_the_last_48_readings()
+{
+  MqttTelemetry client(broker, settings, 1);
+  addReadings(client, MQTT_BATCH_MAX_SAMPLES, 0, 0);
+  TEST_ASSERT_EQUAL(0, client.stats().samplesDropped);
+  addReadings(client, 2, MQTT_BATCH_MAX_SAMPLES, 0);
+  TEST_ASSERT_EQUAL(2, client.stats().samplesDropped);
+
+  // The oldest two are gone, the others are all published: the whole batches at once, the rest when 5 minutes old
+  run(client, 0, BATCH_AGE + 1000);
+  TEST_ASSERT_TRUE(strncmp(broker.firstPayload, "{\"t\":2,\"s\":[[0,0,2562],", 23) == 0);
+  TEST_ASSERT_EQUAL(MQTT_BATCH_MAX_SAMPLES, broker.samples);
+  TEST_ASSERT_EQUAL(2, client.stats().samplesDropped);
+}
+
+void test_a_refused_connection_waits_the_backoff()
+{
+  broker.online = false;
+  MqttTelemetry client(broker, settings, 1);
+  uint32_t wait = client.poll(0);
+  TEST_ASSERT_EQUAL(1, broker.connects);
+  TEST_ASSERT_EQUAL(1, client.stats().connectFailures);
+  TEST_ASSERT_TRUE(wait >= MQTT_BACKOFF_MIN / 2 && wait <= MQTT_BACKOFF_MIN);
+
+  client.poll(wait - 1);
+  TEST_ASSERT_EQUAL(1, broker.connects);
+  uint32_t next = client.poll(wait);
+  TEST_ASSERT_EQUAL(2, broker.connects);
+  TEST_ASSERT_TRUE(next >= MQTT_BACKOFF_MIN && next <= 2 * MQTT_BACKOFF_MIN);
+
+  broker.online = true;
+  client.poll(wait + next);
+  TEST_ASSERT_TRUE(client.connected());
+  TEST_ASSERT_EQUAL(1, client.stats().connects);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_a_batch_is_published_at_12_readings);
+  RUN_TEST(test_a_batch_is_published_when_5_minutes_old);
+  RUN_TEST(test_a_batch_is_sent_again_until_its_puback);
+  RUN_TEST(test_an_unacknowledged_batch_is_published_again_after_a_reconnection);
+  RUN_TEST(test_the_batch_keeps_the_last_48_readings);
+  RUN_TEST(test_a_refused_connection_waits_the_backoff);
+  return UNITY_END();
+}
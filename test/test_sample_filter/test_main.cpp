@@ -0,0 +1,135 @@
+// Filter between the sensor readings and the alarm engine:
+//   pio test -e native -f test_sample_filter
+
+#include <unity.h>
+#include "SampleFilter.h"
+#include "AlarmEngine.h"
+
+#define MINUTE 60000
+
+const sampleFilterSettings settings = {3, 0, 1280};  // As the zones: median of 3, 10 °C per minute
+sampleFilterState filter;
+int16_t filtered;
+
+uint8_t feed(uint32_t now, int16_t raw)
+{
+  return filterSample(filter, settings, now, raw, filtered);
+}
+
+void setUp()
+{
+  filter = sampleFilterState();
+  filtered = 0;
+}
+
+void tearDown() {}
+
+void test_readings_go_through_the_median()
+{
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(0, 2560));
+  TEST_ASSERT_EQUAL(2560, filtered);
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(MINUTE, 2600));
+  TEST_ASSERT_EQUAL(2560, filtered);  // Lower of the two
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(2 * MINUTE, 2580));
+  TEST_ASSERT_EQUAL(2580, filtered);
+  TEST_ASSERT_EQUAL(3, filter.accepted);
+}
+
+void test_a_power_on_value_without_a_rise_is_rejected()
+{
+  feed(0, 2560);
+  TEST_ASSERT_EQUAL(FILTER_REJECTED_POWER_ON, feed(MINUTE, POWER_ON_RAW));
+  TEST_ASSERT_EQUAL(1, filter.rejectedPowerOn);
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(2 * MINUTE, 2570));
+}
+
+void test_the_first_reading_may_not_be_the_power_on_value()
+{
+  TEST_ASSERT_EQUAL(FILTER_REJECTED_POWER_ON, feed(0, POWER_ON_RAW));
+  TEST_ASSERT_EQUAL(0, filter.accepted);
+}
+
+void test_a_real_85_degrees_reached_gradually_is_accepted()
+{
+  feed(0, POWER_ON_RAW - 40);
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(MINUTE, POWER_ON_RAW));
+}
+
+void test_the_power_on_value_is_never_taken_as_real()
+{
+  feed(0, 2560);
+  for (int i = 1; i <= 20; i++) TEST_ASSERT_EQUAL(FILTER_REJECTED_POWER_ON, feed(i * MINUTE, POWER_ON_RAW));
+  TEST_ASSERT_EQUAL(20, filter.rejectedPowerOn);
+  TEST_ASSERT_EQUAL(1, filter.accepted);
+}
+
+void test_a_fast_change_is_accepted_after_the_rejections()
+{
+  feed(0, 2560);
+  for (int i = 1; i <= FILTER_MAX_REJECTS; i++) TEST_ASSERT_EQUAL(FILTER_REJECTED_SLEW, feed(i * 1000, 6400));
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(4000, 6400));
+  TEST_ASSERT_EQUAL(6400, filtered);  // The filter starts again from it, the median does not hold it back
+  TEST_ASSERT_EQUAL(FILTER_MAX_REJECTS, filter.rejectedSlew);
+}
+
+void test_the_slew_allowed_grows_with_the_time_elapsed()
+{
+  feed(0, 2560);
+  TEST_ASSERT_EQUAL(FILTER_REJECTED_SLEW, feed(MINUTE, 2560 + 1280 + FILTER_SLEW_MARGIN + 1));
+  TEST_ASSERT_EQUAL(FILTER_ACCEPTED, feed(MINUTE, 2560 + 1280 + FILTER_SLEW_MARGIN));
+}
+
+void test_the_moving_average()
+{
+  const sampleFilterSettings average = {1, 2, 0};  // No median, a new reading weighs 1/4
+  filterSample(filter, average, 0, 1000, filtered);
+  TEST_ASSERT_EQUAL(1000, filtered);
+  filterSample(filter, average, MINUTE, 2000, filtered);
+  TEST_ASSERT_EQUAL(1250, filtered);
+}
+
+// A sensor browning out on every read, as readZones() sees it: the rejected readings are failed ones
+void test_a_sensor_stuck_at_the_power_on_value_fails()
+{
+  const alarmThresholds thresholds = {30 * 128, 35 * 128, 29 * 128, 34 * 128};
+  const alarmSettings alarm = {5, 3600000};
+  alarmState state;
+  uint8_t actions = 0;
+  feed(0, 2560);
+  alarmStep(state, thresholds, alarm, 0, true, filtered);
+  for (int i = 1; i <= 10; i++)
+  {
+    bool valid = feed(i * MINUTE, POWER_ON_RAW) == FILTER_ACCEPTED;
+    actions |= alarmStep(state, thresholds, alarm, i * MINUTE, valid, filtered);
+  }
+  TEST_ASSERT_EQUAL(SENSOR_FAILURE, state.status);
+  TEST_ASSERT_EQUAL(10, state.failedReadings);
+  TEST_ASSERT_TRUE(actions & ACTION_NOTIFY_SENSOR_FAILURE);
+  TEST_ASSERT_FALSE(actions & (ACTION_NOTIFY_PRE_ALARM | ACTION_NOTIFY_ALARM));
+}
+
+void test_reset_keeps_the_counters()
+{
+  feed(0, 2560);
+  feed(MINUTE, POWER_ON_RAW);
+  resetFilter(filter);
+  TEST_ASSERT_EQUAL(0, filter.windowCount);
+  TEST_ASSERT_EQUAL(1, filter.accepted);
+  TEST_ASSERT_EQUAL(1, filter.rejectedPowerOn);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_readings_go_through_the_median);
+  RUN_TEST(test_a_power_on_value_without_a_rise_is_rejected);
+  RUN_TEST(test_the_first_reading_may_not_be_the_power_on_value);
+  RUN_TEST(test_a_real_85_degrees_reached_gradually_is_accepted);
+  RUN_TEST(test_the_power_on_value_is_never_taken_as_real);
+  RUN_TEST(test_a_fast_change_is_accepted_after_the_rejections);
+  RUN_TEST(test_the_slew_allowed_grows_with_the_time_elapsed);
+  RUN_TEST(test_the_moving_average);
+  RUN_TEST(test_a_sensor_stuck_at_the_power_on_value_fails);
+  RUN_TEST(test_reset_keeps_the_counters);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+// Deadline scheduler of loop():
+//   pio test -e native -f test_scheduler
+
+#include <unity.h>
+#include "Scheduler.h"
+
+Scheduler scheduler;
+int runs[64];  // Ids of the jobs run, in order
+int runCount;
+
+void record(int job)
+{
+  runs[runCount++] = job;
+}
+
+// Schedules itself again 100 ms after its deadline
+void periodic(int job)
+{
+  record(job);
+  scheduler.scheduleNext(job, 100, scheduler.deadline(job));
+}
+
+void setUp()
+{
+  scheduler = Scheduler();
+  runCount = 0;
+}
+
+void tearDown() {}
+
+void test_jobs_run_earliest_deadline_first()
+{
+  const uint64_t deadlines[] = {500, 100, 700, 300, 200, 800, 600, 400};
+  for (uint64_t deadline : deadlines) scheduler.schedule(scheduler.addJob(record), deadline);
+  TEST_ASSERT_EQUAL(100, scheduler.nextDeadline());
+
+  TEST_ASSERT_EQUAL(8, scheduler.runDue(1000));
+  TEST_ASSERT_EQUAL(8, runCount);
+  for (int i = 1; i < runCount; i++) TEST_ASSERT_TRUE(scheduler.deadline(runs[i - 1]) < scheduler.deadline(runs[i]));
+  TEST_ASSERT_EQUAL(SCHEDULER_NEVER, scheduler.nextDeadline());
+}
+
+void test_only_due_jobs_run()
+{
+  int early = scheduler.addJob(record);
+  int late = scheduler.addJob(record);
+  scheduler.schedule(late, 2000);
+  scheduler.schedule(early, 1000);
+
+  TEST_ASSERT_EQUAL(0, scheduler.runDue(999));
+  TEST_ASSERT_EQUAL(1, scheduler.runDue(1000));
+  TEST_ASSERT_EQUAL(early, runs[0]);
+  TEST_ASSERT_FALSE(scheduler.isScheduled(early));
+  TEST_ASSERT_TRUE(scheduler.isScheduled(late));
+  TEST_ASSERT_EQUAL(2000, scheduler.nextDeadline());
+}
+
+void test_addJob_fails_when_full()
+{
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) TEST_ASSERT_EQUAL(i, scheduler.addJob(record));
+  TEST_ASSERT_EQUAL(-1, scheduler.addJob(record));
+}
+
+void test_reschedule_moves_a_job_both_ways()
+{
+  int a = scheduler.addJob(record);
+  int b = scheduler.addJob(record);
+  int c = scheduler.addJob(record);
+  scheduler.schedule(a, 100);
+  scheduler.schedule(b, 200);
+  scheduler.schedule(c, 300);
+
+  scheduler.schedule(a, 400);  // Later
+  TEST_ASSERT_EQUAL(200, scheduler.nextDeadline());
+  scheduler.schedule(c, 50);  // Earlier
+  TEST_ASSERT_EQUAL(50, scheduler.nextDeadline());
+
+  scheduler.runDue(1000);
+  TEST_ASSERT_EQUAL(3, runCount);
+  TEST_ASSERT_EQUAL(c, runs[0]);
+  TEST_ASSERT_EQUAL(b, runs[1]);
+  TEST_ASSERT_EQUAL(a, runs[2]);
+}
+
+void test_cancel_takes_a_job_out()
+{
+  int jobs[5];
+  for (int i = 0; i < 5; i++)
+  {
+    jobs[i] = scheduler.addJob(record);
+    scheduler.schedule(jobs[i], 100 * (i + 1));
+  }
+  scheduler.cancel(jobs[0]);  // The root of the heap
+  scheduler.cancel(jobs[3]);
+  scheduler.cancel(jobs[3]);  // Not scheduled any more, nothing happens
+  TEST_ASSERT_FALSE(scheduler.isScheduled(jobs[0]));
+  TEST_ASSERT_EQUAL(200, scheduler.nextDeadline());
+
+  TEST_ASSERT_EQUAL(3, scheduler.runDue(1000));
+  TEST_ASSERT_EQUAL(jobs[1], runs[0]);
+  TEST_ASSERT_EQUAL(jobs[2], runs[1]);
+  TEST_ASSERT_EQUAL(jobs[4], runs[2]);
+}
+
+void test_a_job_can_reschedule_itself()
+{
+  int job = scheduler.addJob(periodic);
+  scheduler.schedule(job, 100);
+  TEST_ASSERT_EQUAL(1, scheduler.runDue(150));
+  TEST_ASSERT_EQUAL(200, scheduler.nextDeadline());
+  TEST_ASSERT_EQUAL(1, scheduler.runDue(250));
+  TEST_ASSERT_EQUAL(300, scheduler.nextDeadline());
+}
+
+void test_scheduleNext_skips_missed_periods()
+{
+  int job = scheduler.addJob(record);
+  scheduler.scheduleNext(job, 100, 1000);  // Never scheduled: one period from now
+  TEST_ASSERT_EQUAL(1100, scheduler.deadline(job));
+  scheduler.scheduleNext(job, 100, 1050);
+  TEST_ASSERT_EQUAL(1200, scheduler.deadline(job));
+  scheduler.scheduleNext(job, 100, 5000);  // Long busy: no burst of missed runs
+  TEST_ASSERT_EQUAL(5100, scheduler.deadline(job));
+}
+
+void test_equal_deadlines_all_run()
+{
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) scheduler.schedule(scheduler.addJob(record), 100);
+  TEST_ASSERT_EQUAL(SCHEDULER_MAX_JOBS, scheduler.runDue(100));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_jobs_run_earliest_deadline_first);
+  RUN_TEST(test_only_due_jobs_run);
+  RUN_TEST(test_addJob_fails_when_full);
+  RUN_TEST(test_reschedule_moves_a_job_both_ways);
+  RUN_TEST(test_cancel_takes_a_job_out);
+  RUN_TEST(test_a_job_can_reschedule_itself);
+  RUN_TEST(test_scheduleNext_skips_missed_periods);
+  RUN_TEST(test_equal_deadlines_all_run);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+// Blink patterns of the status LED, played on a fake LedHal:
+//   pio test -e native -f test_status_led
+
+#include <unity.h>
+#include "StatusLed.h"
+
+// Records the last blink asked and how many there were
+class FakeLed : public LedHal
+{
+public:
+  uint8_t color = LED_OFF;
+  uint16_t onTime = 0;
+  uint16_t offTime = 0;
+  int blinks = 0;
+
+  void blink(uint8_t c, uint16_t on, uint16_t off) override
+  {
+    color = c;
+    onTime = on;
+    offTime = off;
+    blinks++;
+  }
+};
+
+FakeLed led;
+
+const ledStep steadySteps[] = {{LED_GREEN, 50, 950, 0}};
+const ledPattern steady = {steadySteps, 1};
+const ledStep otherSteadySteps[] = {{LED_RED, 50, 250, 0}};
+const ledPattern otherSteady = {otherSteadySteps, 1};
+// 2 red blinks of 200 ms, then 1 blue blink of 1000 ms: a 1400 ms cycle
+const ledStep alternatingSteps[] = {{LED_RED, 100, 100, 2}, {LED_BLUE, 500, 500, 1}};
+const ledPattern alternating = {alternatingSteps, 2};
+
+void setUp()
+{
+  led = FakeLed();
+}
+
+void tearDown() {}
+
+void test_play_starts_the_first_step()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(alternating, 0);
+  TEST_ASSERT_EQUAL(1, led.blinks);
+  TEST_ASSERT_EQUAL(LED_RED, led.color);
+  TEST_ASSERT_EQUAL(100, led.onTime);
+  TEST_ASSERT_EQUAL(100, led.offTime);
+  TEST_ASSERT_TRUE(sequencer.pattern() == &alternating);
+  TEST_ASSERT_EQUAL(0, sequencer.step());
+}
+
+void test_playing_the_same_pattern_does_not_restart_it()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(alternating, 0);
+  sequencer.update(450);
+  TEST_ASSERT_EQUAL(1, sequencer.step());
+  sequencer.play(alternating, 500);
+  TEST_ASSERT_EQUAL(2, led.blinks);
+  TEST_ASSERT_EQUAL(1, sequencer.step());
+}
+
+void test_a_new_pattern_replaces_the_running_one()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(steady, 0);
+  sequencer.play(otherSteady, 10);
+  TEST_ASSERT_EQUAL(2, led.blinks);
+  TEST_ASSERT_EQUAL(LED_RED, led.color);
+  TEST_ASSERT_EQUAL(250, led.offTime);
+  sequencer.play(steady, 20);
+  TEST_ASSERT_EQUAL(LED_GREEN, led.color);
+}
+
+void test_a_single_step_needs_no_update()
+{
+  LedSequencer sequencer(led);
+  TEST_ASSERT_EQUAL(LED_NO_CHANGE, sequencer.update(0));
+  sequencer.play(steady, 0);
+  TEST_ASSERT_EQUAL(LED_NO_CHANGE, sequencer.update(100000));
+  TEST_ASSERT_EQUAL(1, led.blinks);
+}
+
+void test_steps_follow_their_durations()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(alternating, 0);
+  TEST_ASSERT_EQUAL(400, sequencer.update(0));
+  TEST_ASSERT_EQUAL(1, sequencer.update(399));
+  TEST_ASSERT_EQUAL(1, led.blinks);
+
+  TEST_ASSERT_EQUAL(1000, sequencer.update(400));
+  TEST_ASSERT_EQUAL(LED_BLUE, led.color);
+  TEST_ASSERT_EQUAL(1, sequencer.step());
+
+  TEST_ASSERT_EQUAL(400, sequencer.update(1400));
+  TEST_ASSERT_EQUAL(LED_RED, led.color);
+  TEST_ASSERT_EQUAL(0, sequencer.step());
+  TEST_ASSERT_EQUAL(3, led.blinks);
+}
+
+void test_a_late_update_keeps_the_planned_step_ends()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(alternating, 0);
+  // 50 ms late: the blue step still ends at 1400
+  TEST_ASSERT_EQUAL(950, sequencer.update(450));
+  TEST_ASSERT_EQUAL(400, sequencer.update(1400));
+}
+
+void test_a_long_pause_skips_whole_cycles()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(alternating, 0);
+  // 100 cycles later, 500 ms into the blue step
+  TEST_ASSERT_EQUAL(500, sequencer.update(100 * 1400 + 900));
+  TEST_ASSERT_EQUAL(1, sequencer.step());
+  TEST_ASSERT_EQUAL(LED_BLUE, led.color);
+  TEST_ASSERT_TRUE(led.blinks <= 3);
+}
+
+void test_the_clock_may_wrap()
+{
+  LedSequencer sequencer(led);
+  sequencer.play(alternating, UINT32_MAX - 100);
+  TEST_ASSERT_EQUAL(1000, sequencer.update(299));
+  TEST_ASSERT_EQUAL(LED_BLUE, led.color);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_play_starts_the_first_step);
+  RUN_TEST(test_playing_the_same_pattern_does_not_restart_it);
+  RUN_TEST(test_a_new_pattern_replaces_the_running_one);
+  RUN_TEST(test_a_single_step_needs_no_update);
+  RUN_TEST(test_steps_follow_their_durations);
+  RUN_TEST(test_a_late_update_keeps_the_planned_step_ends);
+  RUN_TEST(test_a_long_pause_skips_whole_cycles);
+  RUN_TEST(test_the_clock_may_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,141 @@
+// WiFi link kept up in background, on a fake station interface:
+//   pio test -e native -f test_wifi_reconnect
+
+#include <unity.h>
+#include "WiFiReconnect.h"
+
+// Counts the calls; the test decides when the link is up
+class FakeLink : public WiFiLink
+{
+public:
+  bool up = false;
+  int begins = 0;
+  int disconnects = 0;
+
+  bool connected() override { return up; }
+  void begin() override { begins++; }
+  void disconnect() override
+  {
+    up = false;
+    disconnects++;
+  }
+};
+
+FakeLink link;
+
+void setUp()
+{
+  link = FakeLink();
+}
+
+void tearDown() {}
+
+void test_reconnect_starts_an_attempt()
+{
+  WiFiReconnect wifi(link, 1);
+  wifi.reconnect(0);
+  TEST_ASSERT_EQUAL(1, link.begins);
+  TEST_ASSERT_EQUAL(1, link.disconnects);
+  TEST_ASSERT_FALSE(wifi.connected());
+  TEST_ASSERT_EQUAL(WIFI_CHECK_INTERVAL, wifi.poll(0));
+
+  link.up = true;
+  TEST_ASSERT_EQUAL(WIFI_CHECK_INTERVAL, wifi.poll(2000));
+  TEST_ASSERT_TRUE(wifi.connected());
+  TEST_ASSERT_EQUAL(1, wifi.stats().attempts);
+}
+
+void test_a_lost_link_is_retried_at_once()
+{
+  WiFiReconnect wifi(link, 1);
+  wifi.reconnect(0);
+  link.up = true;
+  wifi.poll(1000);
+  link.up = false;
+  wifi.poll(60000);
+  TEST_ASSERT_EQUAL(1, wifi.stats().linkLosses);
+  TEST_ASSERT_EQUAL(2, link.begins);
+}
+
+void test_a_timed_out_attempt_waits_a_growing_backoff()
+{
+  WiFiReconnect wifi(link, 1);
+  wifi.reconnect(0);
+  uint32_t now = 0;
+  uint32_t limit = WIFI_BACKOFF_MIN;
+  for (int failure = 1; failure <= 4; failure++)
+  {
+    // The attempt is dropped exactly at its timeout
+    uint32_t start = now;
+    while (now - start < WIFI_CONNECT_TIMEOUT) now += wifi.poll(now);
+    TEST_ASSERT_EQUAL(start + WIFI_CONNECT_TIMEOUT, now);
+    wifi.poll(now);
+    TEST_ASSERT_EQUAL(failure, wifi.stats().failures);
+    TEST_ASSERT_EQUAL(failure + 1, link.disconnects);
+
+    // Then nothing is started until the backoff is over
+    uint32_t waitStart = now;
+    int begins = link.begins;
+    while (link.begins == begins) now += wifi.poll(now);
+    uint32_t wait = now - waitStart;
+    TEST_ASSERT_TRUE(wait >= limit / 2 && wait <= limit);
+    limit *= 2;
+  }
+  TEST_ASSERT_EQUAL(5, wifi.stats().attempts);
+}
+
+void test_a_link_back_by_itself_is_taken()
+{
+  WiFiReconnect wifi(link, 1);
+  wifi.reconnect(0);
+  wifi.poll(WIFI_CONNECT_TIMEOUT);  // Waiting for the backoff
+  link.up = true;  // The driver got there on its own
+  wifi.poll(WIFI_CONNECT_TIMEOUT + 1000);
+  TEST_ASSERT_TRUE(wifi.connected());
+  TEST_ASSERT_EQUAL(1, link.begins);
+}
+
+void test_success_resets_the_backoff()
+{
+  WiFiReconnect wifi(link, 1);
+  wifi.reconnect(0);
+  uint32_t now = 0;
+  for (int i = 0; i < 6; i++)  // The backoff is now well over the minimum
+  {
+    int begins = link.begins;
+    while (link.begins == begins) now += wifi.poll(now);
+  }
+  link.up = true;
+  now += wifi.poll(now);
+  link.up = false;
+  now += wifi.poll(now);  // Lost: a new attempt at once
+  uint32_t start = now;
+  while (now - start < WIFI_CONNECT_TIMEOUT) now += wifi.poll(now);
+  wifi.poll(now);
+  int begins = link.begins;
+  uint32_t waitStart = now;
+  while (link.begins == begins) now += wifi.poll(now);
+  TEST_ASSERT_TRUE(now - waitStart <= WIFI_BACKOFF_MIN);
+}
+
+void test_the_clock_may_wrap()
+{
+  WiFiReconnect wifi(link, 1);
+  uint32_t now = UINT32_MAX - 1000;
+  wifi.reconnect(now);
+  now += WIFI_CONNECT_TIMEOUT;
+  wifi.poll(now);
+  TEST_ASSERT_EQUAL(1, wifi.stats().failures);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_reconnect_starts_an_attempt);
+  RUN_TEST(test_a_lost_link_is_retried_at_once);
+  RUN_TEST(test_a_timed_out_attempt_waits_a_growing_backoff);
+  RUN_TEST(test_a_link_back_by_itself_is_taken);
+  RUN_TEST(test_success_resets_the_backoff);
+  RUN_TEST(test_the_clock_may_wrap);
+  return UNITY_END();
+}
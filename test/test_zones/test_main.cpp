@@ -0,0 +1,262 @@
+// Zones read through SensorBuses from simulated sensors, as the monitor and the simulator do:
+//   pio test -e native -f test_zones
+
+#include <unity.h>
+#include <string.h>
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include "Zones.h"
+
+// One bus with two DS18B20, unplugged unless present is set
+struct bench {
+  OneWire wire{15};
+  SimDevice rack{SIM_DS18B20, 0x0000A1B2C3D4};
+  SimDevice aisle{SIM_DS18B20, 0x0000A1B2C3D5};
+  DallasTemperature sensors{&wire};
+  SensorBuses buses;
+
+  bench(bool present)
+  {
+    if (!present)
+    {
+      rack.setFaults(SIM_FAULT_ABSENT);
+      aisle.setFaults(SIM_FAULT_ABSENT);
+    }
+    wire.attach(rack);
+    wire.attach(aisle);
+    rack.setTemperature(22.0f);
+    aisle.setTemperature(21.0f);
+    buses.addBus(sensors);
+    buses.begin();
+  }
+};
+
+// Keeps what readZones() reported for each zone
+class RecordingListener : public ZoneListener
+{
+public:
+  void zoneRead(int zoneIndex, uint8_t result, int16_t raw, uint8_t actions) override
+  {
+    results[zoneIndex] = result;
+    raws[zoneIndex] = raw;
+    this->actions[zoneIndex] |= actions;
+    calls++;
+  }
+
+  void clear()
+  {
+    memset(actions, 0, sizeof(actions));
+    calls = 0;
+  }
+
+  uint8_t results[MAX_ZONES];
+  int16_t raws[MAX_ZONES];
+  uint8_t actions[MAX_ZONES];
+  int calls;
+};
+
+const zoneSettings settings = {{SENSOR_FAILURE_READINGS, 600000}, {FILTER_MEDIAN_LENGTH, FILTER_EMA_SHIFT, FILTER_MAX_SLEW}};
+bench *b;
+deviceConfig cfg;
+zone zones[MAX_ZONES];
+int zoneCount;
+RecordingListener listener;
+
+// Runs a mesurement as runMesurement() and collectMesurement() do, then moves on one minute
+uint8_t mesure(bool fullRead)
+{
+  listener.clear();
+  watchZones(b->buses, zones, zoneCount);
+  uint32_t wait = b->buses.requestTemperatures(millis(), !fullRead);
+  while (wait != BUSES_COLLECTED)
+  {
+    delay(wait);
+    wait = b->buses.collect(millis());
+  }
+  uint8_t actions = readZones(b->buses, zones, zoneCount, settings, millis(), listener);
+  delay(60000);
+  return actions;
+}
+
+// Maps the sensors of a new bench to the zones of a device seen for the first time
+void start(bool present)
+{
+  b = new bench(present);
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.alarms = {30.0f, 35.0f, 1.0f, 60, 10};
+  bool configChanged = false;
+  zoneCount = mapZones(b->buses, cfg, zones, configChanged);
+  TEST_ASSERT_EQUAL(present, configChanged);
+  configureSensors(b->buses, zones, zoneCount, 12, true);
+}
+
+void setUp()
+{
+  start(true);
+}
+
+void tearDown()
+{
+  delete b;
+}
+
+void test_new_sensors_get_a_zone_and_a_slot()
+{
+  TEST_ASSERT_EQUAL(2, zoneCount);
+  for (int i = 0; i < zoneCount; i++)
+  {
+    TEST_ASSERT_EQUAL(i, zones[i].device);
+    TEST_ASSERT_TRUE(cfg.zoneSlotUsed[zones[i].nvsSlot]);
+    TEST_ASSERT_EQUAL_MEMORY(b->buses.reading(i).address, cfg.zones[zones[i].nvsSlot].address, 8);
+  }
+  TEST_ASSERT_TRUE(zones[0].nvsSlot != zones[1].nvsSlot);
+  TEST_ASSERT_EQUAL_STRING("Zone 1", zones[0].config.name);
+  TEST_ASSERT_EQUAL(30 * 128, zones[0].thresholds.preAlarm);
+  TEST_ASSERT_EQUAL(29 * 128, zones[0].thresholds.preAlarmReset);
+}
+
+void test_known_sensors_keep_their_settings()
+{
+  strcpy(cfg.zones[zones[1].nvsSlot].name, "Corridoio");
+  cfg.zones[zones[1].nvsSlot].preAlarmTemperature = 25.5f;
+  bool configChanged = false;
+  zoneCount = mapZones(b->buses, cfg, zones, configChanged);
+  TEST_ASSERT_FALSE(configChanged);
+  TEST_ASSERT_EQUAL_STRING("Corridoio", zones[1].config.name);
+  TEST_ASSERT_EQUAL(3264, zones[1].thresholds.preAlarm);
+  TEST_ASSERT_EQUAL(27, sensorHighAlarm(zones[0]));  // SAMPLING_FAR_MARGIN under the pre alarm, in whole degrees
+  TEST_ASSERT_EQUAL(22, sensorHighAlarm(zones[1]));
+}
+
+void test_without_sensors_a_zone_is_kept()
+{
+  delete b;
+  start(false);
+  TEST_ASSERT_EQUAL(1, zoneCount);
+  TEST_ASSERT_EQUAL(-1, zones[0].device);
+  uint8_t actions = 0;
+  for (int i = 0; i < SENSOR_FAILURE_READINGS; i++) actions |= mesure(false);
+  TEST_ASSERT_EQUAL(ZONE_FAILED, listener.results[0]);
+  TEST_ASSERT_EQUAL(SENSOR_FAILURE, zones[0].alarm.status);
+  TEST_ASSERT_TRUE(actions & ACTION_NOTIFY_SENSOR_FAILURE);
+}
+
+void test_the_thresholds_keep_the_resets_under_them()
+{
+  zone z;
+  z.config.preAlarmTemperature = 30.0f;
+  z.config.alarmTemperature = 30.5f;
+  setZoneThresholds(z, 0.0f);
+  TEST_ASSERT_EQUAL(30 * 128 - 1, z.thresholds.preAlarmReset);
+  TEST_ASSERT_EQUAL(z.thresholds.alarm - 1, z.thresholds.alarmReset);
+}
+
+void test_quiet_slow_zones_are_read_only_by_full_reads()
+{
+  mesure(true);
+  TEST_ASSERT_EQUAL(ZONE_READ, listener.results[0]);
+  TEST_ASSERT_EQUAL(SAMPLING_SLOW, zones[0].samplingLevel);
+  uint32_t readingTime = zones[0].readingTime;
+  mesure(false);
+  TEST_ASSERT_EQUAL(2, listener.calls);
+  TEST_ASSERT_EQUAL(ZONE_NOT_READ, listener.results[0]);
+  TEST_ASSERT_EQUAL(ZONE_NOT_READ, listener.results[1]);
+  TEST_ASSERT_EQUAL(readingTime, zones[0].readingTime);  // Nothing new to record
+  TEST_ASSERT_EQUAL(22 * 128, zones[0].tempRaw);
+}
+
+void test_zones_closer_to_the_threshold_are_watched()
+{
+  mesure(true);
+  b->rack.setTemperature(27.5f);  // Over TH, so it answers the alarm search anyway
+  b->aisle.setTemperature(21.5f);
+  mesure(false);
+  mesure(false);  // The median takes the new value with the second reading
+  TEST_ASSERT_EQUAL(ZONE_READ, listener.results[0]);
+  TEST_ASSERT_EQUAL(3520, zones[0].tempRaw);
+  TEST_ASSERT_EQUAL(ZONE_NOT_READ, listener.results[1]);
+  TEST_ASSERT_TRUE(zones[0].samplingLevel != SAMPLING_SLOW);
+  // Back under TH but still watched, the adaptive sampling follows it
+  b->rack.setTemperature(25.5f);
+  mesure(false);
+  TEST_ASSERT_EQUAL(ZONE_READ, listener.results[0]);
+  TEST_ASSERT_TRUE(b->buses.reading(0).watched);
+}
+
+void test_a_failed_sensor_is_read_until_it_is_back()
+{
+  mesure(true);
+  b->aisle.setFaults(SIM_FAULT_ABSENT);
+  mesure(false);
+  TEST_ASSERT_EQUAL(ZONE_NOT_READ, listener.results[1]);  // Quiet as far as the alarm search can tell
+  mesure(true);
+  TEST_ASSERT_EQUAL(ZONE_FAILED, listener.results[1]);
+  mesure(false);
+  TEST_ASSERT_EQUAL(ZONE_FAILED, listener.results[1]);
+  b->aisle.setFaults(0);
+  mesure(false);
+  TEST_ASSERT_EQUAL(ZONE_READ, listener.results[1]);
+  TEST_ASSERT_EQUAL(0, zones[1].alarm.failedReadings);
+}
+
+void test_a_sensor_stuck_at_the_power_on_value_fails()
+{
+  mesure(true);
+  b->rack.powerCycle();
+  b->rack.setFaults(SIM_FAULT_NO_CONVERSION);
+  uint8_t actions = 0;
+  for (int i = 0; i < 2 * SENSOR_FAILURE_READINGS; i++)
+  {
+    actions |= mesure(true);
+    TEST_ASSERT_EQUAL(ZONE_REJECTED, listener.results[0]);
+    TEST_ASSERT_EQUAL(POWER_ON_RAW, listener.raws[0]);
+  }
+  TEST_ASSERT_EQUAL(SENSOR_FAILURE, zones[0].alarm.status);
+  TEST_ASSERT_TRUE(actions & ACTION_NOTIFY_SENSOR_FAILURE);
+  TEST_ASSERT_FALSE(actions & (ACTION_NOTIFY_PRE_ALARM | ACTION_NOTIFY_ALARM));
+  TEST_ASSERT_EQUAL(22 * 128, zones[0].tempRaw);  // The last real reading
+}
+
+void test_the_sampling_level_slows_down_after_the_hold()
+{
+  uint8_t holdCount = 0;
+  zones[0].samplingLevel = SAMPLING_FAST;
+  zones[1].samplingLevel = SAMPLING_SLOW;
+  TEST_ASSERT_EQUAL(SAMPLING_FAST, nextSamplingLevel(SAMPLING_SLOW, holdCount, zones, zoneCount));
+  zones[0].samplingLevel = SAMPLING_SLOW;
+  for (int i = 1; i < SAMPLING_HOLD_CYCLES; i++)
+    TEST_ASSERT_EQUAL(SAMPLING_FAST, nextSamplingLevel(SAMPLING_FAST, holdCount, zones, zoneCount));
+  TEST_ASSERT_EQUAL(SAMPLING_NORMAL, nextSamplingLevel(SAMPLING_FAST, holdCount, zones, zoneCount));
+  TEST_ASSERT_EQUAL(0, holdCount);
+  // A mesurement that wants the current level again starts the hold over
+  nextSamplingLevel(SAMPLING_NORMAL, holdCount, zones, zoneCount);
+  zones[0].samplingLevel = SAMPLING_NORMAL;
+  TEST_ASSERT_EQUAL(SAMPLING_NORMAL, nextSamplingLevel(SAMPLING_NORMAL, holdCount, zones, zoneCount));
+  TEST_ASSERT_EQUAL(0, holdCount);
+}
+
+void test_the_worst_status_is_shown()
+{
+  TEST_ASSERT_EQUAL(IDLE, worstZoneStatus(zones, zoneCount));
+  zones[1].alarm.status = PRE_ALARM;
+  TEST_ASSERT_EQUAL(PRE_ALARM, worstZoneStatus(zones, zoneCount));
+  zones[0].alarm.status = SENSOR_FAILURE;
+  TEST_ASSERT_EQUAL(SENSOR_FAILURE, worstZoneStatus(zones, zoneCount));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_new_sensors_get_a_zone_and_a_slot);
+  RUN_TEST(test_known_sensors_keep_their_settings);
+  RUN_TEST(test_without_sensors_a_zone_is_kept);
+  RUN_TEST(test_the_thresholds_keep_the_resets_under_them);
+  RUN_TEST(test_quiet_slow_zones_are_read_only_by_full_reads);
+  RUN_TEST(test_zones_closer_to_the_threshold_are_watched);
+  RUN_TEST(test_a_failed_sensor_is_read_until_it_is_back);
+  RUN_TEST(test_a_sensor_stuck_at_the_power_on_value_fails);
+  RUN_TEST(test_the_sampling_level_slows_down_after_the_hold);
+  RUN_TEST(test_the_worst_status_is_shown);
+  return UNITY_END();
+}